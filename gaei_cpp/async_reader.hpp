@@ -0,0 +1,411 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <future>
+#include <fstream>
+#include <filesystem>
+#include <system_error>
+#include <algorithm>
+#include <variant>
+#include "trace.hpp"
+#include "ouchilib/result/result.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) && !defined(GAEI_NO_IO_URING)
+#define GAEI_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace gaei {
+
+/// <summary>
+/// ファイル全体をdestに読み込む。destの容量は再利用される。
+/// </summary>
+inline ouchi::result::result<std::monostate, std::string>
+read_file(const std::filesystem::path& path, std::string& dest)
+{
+    using namespace std::string_literals;
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec) return ouchi::result::err(path.string() + ": "s + ec.message());
+    std::ifstream file(path, std::ios::binary);
+    dest.resize(static_cast<std::size_t>(size));
+    if (!file.read(dest.data(), static_cast<std::streamsize>(size)))
+        return ouchi::result::err("cannot read "s + path.string());
+    return ouchi::result::ok(std::monostate{});
+}
+
+/// <summary>
+/// ファイルを読み取り専用でメモリにマップする。大きな点群ファイルを一度に読み込まずに済む。
+/// マップできない環境ではファイル全体を読み込む。
+/// </summary>
+class mapped_file {
+public:
+    mapped_file() = default;
+    ~mapped_file() { close(); }
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ouchi::result::result<std::monostate, std::string>
+    open(const std::filesystem::path& path)
+    {
+        using namespace std::string_literals;
+        close();
+#if !defined(_WIN32)
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return ouchi::result::err(path.string() + ": "s + std::strerror(errno));
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return ouchi::result::err(path.string() + ": "s + std::strerror(errno));
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_) {
+            auto p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data_ = static_cast<const char*>(p);
+                // 先頭から順に読むことをカーネルに伝える
+                ::madvise(p, size_, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        if (data_ || !size_) return ouchi::result::ok(std::monostate{});
+#endif
+        if (auto r = read_file(path, buffer_); !r) return r;
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        return ouchi::result::ok(std::monostate{});
+    }
+    void close() noexcept
+    {
+#if !defined(_WIN32)
+        if (data_ && data_ != buffer_.data()) ::munmap(const_cast<char*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        std::string().swap(buffer_);
+    }
+
+    [[nodiscard]]
+    std::string_view data() const noexcept { return { data_, size_ }; }
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    // マップできなかった場合に読み込んだ内容
+    std::string buffer_;
+};
+
+/// <summary>
+/// ファイルの列を先読みしながら順番に読み込む。
+/// 呼び出し元が1つのファイルをパースしている間に、後続のファイルの読み込みを最大depth個まで並行して進める。
+/// 先読みしているファイルの合計の大きさはbudget[byte]を超えない。ただし1つで超えるファイルは単独で読む。
+/// </summary>
+/// <remarks>
+/// Linuxではio_uringで読み込み、使用できなければファイルごとにスレッドで読み込む。
+/// 読み終えたバッファは次のファイルに再利用する。
+/// </remarks>
+/// <example>
+/// <code>
+/// async_reader reader(files);
+/// for (auto&amp; f : files) {
+///     auto r = reader.next();
+///     if (!r) return r.unwrap_err();
+///     parse(r.unwrap());
+/// }
+/// </code>
+/// </example>
+class async_reader {
+public:
+    explicit async_reader(std::vector<std::filesystem::path> files,
+                          unsigned depth = 4,
+                          std::size_t budget = std::size_t{ 256 } << 20,
+                          bool use_io_uring = true)
+        : files_{ std::move(files) }
+        , depth_{ std::max(depth, 1u) }
+        , budget_{ budget }
+    {
+#if defined(GAEI_HAS_IO_URING)
+        if (use_io_uring) ring_.setup(depth_);
+#else
+        (void)use_io_uring;
+#endif
+    }
+    ~async_reader()
+    {
+        // 読み込み中のバッファを解放しないよう、全ての完了を待つ
+        for (auto& s : window_) {
+            if (s.pending.valid()) s.pending.wait();
+        }
+#if defined(GAEI_HAS_IO_URING)
+        while (ring_.in_flight) reap(true);
+        for (auto& s : window_) s.close();
+#endif
+    }
+    async_reader(const async_reader&) = delete;
+    async_reader& operator=(const async_reader&) = delete;
+
+    /// <summary>
+    /// 次のファイルの内容を返す。戻り値は次にnextを呼ぶまで有効である。
+    /// </summary>
+    ouchi::result::result<std::string_view, std::string> next()
+    {
+        using namespace std::string_literals;
+        if (!window_.empty()) {
+            // 前回返したバッファを再利用に回す
+            in_flight_bytes_ -= window_.front().size;
+            if (free_.size() < depth_) free_.push_back(std::move(window_.front().data));
+            window_.pop_front();
+        }
+        if (consumed_ == files_.size()) return ouchi::result::err("no more files"s);
+        fill();
+        auto& s = window_.front();
+        {
+            trace_scope ts("read_wait");
+            wait(s);
+        }
+        ++consumed_;
+        if (!s.error.empty()) return ouchi::result::err(s.error);
+        bytes_ += s.data.size();
+        return ouchi::result::ok(std::string_view{ s.data });
+    }
+
+    [[nodiscard]]
+    bool done() const noexcept { return consumed_ == files_.size(); }
+    /// <summary>
+    /// これまでに読み込んだバイト数。
+    /// </summary>
+    [[nodiscard]]
+    std::size_t bytes_read() const noexcept { return bytes_; }
+    [[nodiscard]]
+    const char* backend() const noexcept
+    {
+#if defined(GAEI_HAS_IO_URING)
+        if (ring_.fd >= 0) return "io_uring";
+#endif
+        return "thread";
+    }
+
+private:
+    struct slot {
+        std::size_t index = 0;
+        std::size_t size = 0;
+        std::string data;
+        std::string error;
+        bool complete = false;
+        // スレッドで読み込む場合の完了通知
+        std::future<void> pending;
+#if defined(GAEI_HAS_IO_URING)
+        int fd = -1;
+        std::size_t done = 0;
+        void close() noexcept
+        {
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+#endif
+    };
+
+    std::vector<std::filesystem::path> files_;
+    unsigned depth_;
+    std::size_t budget_;
+    // 先頭が次に返すファイル。要素への参照はpush_backとpop_frontで無効にならない
+    std::deque<slot> window_;
+    std::vector<std::string> free_;
+    std::size_t started_ = 0;
+    std::size_t consumed_ = 0;
+    std::size_t in_flight_bytes_ = 0;
+    std::size_t bytes_ = 0;
+
+    // 個数と合計の大きさが許す限り、次のファイルの読み込みを始める
+    void fill()
+    {
+        while (started_ < files_.size() && window_.size() < depth_) {
+            std::error_code ec;
+            auto size = static_cast<std::size_t>(std::filesystem::file_size(files_[started_], ec));
+            if (ec) size = 0;
+            if (!window_.empty() && in_flight_bytes_ + size > budget_) break;
+            auto& s = window_.emplace_back();
+            s.index = started_;
+            s.size = size;
+            if (!free_.empty()) {
+                s.data = std::move(free_.back());
+                free_.pop_back();
+            }
+            in_flight_bytes_ += size;
+            start(s, files_[started_++]);
+        }
+    }
+
+    void start(slot& s, const std::filesystem::path& path)
+    {
+#if defined(GAEI_HAS_IO_URING)
+        if (ring_.fd >= 0) {
+            using namespace std::string_literals;
+            s.data.resize(s.size);
+            s.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (s.fd < 0) {
+                s.error = path.string() + ": "s + std::strerror(errno);
+                s.complete = true;
+            }
+            else if (s.size == 0) {
+                s.close();
+                s.complete = true;
+            }
+            else submit(s);
+            return;
+        }
+#endif
+        s.pending = std::async(std::launch::async, [&s, path] {
+            if (auto r = read_file(path, s.data); !r) s.error = r.unwrap_err();
+        });
+    }
+
+    void wait(slot& s)
+    {
+        if (s.pending.valid()) {
+            s.pending.get();
+            s.complete = true;
+        }
+#if defined(GAEI_HAS_IO_URING)
+        while (!s.complete) reap(true);
+#endif
+    }
+
+#if defined(GAEI_HAS_IO_URING)
+    // システムコールを直接使う最小限のio_uring
+    struct ring {
+        int fd = -1;
+        unsigned in_flight = 0;
+        void* sq_ptr = nullptr;
+        void* cq_ptr = nullptr;
+        std::size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+        unsigned *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+        unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+        io_uring_sqe* sqes = nullptr;
+        io_uring_cqe* cqes = nullptr;
+
+        ring() = default;
+        ring(const ring&) = delete;
+        ring& operator=(const ring&) = delete;
+        ~ring() { reset(); }
+
+        void reset() noexcept
+        {
+            if (sqes) ::munmap(sqes, sqes_size);
+            if (cq_ptr && cq_ptr != sq_ptr) ::munmap(cq_ptr, cq_size);
+            if (sq_ptr) ::munmap(sq_ptr, sq_size);
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+            sq_ptr = cq_ptr = nullptr;
+            sqes = nullptr;
+        }
+
+        // 失敗した場合はfdが負のままになり、スレッドで読み込む
+        void setup(unsigned entries) noexcept
+        {
+            io_uring_params p{};
+            int f = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+            if (f < 0) return;
+            sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+            if (single) sq_size = cq_size = std::max(sq_size, cq_size);
+            sq_ptr = map(sq_size, f, IORING_OFF_SQ_RING);
+            cq_ptr = single ? sq_ptr : map(cq_size, f, IORING_OFF_CQ_RING);
+            sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(map(sqes_size, f, IORING_OFF_SQES));
+            fd = f;
+            if (!sq_ptr || !cq_ptr || !sqes) return reset();
+            auto sq = static_cast<char*>(sq_ptr);
+            sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+            sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+            auto cq = static_cast<char*>(cq_ptr);
+            cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+            cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        }
+        static void* map(std::size_t size, int f, off_t offset) noexcept
+        {
+            auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, f, offset);
+            return p == MAP_FAILED ? nullptr : p;
+        }
+    } ring_;
+
+    // 1回の読み込みの最大長。io_uringの長さは32bitなので分割する
+    static constexpr std::size_t max_read = std::size_t{ 1 } << 30;
+
+    // sの未読の部分を1つの要求として投入する
+    void submit(slot& s)
+    {
+        const auto tail = *ring_.sq_tail;
+        const auto idx = tail & *ring_.sq_mask;
+        auto& sqe = ring_.sqes[idx];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = s.fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(s.data.data() + s.done);
+        sqe.len = static_cast<std::uint32_t>(std::min(s.size - s.done, max_read));
+        sqe.off = s.done;
+        sqe.user_data = s.index;
+        ring_.sq_array[idx] = idx;
+        __atomic_store_n(ring_.sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++ring_.in_flight;
+        while (::syscall(__NR_io_uring_enter, ring_.fd, 1, 0, 0, nullptr, 0) < 0 && errno == EINTR);
+    }
+
+    // 完了した要求を処理する。waitがtrueなら少なくとも1つ完了するまで待つ
+    void reap(bool wait)
+    {
+        using namespace std::string_literals;
+        if (wait) {
+            while (::syscall(__NR_io_uring_enter, ring_.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno == EINTR);
+        }
+        auto head = *ring_.cq_head;
+        const auto tail = __atomic_load_n(ring_.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const auto& cqe = ring_.cqes[head & *ring_.cq_mask];
+            --ring_.in_flight;
+            auto it = std::find_if(window_.begin(), window_.end(),
+                                   [&cqe](auto& s) { return s.index == cqe.user_data; });
+            if (it == window_.end()) continue;
+            auto& s = *it;
+            if (cqe.res < 0) {
+                s.error = files_[s.index].string() + ": "s + std::strerror(-cqe.res);
+            }
+            else if (cqe.res == 0 && s.done < s.size) {
+                // 読み込み中にファイルが短くなった
+                s.data.resize(s.done);
+                s.size = s.done;
+            }
+            else s.done += static_cast<std::size_t>(cqe.res);
+            if (s.error.empty() && s.done < s.size) {
+                submit(s);
+                continue;
+            }
+            s.close();
+            s.complete = true;
+        }
+        __atomic_store_n(ring_.cq_head, head, __ATOMIC_RELEASE);
+    }
+#endif
+};
+
+}
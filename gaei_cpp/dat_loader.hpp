@@ -7,14 +7,65 @@
 #include <filesystem>
 #include <string_view>
 #include <charconv>
+#include <memory>
 #include "ouchilib/result/result.hpp"
 #include "ouchilib/tokenizer/tokenizer.hpp"
 #include "ouchilib/utl/translator.hpp"
 #include "vertex.hpp"
 #include "color.hpp"
 
+#if defined(GAEI_HAS_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(GAEI_HAS_ZSTD)
+#include <zstd.h>
+#endif
+
 namespace gaei {
 
+/// <summary>
+/// 点群ファイルの形式。.datファイルは圧縮形式で区別する。
+/// </summary>
+enum class dat_format {
+    none,   // 点群ファイルではない
+    plain,  // .dat
+    gzip,   // .dat.gz
+    zstd,   // .dat.zst
+    las,    // .las。<see cref="las_loader"/>で読み込む
+};
+
+/// <summary>
+/// 拡張子から点群ファイルの形式を判定する。
+/// </summary>
+inline dat_format dat_format_of(const std::filesystem::path& path)
+{
+    auto ext = path.extension();
+    if (ext == ".dat") return dat_format::plain;
+    if (ext == ".las" || ext == ".LAS") return dat_format::las;
+    if (path.stem().extension() != ".dat") return dat_format::none;
+    if (ext == ".gz") return dat_format::gzip;
+    if (ext == ".zst") return dat_format::zstd;
+    return dat_format::none;
+}
+
+/// <summary>
+/// この実行ファイルが読み込める形式ならtrueを返す。gzipとzstdはビルド時にライブラリが見つかった場合だけ読み込める。
+/// </summary>
+constexpr bool dat_format_supported(dat_format f) noexcept
+{
+    switch (f) {
+    case dat_format::plain: return true;
+    case dat_format::las: return true;
+#if defined(GAEI_HAS_ZLIB)
+    case dat_format::gzip: return true;
+#endif
+#if defined(GAEI_HAS_ZSTD)
+    case dat_format::zstd: return true;
+#endif
+    default: return false;
+    }
+}
+
 class dat_loader {
     static ouchi::tokenizer::separator<char> init_sep()
     {
@@ -40,6 +91,15 @@ public:
     }
     ouchi::result::result<std::monostate, std::string>
     load(const std::filesystem::path& path, std::vector<vertex<vec3f, color>>& dest) const
+    {
+        return load(path, dest, accept_all{});
+    }
+    /// <summary>
+    /// ファイルを読み込み、pred(点)がtrueとなる点だけをdestに追加する。
+    /// </summary>
+    template<class Pred>
+    ouchi::result::result<std::monostate, std::string>
+    load(const std::filesystem::path& path, std::vector<vertex<vec3f, color>>& dest, Pred&& pred) const
     {
         using namespace std::string_literals;
         if (!std::filesystem::exists(path))
@@ -50,7 +110,10 @@ public:
         s.resize(size);
         file.read(s.data(), size);
         
-        return std::move(load_from_memory(s, dest));
+        // 拡張子が.datでないファイルは非圧縮として読む
+        auto format = dat_format_of(path);
+        if (format == dat_format::none) format = dat_format::plain;
+        return load_from_memory(s, format, dest, std::forward<Pred>(pred));
     }
     /// <summary>
     /// ストリームからデータを読み取り、パースして点集合を返す。
@@ -95,19 +158,71 @@ public:
     }
     ouchi::result::result<std::monostate, std::string>
     load_from_memory(std::string_view s, std::vector<vertex<vec3f, color>>& dest) const
+    {
+        return load_from_memory(s, dest, accept_all{});
+    }
+    /// <summary>
+    /// メモリ上のデータをパースし、pred(点)がtrueとなる点だけをdestに追加する。
+    /// 捨てられる点は実体化されない。
+    /// </summary>
+    template<class Pred>
+    ouchi::result::result<std::monostate, std::string>
+    load_from_memory(std::string_view s, std::vector<vertex<vec3f, color>>& dest, Pred&& pred) const
     {
         while (s.size()) {
             auto lsize = s.find_first_of('\n') + 1;
             if (lsize == std::string_view::npos) break;
             std::string_view line = s.substr(0, lsize);
             s.remove_prefix(lsize);
-            if(auto ver = load_line(line))
-                dest.push_back(ver.unwrap());
+            if (auto ver = load_line(line)) {
+                if (pred(ver.unwrap())) dest.push_back(ver.unwrap());
+            }
             else return ouchi::result::err(ver.unwrap_err() + line.data());
         }
         return ouchi::result::ok(std::monostate{});
     }
+    /// <summary>
+    /// formatの形式で圧縮されたデータをchunk[byte]ずつ展開しながらパースし、pred(点)がtrueとなる点だけをdestに追加する。
+    /// 展開したデータ全体をメモリ上に置くことはない。結果は展開したデータを<see cref="load_from_memory"/>に渡した場合と同じである。
+    /// </summary>
+    template<class Pred>
+    ouchi::result::result<std::monostate, std::string>
+    load_from_memory(std::string_view s, dat_format format,
+                     std::vector<vertex<vec3f, color>>& dest, Pred&& pred,
+                     std::size_t chunk = std::size_t{ 1 } << 20) const
+    {
+        using namespace std::string_literals;
+        if (format == dat_format::plain) return load_from_memory(s, dest, std::forward<Pred>(pred));
+        if (format == dat_format::none || format == dat_format::las) return ouchi::result::err("not a .dat file"s);
+        // チャンクの境界をまたぐ行
+        std::string carry;
+        auto consume = [&](std::string_view out) -> ouchi::result::result<std::monostate, std::string> {
+            if (carry.size()) {
+                auto p = out.find('\n');
+                carry.append(out.substr(0, p == std::string_view::npos ? out.size() : p + 1));
+                if (p == std::string_view::npos) return ouchi::result::ok(std::monostate{});
+                out.remove_prefix(p + 1);
+                if (auto r = load_from_memory(carry, dest, pred); !r) return r;
+                carry.clear();
+            }
+            auto last = out.rfind('\n');
+            if (last == std::string_view::npos) {
+                carry.assign(out);
+                return ouchi::result::ok(std::monostate{});
+            }
+            carry.assign(out.substr(last + 1));
+            return load_from_memory(out.substr(0, last + 1), dest, pred);
+        };
+        auto r = format == dat_format::gzip ? inflate_gzip(s, chunk, consume) : decompress_zstd(s, chunk, consume);
+        if (!r) return r;
+        // 改行で終わらない最後の行は、非圧縮の場合と同じ扱いにする
+        if (carry.size()) return load_from_memory(carry, dest, pred);
+        return ouchi::result::ok(std::monostate{});
+    }
 private:
+    struct accept_all {
+        constexpr bool operator()(const vertex<vec3f, color>&) const noexcept { return true; }
+    };
 
     ouchi::result::result<vertex<vec3f, color>, std::string>
     load_line(std::string_view line) const noexcept
@@ -130,6 +245,66 @@ private:
         if (vec_c < 3) return ouchi::result::err("too short line!"s);
         return ouchi::result::ok(vertex<vec3f, color>{pos, colors::none});
     }
+
+    // sを展開し、chunk[byte]以下の断片ごとにconsumeに渡す
+    template<class Consume>
+    static ouchi::result::result<std::monostate, std::string>
+    inflate_gzip([[maybe_unused]] std::string_view s, [[maybe_unused]] std::size_t chunk, [[maybe_unused]] Consume& consume)
+    {
+        using namespace std::string_literals;
+#if defined(GAEI_HAS_ZLIB)
+        z_stream zs{};
+        // 15 + 32: gzipとzlibのヘッダーを自動で判定する
+        if (inflateInit2(&zs, 15 + 32) != Z_OK) return ouchi::result::err("cannot initialize zlib"s);
+        std::string out(chunk, '\0');
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(s.data()));
+        zs.avail_in = static_cast<uInt>(s.size());
+        int ret = Z_OK;
+        while (true) {
+            zs.next_out = reinterpret_cast<Bytef*>(out.data());
+            zs.avail_out = static_cast<uInt>(out.size());
+            ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END) break;
+            if (auto r = consume(std::string_view(out.data(), out.size() - zs.avail_out)); !r) {
+                inflateEnd(&zs);
+                return r;
+            }
+            if (ret == Z_STREAM_END) {
+                // 連結された複数のgzipメンバー
+                if (zs.avail_in == 0) break;
+                inflateReset(&zs);
+            }
+        }
+        inflateEnd(&zs);
+        if (ret != Z_STREAM_END) return ouchi::result::err("corrupted gzip data: "s + (zs.msg ? zs.msg : "unexpected end"));
+        return ouchi::result::ok(std::monostate{});
+#else
+        return ouchi::result::err("gzip is not supported in this build"s);
+#endif
+    }
+    template<class Consume>
+    static ouchi::result::result<std::monostate, std::string>
+    decompress_zstd([[maybe_unused]] std::string_view s, [[maybe_unused]] std::size_t chunk, [[maybe_unused]] Consume& consume)
+    {
+        using namespace std::string_literals;
+#if defined(GAEI_HAS_ZSTD)
+        std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> ds(ZSTD_createDStream(), &ZSTD_freeDStream);
+        if (!ds) return ouchi::result::err("cannot initialize zstd"s);
+        std::string out(chunk, '\0');
+        ZSTD_inBuffer in{ s.data(), s.size(), 0 };
+        std::size_t ret = 0;
+        while (in.pos < in.size || ret != 0) {
+            ZSTD_outBuffer o{ out.data(), out.size(), 0 };
+            ret = ZSTD_decompressStream(ds.get(), &o, &in);
+            if (ZSTD_isError(ret)) return ouchi::result::err("corrupted zstd data: "s + ZSTD_getErrorName(ret));
+            if (auto r = consume(std::string_view(out.data(), o.pos)); !r) return r;
+            if (in.pos == in.size && o.pos == 0 && ret != 0) return ouchi::result::err("corrupted zstd data: unexpected end"s);
+        }
+        return ouchi::result::ok(std::monostate{});
+#else
+        return ouchi::result::err("zstd is not supported in this build"s);
+#endif
+    }
 };
 
 }
@@ -0,0 +1,165 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include "vertex.hpp"
+#include "parallel.hpp"
+#include "radix_sort.hpp"
+#include "ouchilib/result/result.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// xy座標が同じ点をまとめるときに残すz座標の決め方。
+/// </summary>
+enum class dedup_policy {
+    none,   // まとめない
+    first,  // 最初に読み込んだ点
+    min,    // zが最も小さい点
+    max,    // zが最も大きい点
+    mean,   // zの平均
+};
+
+// xy座標を同じとみなす格子の間隔[m]の既定値
+inline constexpr double default_dedup_tolerance = 0.001;
+
+/// <summary>
+/// "none", "first", "min", "max", "mean"のいずれかの文字列からまとめ方を得る。
+/// </summary>
+inline ouchi::result::result<dedup_policy, std::string>
+parse_dedup_policy(std::string_view s)
+{
+    using namespace std::string_literals;
+    if (s == "none") return ouchi::result::ok(dedup_policy::none);
+    if (s == "first") return ouchi::result::ok(dedup_policy::first);
+    if (s == "min") return ouchi::result::ok(dedup_policy::min);
+    if (s == "max") return ouchi::result::ok(dedup_policy::max);
+    if (s == "mean") return ouchi::result::ok(dedup_policy::mean);
+    return ouchi::result::err("dedup must be none, first, min, max or mean: "s + std::string(s));
+}
+
+/// <summary>
+/// xy座標を格子に丸めた値と、点の番号。
+/// </summary>
+struct xy_key {
+    std::uint64_t x;
+    std::uint64_t y;
+    std::size_t index;
+
+    [[nodiscard]]
+    bool same_position(const xy_key& o) const noexcept { return x == o.x && y == o.y; }
+};
+
+/// <summary>
+/// 点のxy座標を間隔toleranceの格子に丸め、丸めた座標の順に並べた<see cref="xy_key"/>を返す。
+/// 丸めた座標が同じ点は隣り合い、その中では番号の順に並ぶ。
+/// </summary>
+/// <remarks>
+/// 丸めた座標から最小値を引いて非負にし、必要な桁数だけ基数ソートする。
+/// </remarks>
+inline std::vector<xy_key> sort_by_xy(const std::vector<vertex<>>& vs, double tolerance = default_dedup_tolerance)
+{
+    const auto n = vs.size();
+    if (!n) return {};
+    const auto quantize = [tolerance](double v) { return static_cast<std::int64_t>(std::llround(v / tolerance)); };
+    const auto chunks = chunk_count(n);
+    std::vector<std::int64_t> min_x(chunks, std::numeric_limits<std::int64_t>::max()), min_y(min_x);
+    std::vector<std::int64_t> max_x(chunks, std::numeric_limits<std::int64_t>::lowest()), max_y(max_x);
+    parallel_chunks(n, chunks, [&](std::size_t b, std::size_t e, std::size_t c) {
+        for (auto i = b; i < e; ++i) {
+            const auto x = quantize(vs[i].position.x());
+            const auto y = quantize(vs[i].position.y());
+            min_x[c] = std::min(min_x[c], x);
+            min_y[c] = std::min(min_y[c], y);
+            max_x[c] = std::max(max_x[c], x);
+            max_y[c] = std::max(max_y[c], y);
+        }
+    });
+    const auto mx = *std::min_element(min_x.begin(), min_x.end());
+    const auto my = *std::min_element(min_y.begin(), min_y.end());
+    auto bytes_of = [](std::uint64_t range) {
+        unsigned bytes = 1;
+        while (bytes < sizeof(range) && (range >> (bytes * 8))) ++bytes;
+        return bytes;
+    };
+    const auto bx = bytes_of(static_cast<std::uint64_t>(*std::max_element(max_x.begin(), max_x.end())) - static_cast<std::uint64_t>(mx));
+    const auto by = bytes_of(static_cast<std::uint64_t>(*std::max_element(max_y.begin(), max_y.end())) - static_cast<std::uint64_t>(my));
+    std::vector<xy_key> keys(n);
+    parallel_for(n, [&](std::size_t b, std::size_t e) {
+        for (auto i = b; i < e; ++i) {
+            keys[i] = { static_cast<std::uint64_t>(quantize(vs[i].position.x())) - static_cast<std::uint64_t>(mx),
+                        static_cast<std::uint64_t>(quantize(vs[i].position.y())) - static_cast<std::uint64_t>(my),
+                        i };
+        }
+    });
+    // 最下位の桁はxの最下位バイト、最上位の桁はyの最上位バイト
+    radix_sort(keys, bx + by, [bx](const xy_key& k, unsigned pass) {
+        return static_cast<std::uint8_t>(pass < bx ? k.x >> (pass * 8) : k.y >> ((pass - bx) * 8));
+    });
+    return keys;
+}
+
+/// <summary>
+/// xy座標を間隔toleranceの格子に丸めて同じになる点を1つにまとめ、取り除いた点の数を返す。
+/// まとめた点は最初に読み込んだ点の位置に残り、そのxy座標を使う。zと色はpolicyに従う(meanでは最初の点の色)。
+/// 残った点は元の順序を保つ。
+/// </summary>
+/// <remarks>
+/// 隣り合うタイルは境界の行を共有するので、連結した点群には同じxy座標の点が含まれる。
+/// <see cref="sort_by_xy"/>で同じ座標の組を見つけ、組ごとの処理は区間に分けて並列に行う。
+/// </remarks>
+inline std::size_t remove_duplicate_points(std::vector<vertex<>>& vs,
+                                           dedup_policy policy = dedup_policy::first,
+                                           double tolerance = default_dedup_tolerance)
+{
+    const auto n = vs.size();
+    if (policy == dedup_policy::none || n < 2) return 0;
+    const auto keys = sort_by_xy(vs, tolerance);
+    std::vector<char> drop(n, 0);
+    const auto same = [&keys](std::size_t a, std::size_t b) { return keys[a].same_position(keys[b]); };
+    // keys[b, e)が同じ座標の組。最初の点に結果を書き、残りを取り除く印を付ける
+    const auto merge = [&](std::size_t b, std::size_t e) {
+        auto& keep = vs[keys[b].index];
+        auto chosen = keys[b].index;
+        double sum = 0;
+        for (auto i = b; i < e; ++i) {
+            const auto k = keys[i].index;
+            const auto z = vs[k].position.z();
+            sum += z;
+            if ((policy == dedup_policy::min && z < vs[chosen].position.z()) ||
+                (policy == dedup_policy::max && z > vs[chosen].position.z())) chosen = k;
+            if (i != b) drop[k] = 1;
+        }
+        if (policy == dedup_policy::mean) keep.position.z() = sum / static_cast<double>(e - b);
+        else if (chosen != keys[b].index) {
+            keep.position.z() = vs[chosen].position.z();
+            keep.color = vs[chosen].color;
+        }
+    };
+    parallel_for(n, [&](std::size_t b, std::size_t e) {
+        // 区間の境界をまたぐ組は、組が始まる区間で処理する
+        while (b > 0 && b < n && same(b - 1, b)) ++b;
+        while (e < n && same(e - 1, e)) ++e;
+        for (auto i = b; i < e;) {
+            auto j = i + 1;
+            while (j < n && same(i, j)) ++j;
+            if (j - i > 1) merge(i, j);
+            i = j;
+        }
+    });
+    std::size_t out = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (drop[i]) continue;
+        if (out != i) vs[out] = vs[i];
+        ++out;
+    }
+    vs.resize(out);
+    return n - out;
+}
+
+}
@@ -9,142 +9,965 @@
 #include <memory>
 #include <chrono>
 #include <random>
+#include <optional>
+#include <limits>
+#include <sstream>
+#include <locale>
+#include <list>
+#include <deque>
+#include <set>
+#include <mutex>
+#include <future>
+#include <algorithm>
 #include "vertex.hpp"
 #include "vector_utl.hpp"
 #include "color.hpp"
 #include "dat_loader.hpp"
+#include "las_loader.hpp"
 #include "vrml_writer.hpp"
-#include "surface_structure_isolate.hpp"
-#include "reduce_points.hpp"
-#include "normalize.hpp"
-#include "wall.hpp"
-#include "triangle_direction.hpp"
+#include "triangle_postprocess.hpp"
+#include "mesh_partition.hpp"
+#include "pipeline.hpp"
+#include "stage_report.hpp"
+#include "tile_index.hpp"
+#include "tile_cache.hpp"
+#include "memory_resource.hpp"
+#include "lod_pyramid.hpp"
+#include "local_server.hpp"
+#include "async_reader.hpp"
+#include "task_scheduler.hpp"
+#include "shard.hpp"
 
-#include "ouchilib/geometry/triangulation.hpp"
 #include "ouchilib/program_options/program_options_parser.hpp"
 #include "ouchilib/result/result.hpp"
 
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstring>
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+// 読み込む点の条件と、読み込み時に捨てた点の数
+struct load_filter {
+    gaei::region roi;
+    // LASファイルの分類と反射の種類による絞り込み
+    gaei::las_loader las;
+    // roiとLASの絞り込みを表す文字列のハッシュ。キャッシュのキーに使う
+    std::uint64_t roi_hash = 0;
+    const gaei::tile_cache* cache = nullptr;
+    // デーモンモードでメモリ上に保持しているタイル
+    gaei::resident_tiles* resident = nullptr;
+    // 読み込んだ全タイルの内容のハッシュ
+    std::uint64_t input_hash = gaei::fnv1a(std::string_view{});
+    std::size_t errors = 0;
+    // 並行して先読みするファイルの数
+    unsigned read_ahead = 4;
+    // 複数のプロセスで分担するときの分け方と、このプロセスの分担
+    gaei::shard_layout shards;
+    unsigned shard = 0;
+};
+
+// 読み込む.datファイルと、その圧縮形式と、ファイルを含むディレクトリの索引
+struct tile_job {
+    std::filesystem::path path;
+    gaei::dat_format format;
+    gaei::tile_index* index;
+};
+
+// デーモンモードでメモリ上に保持しているタイルがあれば、bufに追加してtrueを返す
+bool load_resident(std::vector<gaei::vertex<>>& buf,
+                   const std::filesystem::path& p,
+                   load_filter& filter)
+{
+    auto t = filter.resident ? filter.resident->find(p, filter.roi_hash) : nullptr;
+    if (!t) return false;
+    gaei::scoped_stage s("load_file", buf.size());
+    std::cout << "resident " << p.string() << std::endl;
+    buf.insert(buf.end(), t->points.begin(), t->points.end());
+    filter.errors += t->errors;
+    filter.input_hash = gaei::fnv1a(t->content_hash, filter.input_hash);
+    s.points_out(buf.size());
+    return true;
+}
+
+// 1つのタイルをパースした結果
+struct parsed_tile {
+    std::uint64_t content_hash = 0;
+    // 捨てた誤差点の数
+    std::size_t errors = 0;
+    // パースしたファイルの範囲。キャッシュから読み、範囲もキャッシュになかった場合は空
+    std::optional<gaei::tile_entry> bounds;
+};
+
+// contentをパースしてbufの末尾に追加する。filterを変更しないので、別々のbufに対して並列に呼び出せる
+[[nodiscard]]
+ouchi::result::result<parsed_tile, std::string>
+parse_tile(std::vector<gaei::vertex<>>& buf,
+           std::string_view content,
+           gaei::dat_format format,
+           const load_filter& filter)
+{
+    parsed_tile t;
+    t.content_hash = gaei::fnv1a(content);
+    const auto key = gaei::fnv1a(filter.roi_hash, t.content_hash);
+    // 内容が変わっていないタイルはパースせずにキャッシュから読む
+    if (filter.cache && filter.cache->load_points(key, buf, t.errors)) {
+        if (gaei::tile_entry bounds; filter.cache->load_bounds(t.content_hash, bounds)) t.bounds = bounds;
+        return ouchi::result::ok(std::move(t));
+    }
+    if(auto size = content.size() >> 5/* / 32*/; format == gaei::dat_format::plain && buf.capacity() <= size)
+        buf.reserve(9 * size/* line size */);
+    const auto first = buf.size();
+    gaei::tile_entry bounds;
+    auto pred = [&filter, &bounds, &t](const gaei::vertex<>& v) {
+        //-9999.99
+        if (v.position.z() < -9000) {
+            ++t.errors;
+            return false;
+        }
+        bounds.add(v.position.x(), v.position.y());
+        return filter.roi.contains(v.position.x(), v.position.y()) &&
+               filter.shards.covers(filter.shard, v.position.x(), v.position.y());
+    };
+    auto r = format == gaei::dat_format::las
+        ? filter.las.load_from_memory(content, buf, pred)
+        : gaei::dat_loader{}.load_from_memory(content, format, buf, pred);
+    if (!r) return ouchi::result::err(std::string(r.unwrap_err()));
+    t.bounds = bounds;
+    if (filter.cache) {
+        if (auto c = filter.cache->store_points(key, buf.data() + first, buf.size() - first, t.errors); !c)
+            std::cout << c.unwrap_err() << std::endl;
+        if (auto c = filter.cache->store_bounds(t.content_hash, bounds); !c) std::cout << c.unwrap_err() << std::endl;
+    }
+    return ouchi::result::ok(std::move(t));
+}
+
+// パースした結果をfilterと索引に反映する。buf[first, end)がタイルの点である
+void commit_tile(const std::vector<gaei::vertex<>>& buf,
+                 std::size_t first,
+                 const std::filesystem::path& p,
+                 const parsed_tile& t,
+                 load_filter& filter,
+                 gaei::tile_index* index)
+{
+    filter.errors += t.errors;
+    filter.input_hash = gaei::fnv1a(t.content_hash, filter.input_hash);
+    if (index && t.bounds) index->update(p, *t.bounds);
+    if (filter.resident) {
+        filter.resident->insert(p, filter.roi_hash,
+                                { t.content_hash, t.errors,
+                                  std::vector<gaei::vertex<>>(buf.begin() + first, buf.end()) });
+    }
+}
+
 [[nodiscard]]
 ouchi::result::result<std::monostate, std::string>
-load(std::vector<gaei::vertex<>>& buf,
-     const std::filesystem::path& p)
+load_file(std::vector<gaei::vertex<>>& buf,
+          const std::filesystem::path& p,
+          std::string_view content,
+          gaei::dat_format format,
+          load_filter& filter,
+          gaei::tile_index* index)
+{
+    const auto path_str = p.string();
+    gaei::trace_scope ts("load_file", path_str);
+    gaei::scoped_stage s("load_file", buf.size());
+    std::cout << "loading " << path_str << std::endl;
+    const auto first = buf.size();
+    auto r = parse_tile(buf, content, format, filter);
+    if (!r) return ouchi::result::err(std::string(r.unwrap_err()));
+    commit_tile(buf, first, p, r.unwrap(), filter, index);
+    s.points_out(buf.size());
+    return ouchi::result::ok(std::monostate{});
+}
+
+// pの下にある読み込むべき.datファイルを、読み込む順にjobsに追加する
+[[nodiscard]]
+ouchi::result::result<std::monostate, std::string>
+collect(const std::filesystem::path& p,
+        const load_filter& filter,
+        std::vector<tile_job>& jobs,
+        std::list<std::pair<std::filesystem::path, gaei::tile_index>>& indexes)
 {
     using namespace std::string_literals;
     std::error_code err;
     bool d = std::filesystem::is_directory(p, err);
     // file not found
     if (err) return ouchi::result::err(err.message());
+    auto add = [&jobs](const std::filesystem::path& file, gaei::tile_index* index) -> ouchi::result::result<std::monostate, std::string> {
+        auto format = gaei::dat_format_of(file);
+        if (!gaei::dat_format_supported(format))
+            return ouchi::result::err("cannot read "s + file.string() + ": compression is not supported in this build"s);
+        jobs.push_back({ file, format, index });
+        return ouchi::result::ok(std::monostate{});
+    };
     // path is directory
     if (d) {
+        auto& index = indexes.emplace_back(p, gaei::tile_index::load(p)).second;
         for (auto&& subp : std::filesystem::directory_iterator(p)) {
-            if(auto r = load(buf, subp.path()); !r) return ouchi::result::err(r.unwrap_err());
+            if (subp.is_directory()) {
+                if (auto r = collect(subp.path(), filter, jobs, indexes); !r) return r;
+            }
+            else if (gaei::dat_format_of(subp.path()) != gaei::dat_format::none) {
+                // 索引から範囲が分かり、領域と重ならないファイルは開かない
+                if (auto e = index.find(subp.path());
+                    e && (!filter.roi.intersects(e->min, e->max) ||
+                          !filter.shards.intersects(filter.shard, e->min.x(), e->min.y(), e->max.x(), e->max.y()))) {
+                    std::cout << "skipping " << subp.path().string() << std::endl;
+                    continue;
+                }
+                if (auto r = add(subp.path(), &index); !r) return r;
+            }
         }
+        return ouchi::result::ok(std::monostate{});
     }
     // path is file
-    if (p.extension() != ".dat") return ouchi::result::ok(std::monostate{});
-    std::cout << "loading " << p.string() << std::endl;
-    if(auto size = std::filesystem::file_size(p) >> 5/* / 32*/; buf.capacity() <= size)
-        buf.reserve(9 * size/* line size */);
-    gaei::dat_loader dl;
-    if (auto r = dl.load(p, buf); !r) return ouchi::result::err(std::string(r.unwrap_err()));
+    if (gaei::dat_format_of(p) != gaei::dat_format::none) return add(p, nullptr);
     return ouchi::result::ok(std::monostate{});
 }
 
 [[nodiscard]]
 ouchi::result::result<std::vector<gaei::vertex<>>, std::string>
-load(const std::vector<std::string>& path)
+load(const std::vector<std::string>& path, load_filter& filter)
 {
-
-    std::vector<gaei::vertex<>> ret;
-    std::filesystem::path fp;
+    std::vector<tile_job> jobs;
+    std::list<std::pair<std::filesystem::path, gaei::tile_index>> indexes;
     for (auto&& p : path) {
-        fp.assign(p);
-        if (auto r = load(ret, fp); !r) return ouchi::result::err(r.unwrap_err());
+        if (auto r = collect(p, filter, jobs, indexes); !r) return ouchi::result::err(r.unwrap_err());
     }
+    // 常駐しているタイルは読まない。ディスクは前のタイルをパースしている間に次のタイルを読む
+    // LASファイルは大きいので、先読みせずにメモリにマップする
+    std::vector<bool> resident(jobs.size());
+    std::vector<std::filesystem::path> reads;
+    for (auto i = 0u; i < jobs.size(); ++i) {
+        resident[i] = filter.resident && filter.resident->find(jobs[i].path, filter.roi_hash);
+        if (!resident[i] && jobs[i].format != gaei::dat_format::las) reads.push_back(jobs[i].path);
+    }
+    gaei::async_reader reader(std::move(reads), filter.read_ahead);
+    // 圧縮されたタイルは、続くものをまとめて別々のスレッドで展開してパースする
+    auto decode = [&filter](std::string content, gaei::dat_format format) {
+        std::vector<gaei::vertex<>> points;
+        auto r = parse_tile(points, content, format, filter);
+        return std::make_pair(std::move(points), std::move(r));
+    };
+    std::deque<std::future<decltype(decode(std::string{}, gaei::dat_format::plain))>> decoding;
+    auto decodable = [&jobs, &resident](std::size_t i) {
+        return !resident[i] && jobs[i].format != gaei::dat_format::plain && jobs[i].format != gaei::dat_format::las;
+    };
+    std::vector<gaei::vertex<>> ret;
+    std::string content;
+    for (std::size_t i = 0, ahead = 0; i < jobs.size(); ++i) {
+        for (ahead = std::max(ahead, i); ahead < jobs.size() && ahead - i < filter.read_ahead && decodable(ahead); ++ahead) {
+            auto c = reader.next();
+            if (!c) return ouchi::result::err(c.unwrap_err());
+            decoding.push_back(std::async(std::launch::async, decode, std::string(c.unwrap()), jobs[ahead].format));
+        }
+        auto& job = jobs[i];
+        if (decodable(i)) {
+            const auto path_str = job.path.string();
+            gaei::trace_scope ts("load_file", path_str);
+            gaei::scoped_stage s("load_file", ret.size());
+            std::cout << "loading " << path_str << std::endl;
+            auto [points, r] = decoding.front().get();
+            decoding.pop_front();
+            if (!r) return ouchi::result::err(r.unwrap_err());
+            const auto first = ret.size();
+            ret.insert(ret.end(), points.begin(), points.end());
+            commit_tile(ret, first, job.path, r.unwrap(), filter, job.index);
+            s.points_out(ret.size());
+            continue;
+        }
+        if (load_resident(ret, job.path, filter)) continue;
+        if (job.format == gaei::dat_format::las) {
+            gaei::mapped_file m;
+            if (auto r = m.open(job.path); !r) return ouchi::result::err(r.unwrap_err());
+            if (auto r = load_file(ret, job.path, m.data(), job.format, filter, job.index); !r) return ouchi::result::err(r.unwrap_err());
+            continue;
+        }
+        if (resident[i]) {
+            // 読み込みの途中で他のタイルに押し出された
+            if (auto r = gaei::read_file(job.path, content); !r) return ouchi::result::err(r.unwrap_err());
+            if (auto r = load_file(ret, job.path, content, job.format, filter, job.index); !r) return ouchi::result::err(r.unwrap_err());
+            continue;
+        }
+        auto c = reader.next();
+        if (!c) return ouchi::result::err(c.unwrap_err());
+        if (auto r = load_file(ret, job.path, c.unwrap(), job.format, filter, job.index); !r) return ouchi::result::err(r.unwrap_err());
+    }
+    for (auto& [dir, index] : indexes) {
+        if (!index.dirty()) continue;
+        if (auto r = index.save(dir); !r) std::cout << r.unwrap_err() << std::endl;
+    }
+    std::cout << "removed error:" << filter.errors << '\n';
     return ouchi::result::ok(std::move(ret));
 }
 
-void label(std::vector<gaei::vertex<>>& vs, const ouchi::program_options::arg_parser& p)
+// 出力に影響するオプションのハッシュ
+std::uint64_t option_hash(const ouchi::program_options::arg_parser& p)
+{
+    std::uint64_t h = gaei::fnv1a(std::to_string(p.get<float>("diff")));
+    h = gaei::fnv1a(std::to_string(p.get<size_t>("remove_minor_labels_threshold")), h);
+    h = gaei::fnv1a(std::to_string(p.get<int>("thinout_width")), h);
+    h = gaei::fnv1a(std::to_string(p.get<int>("lod")), h);
+    h = gaei::fnv1a(std::to_string(p.get<double>("lod_tile_size")), h);
+    h = gaei::fnv1a(p.exist("partition") ? p.get<std::string>("partition") : "-", h);
+    h = gaei::fnv1a(std::to_string(p.get<double>("partition_tile_size")), h);
+    h = gaei::fnv1a(p.get<std::string>("dedup"), h);
+    h = gaei::fnv1a(std::to_string(p.get<double>("dedup_tolerance")), h);
+    h = gaei::fnv1a(std::to_string(p.get<double>("despike")), h);
+    h = gaei::fnv1a(p.get<std::string>("ground"), h);
+    if (p.get<std::string>("ground") == "pmf") {
+        for (auto name : { "pmf_cell_size", "pmf_max_window", "pmf_slope" }) h = gaei::fnv1a(std::to_string(p.get<double>(name)), h);
+    }
+    h = gaei::fnv1a(std::to_string(p.get<int>("shards")), h);
+    h = gaei::fnv1a(p.exist("shard_index") ? std::to_string(p.get<int>("shard_index")) : "-", h);
+    h = gaei::fnv1a(p.exist("shard_extent") ? p.get<std::string>("shard_extent") : "-", h);
+    h = gaei::fnv1a(std::to_string(p.get<double>("shard_margin")), h);
+    h = gaei::fnv1a(std::to_string(p.get<double>("incremental_cell")), h);
+    for (auto flag : { "printer", "onlyground", "onlybuilding", "nooptimize", "nonormal", "tiled", "incremental" }) {
+        h = gaei::fnv1a(p.exist(flag) ? flag : "-", h);
+    }
+    return h;
+}
+
+// コマンドラインのオプションから処理の設定を作る
+gaei::pipeline_options to_pipeline_options(const ouchi::program_options::arg_parser& p)
+{
+    gaei::pipeline_options o;
+    o.diff = p.get<float>("diff");
+    o.remove_minor_labels_threshold = p.get<size_t>("remove_minor_labels_threshold");
+    o.thinout_width = p.get<int>("thinout_width");
+    if (auto d = gaei::parse_dedup_policy(p.get<std::string>("dedup"))) o.dedup = d.unwrap();
+    o.dedup_tolerance = p.get<double>("dedup_tolerance");
+    o.spike_threshold = p.get<double>("despike");
+    if (auto g = gaei::parse_ground_classifier(p.get<std::string>("ground"))) o.ground = g.unwrap();
+    o.pmf.cell_size = p.get<double>("pmf_cell_size");
+    o.pmf.max_window = p.get<double>("pmf_max_window");
+    o.pmf.slope = p.get<double>("pmf_slope");
+    o.printer = p.exist("printer");
+    o.only_ground = p.exist("onlyground");
+    o.only_building = p.exist("onlybuilding");
+    o.optimize = !p.exist("nooptimize");
+    o.normals = !p.exist("nonormal");
+    o.arena = !p.exist("noarena");
+    o.log = &std::cout;
+    return o;
+}
+
+// 頂点、面、法線の配列を複製せずにノードへ移して書き込む
+ouchi::result::result<std::monostate, std::string>
+write(std::vector<gaei::vertex<>> vs,
+      std::vector<long> faces,
+      std::string path,
+      std::vector<gaei::vec3f> normals = {})
+{
+    namespace vrml = gaei::vrml;
+    gaei::stage_arena arena;
+    vrml::vrml_writer vw(arena.resource());
+    const auto n = vs.size();
+    {
+        gaei::scoped_stage s("build_shape", n);
+        vrml::indexed_face_set ifs(std::move(vs), std::move(faces), std::move(normals));
+        ifs.solid = false;
+        // VRMLの座標軸に合わせて(y, z, x)の順に書き込む
+        ifs.axis_order = { 1, 2, 0 };
+        vw.push(vrml::shape<vrml::indexed_face_set, vrml::appearance<>>(std::move(ifs)));
+    }
+    std::cout << "writing " << n << " points to " << path << '\n';
+    gaei::scoped_stage s("vrml_writer", n);
+    return vw.write(path);
+}
+
+// 解像度の異なる階層をタイルごとに別のファイルへ書き出し、pathにはLODノードによる目録を書き込む
+// 書き出したタイルのファイルはfilesに追加する
+ouchi::result::result<std::monostate, std::string>
+write_lod(const std::vector<gaei::vertex<>>& vs,
+          const std::vector<gaei::label_t>& labels,
+          const gaei::label_statistics& lc,
+          const gaei::pipeline& pipe,
+          const ouchi::program_options::arg_parser& p,
+          const std::string& path,
+          std::vector<std::filesystem::path>& files)
 {
-    gaei::surface_structure_isolate ssi{ p.get<float>("diff") };
-    std::cout << "calclating " << vs.size() << " points...\n";
-    gaei::remove_error_point(vs);
-    std::cout << "labeling points..." << std::endl;
-    auto label_cnt = ssi(vs);
-    std::cout << label_cnt << " labels" << std::endl;
-    std::cout << "reducing points..." << std::endl;
-    auto lc = gaei::count_label(label_cnt, vs);
-    if (p.exist("onlyground")) { gaei::extract_ground(lc, vs); }
-    else if (p.exist("onlybuilding")) { gaei::extract_building(lc, vs); }
-    gaei::remove_trivial_surface(lc, vs);
-    gaei::remove_minor_labels(lc, vs, p.get<size_t>("remove_minor_labels_threshold"));
-    gaei::thinout(vs, p.get<int>("thinout_width"));
-    gaei::simplify_color(lc, vs);
+    using namespace std::string_literals;
+    const auto levels = static_cast<unsigned>(p.get<int>("lod"));
+    const auto width = pipe.options().thinout_width;
+    gaei::vec2f min = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    gaei::vec2f max = { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+    for (auto& v : vs) {
+        min = { std::min(min.x(), v.position.x()), std::min(min.y(), v.position.y()) };
+        max = { std::max(max.x(), v.position.x()), std::max(max.y(), v.position.y()) };
+    }
+    // タイルの大きさが指定されなければ、階層0を1枚のタイルにする
+    double tile_size = p.get<double>("lod_tile_size");
+    if (tile_size <= 0) tile_size = std::max({ max.x() - min.x(), max.y() - min.y(), 1.0 });
+    gaei::lod_pyramid pyramid(min, tile_size, levels);
+    const std::filesystem::path out(path);
+    const auto stem = out.stem().string();
+    for (auto level = 0u; level < levels; ++level) {
+        gaei::scoped_stage s("lod_level", vs.size());
+        auto lv = vs;
+        auto ll = labels;
+        pipe.reduce(lv, ll, lc, level);
+        s.points_out(lv.size());
+        auto parts = pyramid.partition(level, lv, width << level);
+        std::cout << "level " << level << ": " << lv.size() << " points, " << parts.size() << " tiles" << std::endl;
+        for (auto& [key, idx] : parts) {
+            if (idx.size() < 3) continue;
+            std::vector<gaei::vertex<>> tv;
+            tv.reserve(idx.size());
+            for (auto i : idx) tv.push_back(lv[i]);
+            gaei::vec2f o;
+            auto ts = pipe.triangulate(tv, nullptr, &o);
+            // タイルごとの原点から全体の最小の角を原点とする座標に移し、すべてのタイルと目録の座標を揃える
+            for (auto& v : tv) {
+                v.position.x() += o.x() - min.x();
+                v.position.y() += o.y() - min.y();
+            }
+            auto ns = pipe.normals(tv, ts);
+            auto faces = pipe.build_faces(tv, ts);
+            auto name = stem + "_L" + std::to_string(level) + '_' + std::to_string(key.first) + '_' + std::to_string(key.second) + ".wrl";
+            pyramid.add(level, key, name, tv);
+            files.push_back(out.parent_path() / name);
+            if (auto r = write(std::move(tv), std::move(faces), files.back().string(), std::move(ns)); !r) return r;
+        }
+    }
+    std::cout << "writing manifest to " << path << '\n';
+    std::ofstream mout(out);
+    if (!mout) return ouchi::result::err("cannot open "s + path);
+    return pyramid.write_manifest(mout);
 }
-std::vector<long> triangulate(std::vector<gaei::vertex<>>& vs,
-                              const ouchi::program_options::arg_parser& p)
+
+// メッシュをラベルまたはタイルごとに分割して別のファイルへ並行して書き出し、pathにはInlineノードによる目録を書き込む
+// 書き出した部分のファイルはfilesに追加する
+ouchi::result::result<std::monostate, std::string>
+write_partitioned(const std::vector<gaei::vertex<>>& vs,
+                  const std::vector<gaei::label_t>& labels,
+                  const std::vector<gaei::triangle>& ts,
+                  gaei::partition_mode mode,
+                  const gaei::pipeline& pipe,
+                  const ouchi::program_options::arg_parser& p,
+                  const std::string& path,
+                  std::vector<std::filesystem::path>& files)
 {
+    using namespace std::string_literals;
+    gaei::vec2f origin = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    for (auto& v : vs) origin = { std::min(origin.x(), v.position.x()), std::min(origin.y(), v.position.y()) };
+    std::vector<gaei::mesh_part> parts;
+    {
+        gaei::scoped_stage s("partition", ts.size());
+        const auto ns = pipe.normals(vs, ts);
+        parts = gaei::partition_mesh(vs, labels, ts, mode, origin, p.get<double>("partition_tile_size"), ns.empty() ? nullptr : &ns);
+        s.points_out(parts.size());
+    }
+    const std::filesystem::path out(path);
+    const auto stem = out.stem().string();
+    std::vector<std::string> names(parts.size());
+    for (std::size_t i = 0; i < parts.size(); ++i) names[i] = stem + '_' + parts[i].name(mode) + ".wrl";
+    // 部分の頂点は書き出すときにノードへ移すので、目録を先に作っておく
+    std::ostringstream index;
+    if (auto r = gaei::write_partition_index(index, parts, names); !r) return r;
+    std::vector<std::string> errors(parts.size());
+    std::cout << "writing " << parts.size() << " partitions..." << std::endl;
+    // 部分を1つずつスレッドに割り当てて書き出す
+    gaei::parallel_for(parts.size(), [&](std::size_t b, std::size_t e) {
+        for (auto i = b; i < e; ++i) {
+            auto& part = parts[i];
+            std::vector<long> faces;
+            faces.reserve(part.triangles.size() * 4);
+            for (auto& t : part.triangles) {
+                faces.insert(faces.end(), { (long)t[0], (long)t[1], (long)t[2], -1 });
+            }
+            std::vector<gaei::triangle>().swap(part.triangles);
+            if (auto r = write(std::move(part.vertices), std::move(faces), (out.parent_path() / names[i]).string(), std::move(part.normals)); !r) errors[i] = r.unwrap_err();
+        }
+    }, 1);
+    for (auto& e : errors) {
+        if (!e.empty()) return ouchi::result::err(e);
+    }
+    for (auto& name : names) files.push_back(out.parent_path() / name);
+    std::cout << "writing index to " << path << '\n';
+    std::ofstream iout(out);
+    if (!iout) return ouchi::result::err("cannot open "s + path);
+    if (!(iout << index.str())) return ouchi::result::err("cannot write "s + path);
+    return ouchi::result::ok(std::monostate{});
+}
+
+// tiledオプションで1つのタイルが段階の間で受け渡すデータ
+struct tiled_work {
+    tile_job job;
+    // 出力するファイルの名前
+    std::string name;
+    std::vector<gaei::vertex<>> points;
+    std::vector<gaei::label_t> labels;
+    gaei::label_statistics lc;
     std::vector<long> faces;
-    if (p.exist("printer")) {
-        gaei::bounding_box(vs);
+    std::vector<gaei::vec3f> normals;
+    std::uint64_t content_hash = 0;
+    // 目録の項目。点が少なく出力しなかったタイルはurlが空
+    // タイルは最初の点を原点とする座標で書き出すので、バウンディングボックスもその座標で表す
+    gaei::vrml::inline_node index;
+    // タイルの原点とした点の元のxy座標
+    gaei::vec2f origin;
+};
+
+// 入力ファイルを独立したタイルとして、読み込みから出力までの段階を異なるタイルについて並行して行う。
+// 各タイルは別のファイルへ書き出し、pathにはInlineノードによる目録を書き込む
+ouchi::result::result<std::monostate, std::string>
+run_tiled(const std::vector<std::string>& path,
+          load_filter& filter,
+          const gaei::pipeline& pipe,
+          const ouchi::program_options::arg_parser& p,
+          const std::string& out_path)
+{
+    using namespace std::string_literals;
+    std::vector<tile_job> jobs;
+    std::list<std::pair<std::filesystem::path, gaei::tile_index>> indexes;
+    for (auto&& in : path) {
+        if (auto r = collect(in, filter, jobs, indexes); !r) return r;
+    }
+    // 進捗は段階ごとに1行で出力し、複数のタイルの出力が混ざらないようにする
+    auto options = pipe.options();
+    options.log = nullptr;
+    const gaei::pipeline quiet(options);
+    const bool output = !p.exist("nooutput");
+    const std::filesystem::path out(out_path);
+    const auto stem = out.stem().string();
+    std::vector<tiled_work> tiles(jobs.size());
+    std::set<std::string> names;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        tiles[i].job = jobs[i];
+        // 拡張子を全て除いたファイル名を使い、異なるディレクトリの同じ名前には番号を付ける
+        auto name = stem + '_' + jobs[i].path.filename().string().substr(0, jobs[i].path.filename().string().find('.'));
+        if (!names.insert(name).second) name += '_' + std::to_string(i);
+        tiles[i].name = name + ".wrl";
+    }
+    // filterと索引、常駐するタイルへのアクセスを保護する
+    std::mutex mtx;
+    gaei::work_stealing_pool pool;
+    gaei::stage_graph<tiled_work> graph;
+    graph
+        .add("load", [&](tiled_work& t) -> ouchi::result::result<std::monostate, std::string> {
+            const auto path_str = t.job.path.string();
+            gaei::trace_scope ts("load_file", path_str);
+            gaei::scoped_stage s("load_file");
+            {
+                std::lock_guard lk(mtx);
+                if (auto r = filter.resident ? filter.resident->find(t.job.path, filter.roi_hash) : nullptr) {
+                    t.points = r->points;
+                    t.content_hash = r->content_hash;
+                    filter.errors += r->errors;
+                    s.points_out(t.points.size());
+                    return ouchi::result::ok(std::monostate{});
+                }
+            }
+            // LASファイルは大きいので、読み込まずにメモリにマップする
+            gaei::mapped_file m;
+            std::string content;
+            if (t.job.format == gaei::dat_format::las) {
+                if (auto r = m.open(t.job.path); !r) return r;
+            }
+            else if (auto r = gaei::read_file(t.job.path, content); !r) return r;
+            auto r = parse_tile(t.points, t.job.format == gaei::dat_format::las ? m.data() : std::string_view(content), t.job.format, filter);
+            if (!r) return ouchi::result::err(std::string(r.unwrap_err()));
+            t.content_hash = r.unwrap().content_hash;
+            std::lock_guard lk(mtx);
+            commit_tile(t.points, 0, t.job.path, r.unwrap(), filter, t.job.index);
+            std::cout << "loaded " << t.job.path.string() << ": " << t.points.size() << " points" << std::endl;
+            s.points_out(t.points.size());
+            return ouchi::result::ok(std::monostate{});
+        }, filter.read_ahead)
+        .add("label", [&quiet](tiled_work& t) -> ouchi::result::result<std::monostate, std::string> {
+            t.lc = quiet.label(t.points, t.labels);
+            return ouchi::result::ok(std::monostate{});
+        }, pool.size())
+        .add("filter", [&quiet](tiled_work& t) -> ouchi::result::result<std::monostate, std::string> {
+            quiet.reduce(t.points, t.labels, t.lc);
+            t.lc = {};
+            return ouchi::result::ok(std::monostate{});
+        }, pool.size())
+        .add("triangulate", [&quiet](tiled_work& t) -> ouchi::result::result<std::monostate, std::string> {
+            // 三角形分割には同じ直線上にない3点以上が必要
+            if (t.points.size() < 3) {
+                std::cout << "skipping " << t.job.path.string() << ": too few points" << std::endl;
+                std::vector<gaei::vertex<>>().swap(t.points);
+                return ouchi::result::ok(std::monostate{});
+            }
+            gaei::scoped_stage s("triangulate", t.points.size());
+            auto tri = quiet.triangulate(t.points, nullptr, &t.origin);
+            t.normals = quiet.normals(t.points, tri);
+            t.faces = quiet.build_faces(t.points, tri);
+            std::vector<gaei::label_t>().swap(t.labels);
+            s.points_out(t.points.size());
+            return ouchi::result::ok(std::monostate{});
+        }, pool.size())
+        .add("format", [&out, output](tiled_work& t) -> ouchi::result::result<std::monostate, std::string> {
+            if (t.points.empty()) return ouchi::result::ok(std::monostate{});
+            gaei::vec3f mn = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+            gaei::vec3f mx = { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+            for (auto& v : t.points) {
+                const gaei::vec3f q = { v.position.y(), v.position.z(), v.position.x() };
+                for (auto d = 0u; d < 3; ++d) {
+                    mn.coord[d] = std::min(mn.coord[d], q.coord[d]);
+                    mx.coord[d] = std::max(mx.coord[d], q.coord[d]);
+                }
+            }
+            t.index.url = t.name;
+            for (auto d = 0u; d < 3; ++d) {
+                t.index.bbox_center.coord[d] = (mn.coord[d] + mx.coord[d]) / 2;
+                t.index.bbox_size.coord[d] = mx.coord[d] - mn.coord[d];
+            }
+            if (!output) {
+                std::vector<gaei::vertex<>>().swap(t.points);
+                return ouchi::result::ok(std::monostate{});
+            }
+            gaei::scoped_stage s("write", t.points.size());
+            return write(std::move(t.points), std::move(t.faces), (out.parent_path() / t.name).string(), std::move(t.normals));
+        }, pool.size());
+    const auto input_hash = filter.input_hash;
+    auto r = graph.run(tiles, pool);
+    graph.write_text(std::cout);
+    std::cout << "steals\t" << pool.steals() << std::endl;
+    if (!r) return r;
+    // 読み込みが終わった順によらないよう、内容のハッシュはファイルの順に合わせる
+    filter.input_hash = input_hash;
+    for (auto& t : tiles) filter.input_hash = gaei::fnv1a(t.content_hash, filter.input_hash);
+    for (auto& [dir, index] : indexes) {
+        if (!index.dirty()) continue;
+        if (auto s = index.save(dir); !s) std::cout << s.unwrap_err() << std::endl;
+    }
+    std::cout << "removed error:" << filter.errors << '\n';
+    if (!output) return ouchi::result::ok(std::monostate{});
+    std::cout << "writing index to " << out_path << '\n';
+    // 各タイルをTransformノードで最初のタイルの原点からの位置に移し、すべてのタイルを1つの座標系に並べる
+    gaei::vrml::vrml_writer vw;
+    std::optional<gaei::vec2f> base;
+    for (auto& t : tiles) {
+        if (t.index.url.empty()) continue;
+        if (!base) base = t.origin;
+        gaei::vrml::transform node;
+        node.translation = { t.origin.y() - base->y(), 0, t.origin.x() - base->x() };
+        node.children.push_back(std::make_unique<gaei::vrml::inline_node>(std::move(t.index)));
+        vw.push(std::move(node));
+    }
+    std::ofstream iout(out);
+    if (!iout) return ouchi::result::err("cannot open "s + out_path);
+    return vw.write(iout);
+}
+
+// 入力全体のxy平面での範囲を求める。索引にないファイルはパースして範囲を索引に記録する
+[[nodiscard]]
+ouchi::result::result<gaei::tile_entry, std::string>
+input_extent(const std::vector<std::string>& path, load_filter& filter)
+{
+    std::vector<tile_job> jobs;
+    std::list<std::pair<std::filesystem::path, gaei::tile_index>> indexes;
+    for (auto&& p : path) {
+        if (auto r = collect(p, filter, jobs, indexes); !r) return ouchi::result::err(r.unwrap_err());
+    }
+    gaei::tile_entry extent;
+    std::vector<gaei::vertex<>> buf;
+    std::string content;
+    for (auto& job : jobs) {
+        if (auto e = job.index ? job.index->find(job.path) : nullptr) {
+            extent.add(e->min.x(), e->min.y());
+            extent.add(e->max.x(), e->max.y());
+            continue;
+        }
+        std::cout << "scanning " << job.path.string() << std::endl;
+        gaei::mapped_file m;
+        std::string_view data;
+        if (job.format == gaei::dat_format::las) {
+            if (auto r = m.open(job.path); !r) return ouchi::result::err(r.unwrap_err());
+            data = m.data();
+        }
+        else {
+            if (auto r = gaei::read_file(job.path, content); !r) return ouchi::result::err(r.unwrap_err());
+            data = content;
+        }
+        buf.clear();
+        auto r = parse_tile(buf, data, job.format, filter);
+        if (!r) return ouchi::result::err(r.unwrap_err());
+        if (auto& bounds = r.unwrap().bounds) {
+            if (bounds->count) {
+                extent.add(bounds->min.x(), bounds->min.y());
+                extent.add(bounds->max.x(), bounds->max.y());
+            }
+            if (job.index) job.index->update(job.path, *bounds);
+        }
+        else {
+            // キャッシュから読んだタイルは範囲が分からないので、読み込んだ点から求める
+            for (auto& v : buf) extent.add(v.position.x(), v.position.y());
+        }
     }
-    gaei::normalize(vs);
-    std::cout << "triangulate " << vs.size() << " points...\n";
-    ouchi::geometry::triangulation<gaei::vertex<>, 1000> t;
-    auto v = t(vs.cbegin(), vs.cend(), t.return_as_idx);
+    for (auto& [dir, index] : indexes) {
+        if (!index.dirty()) continue;
+        if (auto r = index.save(dir); !r) std::cout << r.unwrap_err() << std::endl;
+    }
+    // 領域が指定されていれば、その外側は分けない
+    extent.min = { std::max(extent.min.x(), filter.roi.min.x()), std::max(extent.min.y(), filter.roi.min.y()) };
+    extent.max = { std::min(extent.max.x(), filter.roi.max.x()), std::min(extent.max.y(), filter.roi.max.y()) };
+    if (!extent.count || extent.max.x() < extent.min.x() || extent.max.y() < extent.min.y())
+        return ouchi::result::err(std::string("no points to shard"));
+    return ouchi::result::ok(extent);
+}
 
-    faces.reserve(v.size() * 4 + 128);
+// 分担やパッチを統合したメッシュを、それらを使わない出力と同じく最初の頂点を原点とする座標でoutに書き込む
+[[nodiscard]]
+ouchi::result::result<std::monostate, std::string>
+write_merged(gaei::merged_shards m,
+             const gaei::pipeline& pipe,
+             const ouchi::program_options::arg_parser& p,
+             const std::string& out)
+{
+    std::cout << "welded:" << m.welded << " triangles:" << m.triangles.size() << std::endl;
+    if (!m.vertices.empty()) {
+        const auto f = m.vertices.front().position;
+        for (auto& v : m.vertices) {
+            v.position.x() -= f.x();
+            v.position.y() -= f.y();
+        }
+    }
+    // 頂点は三角形が最初に参照する順に並んでいるので、分担ごとに最適化した順序がほぼ保たれる
+    auto ns = pipe.normals(m.vertices, m.triangles);
+    auto faces = pipe.build_faces(m.vertices, m.triangles);
+    if (p.exist("nooutput")) return ouchi::result::ok(std::monostate{});
+    gaei::scoped_stage s("write", m.vertices.size());
+    return write(std::move(m.vertices), std::move(faces), out, std::move(ns));
+}
 
-    std::cout << "post-processing..." << std::endl;
-    std::sort(v.begin(), v.end());
-    auto e = std::unique(v.begin(), v.end());
-    std::cout << "fail:" << std::distance(e, v.end()) << std::endl;
-    gaei::triangle_direction_judege(vs, v);
-    gaei::inv_normalize(vs);
-    for (auto& f : v) {
-        for (auto idx : f) {
-            faces.push_back((long)idx);
+// 分担ごとの中間ファイルを読み込み、継ぎ目をつないだ1つのメッシュとしてoutに書き込む
+[[nodiscard]]
+ouchi::result::result<std::monostate, std::string>
+merge_shard_files(unsigned count,
+                  const gaei::pipeline& pipe,
+                  const ouchi::program_options::arg_parser& p,
+                  const std::string& out)
+{
+    using namespace std::string_literals;
+    std::vector<gaei::shard_mesh> shards;
+    {
+        gaei::scoped_stage s("read_shards");
+        for (unsigned k = 0; k < count; ++k) {
+            const auto path = gaei::shard_file(out, k);
+            std::cout << "reading " << path.string() << std::endl;
+            auto r = gaei::read_shard(path);
+            if (!r) return ouchi::result::err(r.unwrap_err());
+            auto& m = r.unwrap();
+            if (m.shard != k || m.layout.count != count || (k && m.layout != shards.front().layout))
+                return ouchi::result::err(path.string() + " was made with a different layout"s);
+            shards.push_back(std::move(m));
         }
-        faces.push_back(-1);
     }
-    if (p.exist("printer")) {
-        gaei::create_wall(vs, faces);
+    gaei::merged_shards m;
+    {
+        gaei::scoped_stage s("merge_shards");
+        m = gaei::merge_shards(shards, p.get<double>("dedup_tolerance"));
+        s.points_out(m.vertices.size());
     }
-    return std::move(faces);
+    // 全ての分担が空なら、分担を使わないときと同じく失敗とする
+    if (m.triangles.empty()) return ouchi::result::err("no shard has enough points to triangulate"s);
+    return write_merged(std::move(m), pipe, p, out);
 }
 
+// 入力をpatch_gridのパッチに分け、内容が変わったタイルにかかるパッチだけをラベル付けから三角形分割までやり直す。
+// 残りのパッチはキャッシュから読み、継ぎ目をつないだ1つのメッシュとしてoutに書き込む
+[[nodiscard]]
 ouchi::result::result<std::monostate, std::string>
-write(const std::vector<gaei::vertex<>>& vs,
-      const std::vector<long>& faces,
-      std::string path)
+run_incremental(const std::vector<std::string>& path,
+                load_filter& filter,
+                const gaei::pipeline& pipe,
+                const ouchi::program_options::arg_parser& p,
+                const std::string& out_path)
 {
-    namespace vrml = gaei::vrml;
-    vrml::vrml_writer vw;
-    vrml::shape<vrml::indexed_face_set, vrml::appearance<>> sp;
-    sp.geometry().coord_.reserve(vs.size());
-    sp.geometry().solid = false;
-    for (auto& p : vs) {
-        sp.geometry().coord_.push_back(
-            {
-                {p.position.y(), p.position.z(), p.position.x()}
-                ,p.color
+    using namespace std::string_literals;
+    const auto& cache = *filter.cache;
+    std::vector<tile_job> jobs;
+    std::list<std::pair<std::filesystem::path, gaei::tile_index>> indexes;
+    for (auto&& in : path) {
+        if (auto r = collect(in, filter, jobs, indexes); !r) return r;
+    }
+    // LASファイルは大きいので、読み込まずにメモリにマップする
+    auto with_content = [&jobs](std::size_t i, auto&& f) -> ouchi::result::result<std::monostate, std::string> {
+        gaei::mapped_file m;
+        std::string content;
+        if (jobs[i].format == gaei::dat_format::las) {
+            if (auto r = m.open(jobs[i].path); !r) return r;
+            return f(m.data());
+        }
+        if (auto r = gaei::read_file(jobs[i].path, content); !r) return r;
+        return f(std::string_view(content));
+    };
+    // パッチのキーを作るため、全てのタイルの内容のハッシュと範囲を求める
+    // 範囲がキャッシュにないタイルはパースし、その点はパッチを作るときに使う
+    std::vector<std::uint64_t> hashes(jobs.size());
+    std::vector<gaei::tile_entry> bounds(jobs.size());
+    std::vector<std::vector<gaei::vertex<>>> points(jobs.size());
+    std::vector<bool> loaded(jobs.size());
+    {
+        gaei::scoped_stage s("hash_tiles");
+        for (std::size_t i = 0; i < jobs.size(); ++i) {
+            auto r = with_content(i, [&](std::string_view data) -> ouchi::result::result<std::monostate, std::string> {
+                hashes[i] = gaei::fnv1a(data);
+                if (cache.load_bounds(hashes[i], bounds[i])) return ouchi::result::ok(std::monostate{});
+                std::cout << "scanning " << jobs[i].path.string() << std::endl;
+                auto t = parse_tile(points[i], data, jobs[i].format, filter);
+                if (!t) return ouchi::result::err(t.unwrap_err());
+                if (!t.unwrap().bounds) {
+                    // 範囲を記録する前のキャッシュから点を読んだので、パースし直して範囲を記録する
+                    auto uncached = filter;
+                    uncached.cache = nullptr;
+                    std::vector<gaei::vertex<>> buf;
+                    auto u = parse_tile(buf, data, jobs[i].format, uncached);
+                    if (!u) return ouchi::result::err(u.unwrap_err());
+                    if (auto c = cache.store_bounds(hashes[i], *u.unwrap().bounds); !c) std::cout << c.unwrap_err() << std::endl;
+                    t.unwrap().bounds = u.unwrap().bounds;
+                }
+                bounds[i] = *t.unwrap().bounds;
+                commit_tile(points[i], 0, jobs[i].path, t.unwrap(), filter, jobs[i].index);
+                loaded[i] = true;
+                return ouchi::result::ok(std::monostate{});
+            });
+            if (!r) return r;
+        }
+    }
+    // 領域が指定されていれば、その外側にはパッチを置かない
+    gaei::tile_entry extent;
+    for (auto& b : bounds) {
+        if (!b.count) continue;
+        extent.add(b.min.x(), b.min.y());
+        extent.add(b.max.x(), b.max.y());
+    }
+    extent.min = { std::max(extent.min.x(), filter.roi.min.x()), std::max(extent.min.y(), filter.roi.min.y()) };
+    extent.max = { std::min(extent.max.x(), filter.roi.max.x()), std::min(extent.max.y(), filter.roi.max.y()) };
+    if (!extent.count || extent.max.x() < extent.min.x() || extent.max.y() < extent.min.y())
+        return ouchi::result::err("no points to process"s);
+    const auto grid = gaei::patch_grid::fit(extent.min, extent.max, p.get<double>("incremental_cell"), p.get<double>("shard_margin"));
+
+    // キーがキャッシュにあるパッチは読み、ないパッチとそれに必要なタイルを集める
+    struct patch_job {
+        unsigned cell;
+        std::uint64_t key;
+        std::vector<std::size_t> tiles;
+    };
+    const auto options = gaei::fnv1a(option_hash(p), filter.roi_hash);
+    std::vector<gaei::shard_mesh> patches;
+    std::vector<patch_job> dirty;
+    std::vector<bool> needed(jobs.size());
+    for (unsigned c = 0; c < grid.size(); ++c) {
+        auto tiles = gaei::patch_tiles(grid, c, bounds);
+        if (tiles.empty()) continue;
+        const auto key = gaei::patch_key(options, grid, c, tiles, hashes);
+        if (gaei::shard_mesh m; cache.load_patch(key, m) && m.shard == c) {
+            patches.push_back(std::move(m));
+            continue;
+        }
+        for (auto t : tiles) needed[t] = true;
+        dirty.push_back({ c, key, std::move(tiles) });
+    }
+    const auto reused = patches.size();
+    {
+        gaei::scoped_stage s("load");
+        for (std::size_t i = 0; i < jobs.size(); ++i) {
+            if (!needed[i] || loaded[i]) continue;
+            auto r = with_content(i, [&](std::string_view data) {
+                return load_file(points[i], jobs[i].path, data, jobs[i].format, filter, jobs[i].index);
             });
+            if (!r) return r;
+        }
     }
-    sp.geometry().coord_index_ = faces;
-    vw.push(std::move(sp));
-    std::cout << "writing " << vs.size() << " points to " << path << '\n';
-    return vw.write(path);
+    for (auto& [dir, index] : indexes) {
+        if (!index.dirty()) continue;
+        if (auto r = index.save(dir); !r) std::cout << r.unwrap_err() << std::endl;
+    }
+    // パッチごとの進捗は1行で出力する
+    auto quiet_options = pipe.options();
+    quiet_options.log = nullptr;
+    const gaei::pipeline quiet(quiet_options);
+    {
+        gaei::scoped_stage s("patches");
+        for (auto& d : dirty) {
+            std::vector<gaei::vertex<>> vs;
+            for (auto t : d.tiles) {
+                for (auto& v : points[t]) {
+                    if (grid.covers(d.cell, v.position.x(), v.position.y())) vs.push_back(v);
+                }
+            }
+            std::vector<gaei::label_t> labels;
+            const auto lc = quiet.label(vs, labels);
+            auto m = quiet.shard(std::move(vs), std::move(labels), lc, d.cell, {});
+            std::cout << "patch " << d.cell << ": " << m.vertices.size() << " points, " << m.triangles.size() << " triangles" << std::endl;
+            if (auto r = cache.store_patch(d.key, m); !r) std::cout << r.unwrap_err() << std::endl;
+            patches.push_back(std::move(m));
+        }
+    }
+    std::cout << "removed error:" << filter.errors << '\n';
+    std::cout << "patches:" << patches.size() << " recomputed:" << dirty.size() << " reused:" << reused << std::endl;
+    gaei::merged_shards m;
+    {
+        gaei::scoped_stage s("merge_patches");
+        m = gaei::merge_patches(patches, grid, p.get<double>("dedup_tolerance"));
+        s.points_out(m.vertices.size());
+    }
+    if (m.triangles.empty()) return ouchi::result::err("no patch has enough points to triangulate"s);
+    return write_merged(std::move(m), pipe, p, out_path);
 }
 
-int main(const int argc, const char** const argv)
-try {
+// 分担ごとに、自身を同じ引数にshard_indexとshard_extentオプションを加えて起動し、全てのプロセスが終わるのを待つ
+[[nodiscard]]
+ouchi::result::result<std::monostate, std::string>
+spawn_shards(const std::vector<const char*>& argv, unsigned shards, const std::string& extent)
+{
+    using namespace std::string_literals;
+#if defined(_WIN32)
+    (void)argv;
+    (void)shards;
+    (void)extent;
+    return ouchi::result::err("spawning shards is not supported on this platform; run each shard with shard_index and then merge"s);
+#else
+    // Linuxでは実行中のファイルを確実に指す/proc/self/exeを、それ以外ではPATHからargv[0]を探す
+    std::error_code ec;
+    const bool proc_self = std::filesystem::exists("/proc/self/exe", ec);
+    std::vector<pid_t> pids;
+    std::string error;
+    for (unsigned k = 0; k < shards; ++k) {
+        const auto index = std::to_string(k);
+        std::vector<char*> args;
+        for (auto a : argv) args.push_back(const_cast<char*>(a));
+        for (auto a : { "--shard_index", index.c_str(), "--shard_extent", extent.c_str() }) args.push_back(const_cast<char*>(a));
+        args.push_back(nullptr);
+        pid_t pid = 0;
+        const int e = proc_self
+            ? ::posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, args.data(), environ)
+            : ::posix_spawnp(&pid, args[0], nullptr, nullptr, args.data(), environ);
+        if (e != 0) {
+            error = "cannot spawn shard "s + index + ": " + std::strerror(e);
+            break;
+        }
+        std::cout << "shard " << k << ": pid " << pid << std::endl;
+        pids.push_back(pid);
+    }
+    // 起動できなかった分担があっても、起動したプロセスは待つ
+    for (std::size_t k = 0; k < pids.size(); ++k) {
+        int status = 0;
+        while (::waitpid(pids[k], &status, 0) < 0 && errno == EINTR) {}
+        if ((!WIFEXITED(status) || WEXITSTATUS(status) != 0) && error.empty())
+            error = "shard "s + std::to_string(k) + " failed";
+    }
+    if (error.size()) return ouchi::result::err(error);
+    return ouchi::result::ok(std::monostate{});
+#endif
+}
+
+ouchi::program_options::options_description make_options()
+{
     namespace po = ouchi::program_options;
-    namespace chrono = std::chrono;
     using namespace std::literals;
-    auto beg = chrono::high_resolution_clock::now();
     po::options_description d;
     d
-        .add("", ".datファイルへのパス/.datファイルを含むディレクトリへのパス", po::multi<std::string>)
+        .add("", ".datファイル(.dat.gz/.dat.zst/.lasも可)へのパス/.datファイルを含むディレクトリへのパス", po::multi<std::string>)
         .add("out;o", "出力ファイル", po::default_value = "out.wrl"s, po::single<std::string>)
         .add("diff;d", "指定された値[m]だけzが異なる点に異なるラベルを付けます", po::single<float>, po::default_value = 1.0f)
         .add("nooutput;N", "ファイルへの出力を行いません", po::flag)
@@ -152,41 +975,428 @@ try {
         .add("thinout_width;w", "点を間引く幅を指定します", po::default_value = 2, po::single<int>)
         .add("printer;p", "3Dプリンター用にデータを加工します。", po::flag)
         .add("onlyground;g", "地面と判定された点だけ出力します。", po::flag)
-        .add("onlybuilding;b", "建物と判定された点だけ出力します。printerオプションと併用する場合動作は未定義です。", po::flag);
+        .add("onlybuilding;b", "建物と判定された点だけ出力します。printerオプションと併用する場合動作は未定義です。", po::flag)
+        .add("report;r", "処理段階ごとの実行時間の報告形式を指定します(text/json)", po::default_value = "text"s, po::single<std::string>)
+        .add("report_out", "処理段階ごとの実行時間の報告を指定されたファイルに出力します", po::single<std::string>)
+        .add("bbox", "指定された矩形\"minx,miny,maxx,maxy\"の中の点だけを処理します", po::single<std::string>)
+        .add("polygon", "指定された多角形\"x1,y1,x2,y2,...\"の中の点だけを処理します", po::single<std::string>)
+        .add("parse_cache", "タイルごとのパース結果を指定されたディレクトリに保存し、変更のないタイルのパースを省きます。全てのタイルとオプションが前回と同じで出力も変わっていなければ、処理全体を省きます", po::single<std::string>)
+        .add("incremental", "入力を格子状のパッチに分け、パッチごとの間引いた点とラベル、三角形もparse_cacheオプションのディレクトリに保存します。内容が変わったタイルにかかるパッチだけを作り直し、継ぎ目をつないで出力します", po::flag)
+        .add("incremental_cell", "incrementalオプションでパッチの一辺の長さ[m]。のりしろの幅にはshard_marginを使います", po::default_value = 500.0, po::single<double>)
+        .add("lod", "指定された数の階層からなる解像度の異なるメッシュをタイルごとに出力し、outにはLODノードによる目録を出力します", po::default_value = 0, po::single<int>)
+        .add("lod_tile_size", "lodオプションで最も詳細な階層のタイルの一辺の長さ[m]。0ならば1枚のタイルにします", po::default_value = 0.0, po::single<double>)
+        .add("tiled", "入力ファイルを独立したタイルとして、読み込みから出力までをタイルごとに並行して行い、outにはInlineノードによる目録を出力します", po::flag)
+        .add("shards", "入力の範囲を長い方の軸に沿って指定された数の帯に分け、帯ごとに別のプロセスで処理してから統合します", po::default_value = 1, po::single<int>)
+        .add("shard_index", "shardsオプションで、このプロセスが処理する帯の番号(0から)。outの代わりに帯ごとの中間ファイルを出力します", po::single<int>)
+        .add("shard_extent", "shard_indexオプションで帯に分ける入力の範囲\"minx,miny,maxx,maxy\"。全ての帯で同じ値を指定します", po::single<std::string>)
+        .add("shard_margin", "shardsオプションで、帯の境界の外側から読み込む幅[m]。ラベルと三角形分割が境界で切れないよう、建物より大きくします", po::default_value = 50.0, po::single<double>)
+        .add("merge", "shardsオプションで出力した帯ごとの中間ファイルを統合し、outに出力します", po::flag)
+        .add("dedup", "xy座標が同じ点をまとめるときに残すzを指定します(first/min/max/mean)。noneならばまとめません", po::default_value = "first"s, po::single<std::string>)
+        .add("dedup_tolerance", "dedupオプションでxy座標を同じとみなす格子の間隔[m]", po::default_value = gaei::default_dedup_tolerance, po::single<double>)
+        .add("despike", "周囲の点の中央値から指定された値[m]を超えて離れた孤立点を、ラベル付けの前に取り除きます。0ならば取り除きません", po::default_value = 0.0, po::single<double>)
+        .add("ground", "地面のラベルの決め方を指定します。labelは最も点の多いラベル、pmfは漸進的モルフォロジーフィルタで地面と判定された点が過半数を占めるラベルです(label/pmf)", po::default_value = "label"s, po::single<std::string>)
+        .add("pmf_cell_size", "ground=pmfで高さを集計する格子の間隔[m]", po::default_value = 1.0, po::single<double>)
+        .add("pmf_max_window", "ground=pmfで使う窓の一辺の上限[m]。これより大きい建物は地面と判定されます", po::default_value = 40.0, po::single<double>)
+        .add("pmf_slope", "ground=pmfで想定する地形の勾配", po::default_value = 0.3, po::single<double>)
+        .add("partition", "メッシュをラベルまたはタイルごとに別のファイルへ出力し、outにはInlineノードによる目録を出力します(label/tile/label_tile)", po::single<std::string>)
+        .add("partition_tile_size", "partitionオプションでタイルの一辺の長さ[m]", po::default_value = 500.0, po::single<double>)
+        .add("nonormal", "頂点ごとの法線を出力せず、法線の計算をビューアに任せます", po::flag)
+        .add("nooptimize", "出力する三角形と頂点を頂点キャッシュに合わせて並べ替えません", po::flag)
+        .add("noarena", "ラベル付けの作業領域にアリーナを使わず、確保ごとにヒープを使います(比較用)", po::flag)
+        .add("trace", "処理のタイムラインをChrome trace-event形式で指定されたファイルに出力します", po::single<std::string>)
+        .add("daemon", "指定されたUnixドメインソケットでジョブを待ち受けます。ジョブは1行のコマンドライン引数です", po::single<std::string>)
+        .add("memory_budget", "デーモンモードでメモリ上に保持するタイルの上限[MiB]", po::default_value = (size_t)4096, po::single<size_t>)
+        .add("read_ahead", "パースと並行して先読みする.datファイルの数", po::default_value = 4, po::single<int>)
+        .add("las_class", "LASファイルから指定された分類\"2,6,...\"の点だけを読み込みます", po::single<std::string>)
+        .add("las_return", "LASファイルから読み込む反射の種類を指定します(all/first/last)", po::default_value = "all"s, po::single<std::string>);
+    return d;
+}
 
-    po::arg_parser p;
-    p.parse(d, argv, argc); 
-    auto parse_time = chrono::high_resolution_clock::now();
+// デーモンモードでジョブの結果を返すための出力先
+struct job_reply {
+    std::string out;
+    std::ostringstream report;
+};
+
+// 読み込みから出力までの1回分の処理
+int run(const ouchi::program_options::arg_parser& p,
+        const ouchi::program_options::options_description& d,
+        gaei::stage_report& report,
+        gaei::resident_tiles* resident,
+        job_reply* reply,
+        const std::vector<const char*>& argv)
+{
+    if (p.exist("trace")) gaei::trace_recorder::instance().enable();
     auto in = p.get<std::vector<std::string>>("");
-    if (in.size() == 0) {
+    // 分担ごとの中間ファイルを統合するときは点を読み込まない
+    const auto shards = p.get<int>("shards");
+    // shardsだけが指定されたら、帯ごとのプロセスを起動して待ち、このプロセスで統合する
+    const bool launch = shards > 1 && !p.exist("shard_index") && !p.exist("merge");
+    const bool merge = p.exist("merge") || launch;
+    if (in.size() == 0 && !p.exist("merge")) {
         std::cout << "少なくとも一つ以上のファイルまたはディレクトリが入力されていなければなりません\n";
         std::cout << d << std::endl;
         return -1;
     }
-    auto r = load(in);
-    auto load_time = chrono::high_resolution_clock::now();
-    if (!r) {
-        std::cout << r.unwrap_err() << std::endl;
+    gaei::region roi;
+    if (p.exist("bbox")) {
+        if (auto r = roi.set_bbox(p.get<std::string>("bbox")); !r) {
+            std::cout << r.unwrap_err() << std::endl;
+            return -1;
+        }
+    }
+    if (p.exist("polygon")) {
+        if (auto r = roi.set_polygon(p.get<std::string>("polygon")); !r) {
+            std::cout << r.unwrap_err() << std::endl;
+            return -1;
+        }
+    }
+    if (p.get<int>("lod") > 0 && p.exist("printer")) {
+        std::cout << "lodオプションとprinterオプションは併用できません" << std::endl;
+        return -1;
+    }
+    std::optional<gaei::partition_mode> partition;
+    if (p.exist("partition")) {
+        auto m = gaei::parse_partition_mode(p.get<std::string>("partition"));
+        if (!m) {
+            std::cout << m.unwrap_err() << std::endl;
+            return -1;
+        }
+        if (p.exist("printer") || p.get<int>("lod") > 0) {
+            std::cout << "partitionオプションはprinterオプションやlodオプションと併用できません" << std::endl;
+            return -1;
+        }
+        if (p.get<double>("partition_tile_size") <= 0) {
+            std::cout << "partition_tile_sizeには正の値を指定してください" << std::endl;
+            return -1;
+        }
+        partition = m.unwrap();
+    }
+    if (auto m = gaei::parse_dedup_policy(p.get<std::string>("dedup")); !m) {
+        std::cout << m.unwrap_err() << std::endl;
+        return -1;
+    }
+    if (p.get<double>("dedup_tolerance") <= 0) {
+        std::cout << "dedup_toleranceには正の値を指定してください" << std::endl;
+        return -1;
+    }
+    if (p.get<double>("despike") < 0) {
+        std::cout << "despikeには0以上の値を指定してください" << std::endl;
+        return -1;
+    }
+    if (auto g = gaei::parse_ground_classifier(p.get<std::string>("ground")); !g) {
+        std::cout << g.unwrap_err() << std::endl;
+        return -1;
+    }
+    if (p.get<double>("pmf_cell_size") <= 0 || p.get<double>("pmf_max_window") <= 0 || p.get<double>("pmf_slope") < 0) {
+        std::cout << "pmf_cell_sizeとpmf_max_windowには正の値を、pmf_slopeには0以上の値を指定してください" << std::endl;
+        return -1;
+    }
+    if (p.exist("tiled") && (p.exist("printer") || p.get<int>("lod") > 0 || partition)) {
+        std::cout << "tiledオプションはprinterオプション、lodオプション、partitionオプションと併用できません" << std::endl;
+        return -1;
+    }
+    if (shards < 1 || p.get<double>("shard_margin") < 0) {
+        std::cout << "shardsには正の値を、shard_marginには0以上の値を指定してください" << std::endl;
+        return -1;
+    }
+    std::optional<unsigned> shard_index;
+    gaei::shard_layout layout;
+    if (p.exist("shard_index")) {
+        if (p.get<int>("shard_index") < 0 || p.get<int>("shard_index") >= shards || p.exist("merge")) {
+            std::cout << "shard_indexには0以上shards未満の値を指定し、mergeオプションと併用しないでください" << std::endl;
+            return -1;
+        }
+        shard_index = static_cast<unsigned>(p.get<int>("shard_index"));
+    }
+    if (shard_index && shards > 1) {
+        gaei::region extent;
+        if (auto r = extent.set_bbox(p.exist("shard_extent") ? p.get<std::string>("shard_extent") : ""); !r) {
+            std::cout << "shard_extent: " << r.unwrap_err() << std::endl;
+            return -1;
+        }
+        layout = gaei::shard_layout::fit(static_cast<unsigned>(shards), extent.min, extent.max, p.get<double>("shard_margin"));
+    }
+    if ((shard_index || merge) && (p.exist("printer") || p.get<int>("lod") > 0 || partition || p.exist("tiled"))) {
+        std::cout << "shardsオプションはprinterオプション、lodオプション、partitionオプション、tiledオプションと併用できません" << std::endl;
+        return -1;
+    }
+    // 分担のプロセスが中間ファイルを出力しなければ、統合するものがない
+    if (launch && p.exist("nooutput")) {
+        std::cout << "shardsオプションで分担のプロセスを起動するときはnooutputオプションを指定できません" << std::endl;
+        return -1;
+    }
+    if (p.exist("incremental")) {
+        if (!p.exist("parse_cache") || p.get<double>("incremental_cell") <= 0) {
+            std::cout << "incrementalオプションにはparse_cacheオプションを指定し、incremental_cellには正の値を指定してください" << std::endl;
+            return -1;
+        }
+        if (p.exist("printer") || p.get<int>("lod") > 0 || partition || p.exist("tiled") || shards > 1 || shard_index || p.exist("merge")) {
+            std::cout << "incrementalオプションはprinterオプション、lodオプション、partitionオプション、tiledオプション、shardsオプションと併用できません" << std::endl;
+            return -1;
+        }
+    }
+    const gaei::pipeline pipe(to_pipeline_options(p));
+    std::optional<gaei::tile_cache> cache;
+    if (p.exist("parse_cache")) cache.emplace(p.get<std::string>("parse_cache"));
+    load_filter filter;
+    filter.roi = roi;
+    if (p.exist("las_class")) {
+        if (auto r = filter.las.set_classes(p.get<std::string>("las_class")); !r) {
+            std::cout << r.unwrap_err() << std::endl;
+            return -1;
+        }
+    }
+    if (auto ret = p.get<std::string>("las_return"); ret == "first") filter.las.returns = gaei::las_returns::first;
+    else if (ret == "last") filter.las.returns = gaei::las_returns::last;
+    else if (ret != "all") {
+        std::cout << "las_returnにはall/first/lastのいずれかを指定してください" << std::endl;
         return -1;
     }
-    auto v = r.unwrap();
-    if (p.exist("printer")) std::cout << "out for 3D printer\n";
-    label(v, p);
-    auto label_time = chrono::high_resolution_clock::now();
-    auto tri = triangulate(v, p);
-    auto tri_time = chrono::high_resolution_clock::now();
+    filter.roi_hash = gaei::fnv1a(p.exist("polygon") ? p.get<std::string>("polygon") : "",
+                                  gaei::fnv1a(p.exist("bbox") ? p.get<std::string>("bbox") : ""));
+    filter.roi_hash = gaei::fnv1a(filter.las.classes.to_string() + p.get<std::string>("las_return"), filter.roi_hash);
+    if (shard_index) {
+        filter.shards = layout;
+        filter.shard = *shard_index;
+        filter.roi_hash = gaei::fnv1a(layout.to_string() + '/' + std::to_string(*shard_index), filter.roi_hash);
+    }
+    filter.cache = cache ? &*cache : nullptr;
+    filter.resident = resident;
+    filter.read_ahead = static_cast<unsigned>(std::max(p.get<int>("read_ahead"), 1));
     auto out_path = p.get<std::string>("out");
-    if (!p.exist("nooutput")) write(v, tri,out_path).unwrap_or_else([](auto e)->std::monostate {std::cout << e; return {}; });
-    auto write_time = chrono::high_resolution_clock::now();
+    // 分担のプロセスはoutの代わりに中間ファイルを出力する
+    if (shard_index) out_path = gaei::shard_file(out_path, *shard_index).string();
+    if (merge) {
+        if (launch) {
+            auto extent = [&in, &filter] {
+                gaei::scoped_stage s("input_extent");
+                return input_extent(in, filter);
+            }();
+            if (!extent) {
+                std::cout << extent.unwrap_err() << std::endl;
+                return -1;
+            }
+            std::ostringstream e;
+            e.imbue(std::locale::classic());
+            e.precision(17);
+            e << extent.unwrap().min.x() << ',' << extent.unwrap().min.y() << ','
+              << extent.unwrap().max.x() << ',' << extent.unwrap().max.y();
+            // 分担のプロセスが失敗したときに、前回の中間ファイルを統合しないよう先に消す
+            for (int k = 0; k < shards; ++k) {
+                std::error_code ec;
+                const auto path = gaei::shard_file(out_path, static_cast<unsigned>(k));
+                if (std::filesystem::remove(path, ec); ec) {
+                    std::cout << "cannot remove " << path.string() << ": " << ec.message() << std::endl;
+                    return -1;
+                }
+            }
+            gaei::scoped_stage s("shards");
+            if (auto r = spawn_shards(argv, static_cast<unsigned>(shards), e.str()); !r) {
+                std::cout << r.unwrap_err() << std::endl;
+                return -1;
+            }
+        }
+        gaei::scoped_stage s("merge");
+        if (auto r = merge_shard_files(static_cast<unsigned>(shards), pipe, p, out_path); !r) {
+            std::cout << r.unwrap_err() << std::endl;
+            return -1;
+        }
+    }
+    else if (p.exist("incremental")) {
+        gaei::scoped_stage s("incremental");
+        if (auto r = run_incremental(in, filter, pipe, p, out_path); !r) {
+            std::cout << r.unwrap_err() << std::endl;
+            return -1;
+        }
+    }
+    else if (p.exist("tiled")) {
+        gaei::scoped_stage s("tiled");
+        if (auto r = run_tiled(in, filter, pipe, p, out_path); !r) {
+            std::cout << r.unwrap_err() << std::endl;
+            return -1;
+        }
+    }
+    else {
+        auto r = [&in, &filter] {
+            gaei::scoped_stage s("load");
+            return load(in, filter);
+        }();
+        if (!r) {
+            std::cout << r.unwrap_err() << std::endl;
+            return -1;
+        }
+        auto v = std::move(r.unwrap());
+        bool write_failed = false;
+        // 全タイルの内容とオプションが前回と同じで、出力も残っていれば処理を省く
+        const auto run_key = gaei::fnv1a(option_hash(p), gaei::fnv1a(filter.roi_hash, filter.input_hash));
+        if (cache && !p.exist("nooutput") && cache->has_result(run_key, out_path)) {
+            std::cout << "reuse cached output" << std::endl;
+        }
+        else {
+            if (p.exist("printer")) std::cout << "out for 3D printer\n";
+            std::vector<gaei::label_t> labels;
+            gaei::label_statistics lc;
+            {
+                gaei::scoped_stage s("label", v.size());
+                lc = pipe.label(v, labels);
+                s.points_out(v.size());
+            }
+            // lodとpartitionでは、目録とともに部分のファイルも記録する
+            std::vector<std::filesystem::path> parts;
+            auto store_result = [&] {
+                if (!cache) return;
+                if (auto c = cache->store_result(run_key, out_path, parts); !c) std::cout << c.unwrap_err() << std::endl;
+            };
+            // 書き込みに失敗した出力は記録せず、ジョブを失敗として返す
+            auto finish = [&](const ouchi::result::result<std::monostate, std::string>& w) {
+                if (w) return store_result();
+                std::cout << w.unwrap_err() << std::endl;
+                write_failed = true;
+            };
+            if (p.get<int>("lod") > 0) {
+                if (!p.exist("nooutput")) {
+                    gaei::scoped_stage s("lod", v.size());
+                    finish(write_lod(v, labels, lc, pipe, p, out_path, parts));
+                }
+            }
+            else if (partition) {
+                pipe.reduce(v, labels, lc);
+                std::vector<gaei::triangle> tri;
+                {
+                    gaei::scoped_stage s("triangulate", v.size());
+                    tri = pipe.triangulate(v, &labels);
+                    s.points_out(v.size());
+                }
+                if (!p.exist("nooutput")) {
+                    gaei::scoped_stage s("write", v.size());
+                    finish(write_partitioned(v, labels, tri, *partition, pipe, p, out_path, parts));
+                }
+            }
+            else if (shard_index) {
+                auto m = pipe.shard(std::move(v), std::move(labels), lc, *shard_index, layout);
+                if (!p.exist("nooutput")) {
+                    gaei::scoped_stage s("write_shard", m.vertices.size());
+                    std::cout << "writing " << m.vertices.size() << " points to " << out_path << '\n';
+                    finish(gaei::write_shard(out_path, m));
+                }
+            }
+            else {
+                pipe.reduce(v, labels, lc);
+                std::vector<gaei::vec3f> ns;
+                std::vector<long> faces;
+                {
+                    gaei::scoped_stage s("triangulate", v.size());
+                    auto tri = pipe.triangulate(v);
+                    ns = pipe.normals(v, tri);
+                    faces = pipe.build_faces(v, tri);
+                    s.points_out(v.size());
+                }
+                if (!p.exist("nooutput")) {
+                    gaei::scoped_stage s("write", v.size());
+                    finish(write(std::move(v), std::move(faces), out_path, std::move(ns)));
+                }
+            }
+        }
+        if (write_failed) return -1;
+    }
     std::cout << "out:" << out_path << std::endl;
-    std::cout << "elappsed time"
-        << "\nparse\t" << (parse_time - beg).count() / (double)chrono::high_resolution_clock::period::den
-        << "\nload\t" << (load_time - parse_time).count() / (double)chrono::high_resolution_clock::period::den
-        << "\nlabel\t" << (label_time - load_time).count() / (double)chrono::high_resolution_clock::period::den
-        << "\ntri\t" << (tri_time - load_time).count() / (double)chrono::high_resolution_clock::period::den
-        << "\nwrite\t" << (write_time - tri_time).count() / (double)chrono::high_resolution_clock::period::den
-        << "\ntotal\t" << (write_time - beg).count() / (double)chrono::high_resolution_clock::period::den;
-	return 0;
+    auto write_report = [&p, &report](std::ostream& out) {
+        if (p.get<std::string>("report") == "json") report.write_json(out);
+        else report.write_text(out);
+    };
+    if (reply) {
+        if (!p.exist("nooutput")) reply->out = out_path;
+        report.write_json(reply->report);
+    }
+    else if (p.exist("report_out")) {
+        std::ofstream rout(p.get<std::string>("report_out"));
+        write_report(rout);
+    }
+    else write_report(std::cout);
+    if (p.exist("trace")) {
+        auto& rec = gaei::trace_recorder::instance();
+        rec.disable();
+        std::ofstream tout(p.get<std::string>("trace"));
+        rec.write_json(tout);
+        if (auto dropped = rec.dropped()) std::cout << "trace: " << dropped << " events dropped\n";
+    }
+    return 0;
+}
+
+// ソケットでジョブを待ち受け、読み込んだタイルをジョブをまたいで保持する
+int serve(const std::string& socket_path,
+          std::size_t memory_budget,
+          const ouchi::program_options::options_description& d)
+{
+    gaei::resident_tiles resident(memory_budget);
+    gaei::local_server server;
+    if (auto r = server.listen(socket_path); !r) {
+        std::cout << r.unwrap_err() << std::endl;
+        return -1;
+    }
+    std::cout << "listening on " << socket_path << std::endl;
+    auto r = server.serve([&d, &resident](std::string_view line) {
+        std::cout << "job: " << line << std::endl;
+        auto args = gaei::split_args(line);
+        std::vector<const char*> argv{ "gaei_cpp" };
+        for (auto& a : args) argv.push_back(a.c_str());
+        job_reply reply;
+        std::string error;
+        int status = -1;
+        try {
+            gaei::stage_report report;
+            report.activate();
+            std::optional<gaei::scoped_stage> parse_stage(std::in_place, "parse");
+            ouchi::program_options::arg_parser p;
+            p.parse(d, argv.data(), static_cast<int>(argv.size()));
+            parse_stage.reset();
+            if (p.exist("daemon")) error = "daemon option is not allowed in a job";
+            else if (p.get<int>("shards") > 1 && !p.exist("shard_index") && !p.exist("merge"))
+                error = "shards option requires shard_index or merge in a job";
+            else status = run(p, d, report, &resident, &reply, argv);
+        }
+        catch (std::exception& e) {
+            error = e.what();
+        }
+        std::ostringstream s;
+        s << "{\"status\":" << status << ",\"out\":";
+        gaei::write_json_string(s, reply.out);
+        if (error.size()) {
+            s << ",\"error\":";
+            gaei::write_json_string(s, error);
+        }
+        s << ",\"resident_tiles\":" << resident.size()
+          << ",\"resident_bytes\":" << resident.bytes();
+        if (auto rep = reply.report.str(); rep.size()) {
+            while (rep.back() == '\n') rep.pop_back();
+            s << ",\"report\":" << rep;
+        }
+        s << "}\n";
+        return s.str();
+    });
+    if (!r) {
+        std::cout << r.unwrap_err() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int main(const int argc, const char** const argv)
+try {
+    gaei::stage_report report;
+    report.activate();
+    gaei::trace_recorder::instance().name_thread("main");
+    std::optional<gaei::scoped_stage> parse_stage(std::in_place, "parse");
+    auto d = make_options();
+    ouchi::program_options::arg_parser p;
+    p.parse(d, argv, argc); 
+    parse_stage.reset();
+    if (p.exist("daemon")) {
+        report.deactivate();
+        return serve(p.get<std::string>("daemon"), p.get<size_t>("memory_budget") << 20, d);
+    }
+    return run(p, d, report, nullptr, nullptr, std::vector<const char*>(argv, argv + argc));
 } catch (std::exception& e) {
     std::cerr << e.what() << '\n';
 }
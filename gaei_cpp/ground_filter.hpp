@@ -0,0 +1,387 @@
+﻿#pragma once
+#include <cstddef>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <limits>
+#include "vertex.hpp"
+#include "label_statistics.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "ouchilib/result/result.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 地面のラベルの決め方。
+/// </summary>
+enum class ground_classifier {
+    label,  // 最も点の多いラベル
+    pmf,    // 漸進的モルフォロジーフィルタで地面と判定された点が過半数を占めるラベル
+};
+
+/// <summary>
+/// "label", "pmf"のいずれかの文字列から地面のラベルの決め方を得る。
+/// </summary>
+inline ouchi::result::result<ground_classifier, std::string>
+parse_ground_classifier(std::string_view s)
+{
+    using namespace std::string_literals;
+    if (s == "label") return ouchi::result::ok(ground_classifier::label);
+    if (s == "pmf") return ouchi::result::ok(ground_classifier::pmf);
+    return ouchi::result::err("ground must be label or pmf: "s + std::string(s));
+}
+
+/// <summary>
+/// <see cref="progressive_morphological_filter"/>の設定。長さの単位は[m]。
+/// </summary>
+struct pmf_parameters {
+    // 点を集計する格子の間隔
+    double cell_size = 1.0;
+    // 窓の一辺の上限。これより大きい建物は地面と判定される
+    double max_window = 40.0;
+    // 地形の勾配。窓を広げたときの高さの閾値はinitial_threshold + slope×(窓の一辺の増分)
+    double slope = 0.3;
+    // 最初の窓での高さの閾値と、閾値の上限
+    double initial_threshold = 0.3;
+    double max_threshold = 3.0;
+};
+
+/// <summary>
+/// 長さnの列lineを、各要素を中心とする幅2 * radius + 1の窓でのop(min/maxなど)の結果に置き換える。
+/// 窓が列の外にはみ出した部分はidentityとみなす。
+/// </summary>
+/// <remarks>
+/// van Herk/Gil-Werman法。列を窓の幅のブロックに分け、ブロックの先頭からと末尾からの累積を求めると、
+/// 窓は高々2つのブロックにまたがるので、窓の幅によらず要素あたり3回のopで求まる。
+/// gとhは作業領域で、呼び出しをまたいで再利用できる。
+/// </remarks>
+template<class Op>
+void van_herk_filter(double* line, std::size_t n, std::size_t radius, Op op, double identity,
+                     std::vector<double>& g, std::vector<double>& h)
+{
+    if (!radius || !n) return;
+    const auto w = 2 * radius + 1;
+    const auto m = (n + 2 * radius + w - 1) / w * w;
+    g.resize(m);
+    h.resize(m);
+    auto padded = [line, n, radius, identity](std::size_t k) {
+        return k < radius || k >= radius + n ? identity : line[k - radius];
+    };
+    for (std::size_t k = 0; k < m; ++k) g[k] = k % w == 0 ? padded(k) : op(g[k - 1], padded(k));
+    for (auto k = m; k-- > 0;) h[k] = k % w == w - 1 ? padded(k) : op(h[k + 1], padded(k));
+    for (std::size_t i = 0; i < n; ++i) line[i] = op(h[i], g[i + w - 1]);
+}
+
+/// <summary>
+/// 点の高さを格子に集計した面。セルの値はセルに含まれる点の最小のz。
+/// </summary>
+class height_grid {
+public:
+    height_grid(const std::vector<vertex<>>& vs, double cell_size)
+        : cell_{ cell_size }
+        , inv_cell_{ 1 / cell_size }
+    {
+        if (vs.empty()) return;
+        const auto chunks = chunk_count(vs.size());
+        std::vector<vec2f> mins(chunks, min_);
+        std::vector<vec2f> maxs(chunks, { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() });
+        parallel_chunks(vs.size(), chunks, [&](std::size_t b, std::size_t e, std::size_t c) {
+            auto mn = mins[c], mx = maxs[c];
+            for (auto i = b; i < e; ++i) {
+                const auto& p = vs[i].position;
+                mn = { std::min(mn.x(), p.x()), std::min(mn.y(), p.y()) };
+                mx = { std::max(mx.x(), p.x()), std::max(mx.y(), p.y()) };
+            }
+            mins[c] = mn;
+            maxs[c] = mx;
+        });
+        vec2f max = maxs[0];
+        for (std::size_t c = 0; c < chunks; ++c) {
+            min_ = { std::min(min_.x(), mins[c].x()), std::min(min_.y(), mins[c].y()) };
+            max = { std::max(max.x(), maxs[c].x()), std::max(max.y(), maxs[c].y()) };
+        }
+        width_ = static_cast<std::size_t>((max.x() - min_.x()) * inv_cell_) + 1;
+        height_ = static_cast<std::size_t>((max.y() - min_.y()) * inv_cell_) + 1;
+        z_.assign(width_ * height_, std::numeric_limits<double>::quiet_NaN());
+        scatter(vs);
+        fill_empty();
+    }
+
+    [[nodiscard]]
+    std::size_t width() const noexcept { return width_; }
+    [[nodiscard]]
+    std::size_t height() const noexcept { return height_; }
+    [[nodiscard]]
+    std::size_t cell_of(const vec3f& p) const noexcept
+    {
+        const auto x = std::min(static_cast<std::size_t>((p.x() - min_.x()) * inv_cell_), width_ - 1);
+        const auto y = std::min(static_cast<std::size_t>((p.y() - min_.y()) * inv_cell_), height_ - 1);
+        return y * width_ + x;
+    }
+    [[nodiscard]]
+    double operator[](std::size_t cell) const noexcept { return z_[cell]; }
+
+    /// <summary>
+    /// 一辺2 * radius + 1セルの正方形の窓で収縮(最小値)する。
+    /// </summary>
+    void erode(std::size_t radius) { erode(z_, width_, height_, radius); }
+    /// <summary>
+    /// 一辺2 * radius + 1セルの正方形の窓で膨張(最大値)する。
+    /// </summary>
+    void dilate(std::size_t radius) { dilate(z_, width_, height_, radius); }
+    /// <summary>
+    /// 各セルを左右の3セルの中央値に置き換えてから、上下の3セルの中央値に置き換える。格子の外は端のセルを複製したものとみなす。
+    /// 幅1セルの突起や溝は取り除かれ、段差や斜面は保たれる。
+    /// </summary>
+    void median3()
+    {
+        if (z_.empty()) return;
+        const auto w = width_;
+        const auto chunks = chunk_count(height_, 64);
+        // 行の区間ごとに処理する。区間のすぐ外の行は隣の区間が書き換えるので、先に複製しておく
+        std::vector<std::vector<double>> above(chunks), below(chunks);
+        for (std::size_t c = 0; c < chunks; ++c) {
+            const auto b = height_ * c / chunks, e = height_ * (c + 1) / chunks;
+            const auto a = z_.begin() + (b ? b - 1 : 0) * w;
+            const auto d = z_.begin() + std::min(e, height_ - 1) * w;
+            above[c].assign(a, a + w);
+            below[c].assign(d, d + w);
+        }
+        parallel_chunks(height_, chunks, [&](std::size_t b, std::size_t e, std::size_t c) {
+            // 直近の3行の左右の中央値を循環させて持ち、上下の中央値を書き戻す
+            std::vector<double> ring(3 * w);
+            auto slot = [&ring, w](std::size_t k) { return ring.data() + k % 3 * w; };
+            auto row_median = [w](const double* r, double* o) {
+                // 端のセルは複製したセルとの中央値なので変わらない
+                o[0] = r[0];
+                o[w - 1] = r[w - 1];
+                if (w >= 3) simd::median3(r, r + 1, r + 2, o + 1, w - 2);
+            };
+            row_median(above[c].data(), slot(b + 2));
+            row_median(z_.data() + b * w, slot(b));
+            for (auto y = b; y < e; ++y) {
+                row_median(y + 1 < e ? z_.data() + (y + 1) * w : below[c].data(), slot(y + 1));
+                simd::median3(slot(y + 2), slot(y), slot(y + 1), z_.data() + y * w, w);
+            }
+        });
+    }
+    /// <summary>
+    /// 収縮してから膨張する(オープニング)。窓より小さい突起が取り除かれる。
+    /// </summary>
+    /// <remarks>
+    /// 格子の外を無視すると、傾いた地面の高い側の端で面が下がり、端の点が地面でないと判定される。
+    /// そのため、端のセルを複製して四方にradiusだけ広げた格子でオープニングする。
+    /// </remarks>
+    void open(std::size_t radius)
+    {
+        const auto w = width_ + 2 * radius;
+        const auto h = height_ + 2 * radius;
+        auto clamp = [radius](std::size_t i, std::size_t n) { return std::min(i < radius ? 0 : i - radius, n - 1); };
+        std::vector<double> wide(w * h);
+        parallel_for(h, [&](std::size_t b, std::size_t e) {
+            for (auto y = b; y < e; ++y) {
+                const auto row = z_.data() + clamp(y, height_) * width_;
+                for (std::size_t x = 0; x < w; ++x) wide[y * w + x] = row[clamp(x, width_)];
+            }
+        }, 64);
+        erode(wide, w, h, radius);
+        dilate(wide, w, h, radius);
+        parallel_for(height_, [&](std::size_t b, std::size_t e) {
+            for (auto y = b; y < e; ++y) {
+                std::copy_n(wide.begin() + (y + radius) * w + radius, width_, z_.begin() + y * width_);
+            }
+        }, 64);
+    }
+
+private:
+    vec2f min_ = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    double cell_;
+    double inv_cell_;
+    std::size_t width_ = 0;
+    std::size_t height_ = 0;
+    std::vector<double> z_;
+
+    static void erode(std::vector<double>& z, std::size_t width, std::size_t height, std::size_t radius)
+    {
+        separable(z, width, height, radius, [](double a, double b) { return std::min(a, b); }, std::numeric_limits<double>::infinity());
+    }
+    static void dilate(std::vector<double>& z, std::size_t width, std::size_t height, std::size_t radius)
+    {
+        separable(z, width, height, radius, [](double a, double b) { return std::max(a, b); }, -std::numeric_limits<double>::infinity());
+    }
+    // 正方形の窓は行と列に分けて処理できる。行ごと、列ごとに並列に処理する
+    template<class Op>
+    static void separable(std::vector<double>& z, std::size_t width, std::size_t height,
+                          std::size_t radius, Op op, double identity)
+    {
+        parallel_for(height, [&](std::size_t b, std::size_t e) {
+            std::vector<double> g, h;
+            for (auto y = b; y < e; ++y) van_herk_filter(z.data() + y * width, width, radius, op, identity, g, h);
+        }, 64);
+        parallel_for(width, [&](std::size_t b, std::size_t e) {
+            std::vector<double> col(height), g, h;
+            for (auto x = b; x < e; ++x) {
+                for (std::size_t y = 0; y < height; ++y) col[y] = z[y * width + x];
+                van_herk_filter(col.data(), height, radius, op, identity, g, h);
+                for (std::size_t y = 0; y < height; ++y) z[y * width + x] = col[y];
+            }
+        }, 64);
+    }
+
+    // 各セルに含まれる点の最小のzを書き込む。
+    // 点の区間ごとに点を行の帯へ振り分けてから、帯ごとに別のスレッドで書き込むので、同じセルに2つのスレッドが書き込むことはない
+    void scatter(const std::vector<vertex<>>& vs)
+    {
+        auto put = [this](std::size_t cell, double z) {
+            if (!(z_[cell] <= z)) z_[cell] = z;
+        };
+        const auto chunks = chunk_count(vs.size());
+        if (chunks <= 1) {
+            for (auto& v : vs) put(cell_of(v.position), v.position.z());
+            return;
+        }
+        const auto bands = chunks;
+        auto band_of = [this, bands](std::size_t cell) { return cell / width_ * bands / height_; };
+        // offsets[c * bands + k]は区間cの点のうち帯kに入る点の書き込み位置。帯の順、同じ帯の中では区間の順に並べる
+        std::vector<std::size_t> offsets(chunks * bands);
+        parallel_chunks(vs.size(), chunks, [&](std::size_t b, std::size_t e, std::size_t c) {
+            std::vector<std::size_t> count(bands);
+            for (auto i = b; i < e; ++i) ++count[band_of(cell_of(vs[i].position))];
+            std::copy(count.begin(), count.end(), offsets.begin() + c * bands);
+        });
+        std::vector<std::size_t> band_begin(bands + 1);
+        std::size_t sum = 0;
+        for (std::size_t k = 0; k < bands; ++k) {
+            band_begin[k] = sum;
+            for (std::size_t c = 0; c < chunks; ++c) {
+                sum += std::exchange(offsets[c * bands + k], sum);
+            }
+        }
+        band_begin[bands] = sum;
+        std::vector<std::pair<std::size_t, double>> bucket(vs.size());
+        parallel_chunks(vs.size(), chunks, [&](std::size_t b, std::size_t e, std::size_t c) {
+            auto* offset = offsets.data() + c * bands;
+            for (auto i = b; i < e; ++i) {
+                const auto cell = cell_of(vs[i].position);
+                bucket[offset[band_of(cell)]++] = { cell, vs[i].position.z() };
+            }
+        });
+        parallel_chunks(bands, bands, [&](std::size_t b, std::size_t e, std::size_t) {
+            for (auto j = band_begin[b]; j < band_begin[e]; ++j) put(bucket[j].first, bucket[j].second);
+        });
+    }
+
+    // line[0], line[stride], ...のうち点のないセル(NaN)を、最も近いセルの値で埋める
+    static void fill_line(double* line, std::size_t stride, std::size_t n)
+    {
+        constexpr auto none = static_cast<std::size_t>(-1);
+        std::size_t prev = none;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (!std::isnan(line[i * stride])) {
+                // 前の値のあるセルとの間を、近い方の値で埋める
+                for (auto k = prev == none ? 0 : prev + 1; k < i; ++k) {
+                    line[k * stride] = prev != none && k - prev <= i - k ? line[prev * stride] : line[i * stride];
+                }
+                prev = i;
+            }
+        }
+        if (prev == none) return;
+        for (auto k = prev + 1; k < n; ++k) line[k * stride] = line[prev * stride];
+    }
+    // 点のないセルを、まず同じ行で、行に点がなければ最も近い点のある行の値で埋める
+    void fill_empty()
+    {
+        std::vector<char> empty(height_);
+        parallel_for(height_, [this, &empty](std::size_t b, std::size_t e) {
+            for (auto y = b; y < e; ++y) {
+                const auto row = z_.data() + y * width_;
+                fill_line(row, 1, width_);
+                empty[y] = std::isnan(row[0]);
+            }
+        }, 64);
+        // 点のある行は全てのセルが埋まっているので、列ごとに埋める代わりに行を複製する
+        constexpr auto none = static_cast<std::size_t>(-1);
+        std::size_t prev = none;
+        auto copy_row = [this](std::size_t from, std::size_t to) {
+            std::copy_n(z_.begin() + from * width_, width_, z_.begin() + to * width_);
+        };
+        for (std::size_t y = 0; y < height_; ++y) {
+            if (empty[y]) continue;
+            for (auto k = prev == none ? 0 : prev + 1; k < y; ++k) copy_row(prev != none && k - prev <= y - k ? prev : y, k);
+            prev = y;
+        }
+        if (prev == none) return;
+        for (auto k = prev + 1; k < height_; ++k) copy_row(prev, k);
+    }
+};
+
+/// <summary>
+/// 漸進的モルフォロジーフィルタで各点が地面かどうかを判定する。ground[i]が1ならばvs[i]は地面である。
+/// </summary>
+/// <remarks>
+/// Zhang et al. "A progressive morphological filter for removing nonground measurements from airborne LIDAR data" (2003)。
+/// 点の最小の高さの格子を、一辺3, 5, 9, 17, ...セルの窓で順にオープニングし、
+/// オープニングした面より閾値を超えて高い点を地面でないと判定する。閾値は窓を広げるごとに勾配に合わせて上げる。
+/// 収縮と膨張は<see cref="van_herk_filter"/>で行うので、全体で点とセルの数に対して線形時間で動作する。
+/// </remarks>
+inline std::vector<char> progressive_morphological_filter(const std::vector<vertex<>>& vs, const pmf_parameters& param = {})
+{
+    std::vector<char> ground(vs.size(), 1);
+    if (vs.empty()) return ground;
+    height_grid grid(vs, param.cell_size);
+    std::vector<std::size_t> cells(vs.size());
+    parallel_for(vs.size(), [&](std::size_t b, std::size_t e) {
+        for (auto i = b; i < e; ++i) cells[i] = grid.cell_of(vs[i].position);
+    });
+    double threshold = param.initial_threshold;
+    std::size_t prev_window = 0;
+    for (std::size_t radius = 1; (2 * radius + 1) * param.cell_size <= param.max_window || radius == 1; radius *= 2) {
+        const auto window = 2 * radius + 1;
+        if (prev_window) threshold = std::min(param.initial_threshold + param.slope * (window - prev_window) * param.cell_size, param.max_threshold);
+        prev_window = window;
+        grid.open(radius);
+        parallel_for(vs.size(), [&](std::size_t b, std::size_t e) {
+            for (auto i = b; i < e; ++i) {
+                if (vs[i].position.z() - grid[cells[i]] > threshold) ground[i] = 0;
+            }
+        });
+    }
+    return ground;
+}
+
+/// <summary>
+/// groundで地面と判定された点が過半数を占めるラベルを、そのうち最も点の多いラベルにまとめて地面のラベルにする。
+/// 該当するラベルがなければ地面のラベルは<see cref="label_statistics::no_ground"/>になる。
+/// </summary>
+/// <returns>地面のラベルにまとめたラベルの数</returns>
+inline std::size_t merge_ground_labels(label_statistics& lc, std::vector<label_t>& labels, const std::vector<char>& ground)
+{
+    std::vector<std::size_t> votes(lc.size());
+    for (std::size_t i = 0; i < labels.size(); ++i) votes[label_id(labels[i])] += ground[i] != 0;
+    constexpr auto none = label_statistics::no_ground;
+    std::vector<char> is_ground(lc.size());
+    auto target = none;
+    std::size_t merged = 0;
+    for (std::size_t l = 0; l < lc.size(); ++l) {
+        if (2 * votes[l] <= lc.count(l)) continue;
+        is_ground[l] = 1;
+        ++merged;
+        if (target == none || lc.count(l) > lc.count(target)) target = l;
+    }
+    if (target != none) {
+        for (auto& l : labels) {
+            if (is_ground[label_id(l)]) l = target | (l & label_border);
+        }
+        for (std::size_t l = 0; l < lc.size(); ++l) {
+            if (is_ground[l] && l != target) lc.merge(l, target);
+        }
+    }
+    lc.set_ground(target);
+    return merged;
+}
+
+}
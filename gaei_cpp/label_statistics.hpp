@@ -0,0 +1,164 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include "vertex.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 点のラベル。点と同じ並びの配列に格納する。
+/// 最上位ビットは別のラベルと接している(境界である)ことを表し、残りがラベルの番号である。
+/// </summary>
+using label_t = std::uint64_t;
+inline constexpr label_t label_border = label_t{ 1 } << 63;
+
+[[nodiscard]]
+constexpr label_t label_id(label_t label) noexcept { return label & ~label_border; }
+[[nodiscard]]
+constexpr bool is_border(label_t label) noexcept { return (label & label_border) != 0; }
+
+/// <summary>
+/// 1つのラベル(連結成分)に属する点の統計量。
+/// </summary>
+struct label_stat {
+    std::size_t count = 0;
+    // 別のラベルと接している点の数
+    std::size_t border_count = 0;
+    vec2f min = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    vec2f max = { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+    double min_z = std::numeric_limits<double>::max();
+    double max_z = std::numeric_limits<double>::lowest();
+    double sum_z = 0;
+
+    void add(const vec3f& p, bool border) noexcept
+    {
+        ++count;
+        border_count += border;
+        min.x() = std::min(min.x(), p.x()); min.y() = std::min(min.y(), p.y());
+        max.x() = std::max(max.x(), p.x()); max.y() = std::max(max.y(), p.y());
+        min_z = std::min(min_z, p.z());
+        max_z = std::max(max_z, p.z());
+        sum_z += p.z();
+    }
+    /// <summary>
+    /// 別のラベルの統計量を加える。
+    /// </summary>
+    void merge(const label_stat& o) noexcept
+    {
+        count += o.count;
+        border_count += o.border_count;
+        min.x() = std::min(min.x(), o.min.x()); min.y() = std::min(min.y(), o.min.y());
+        max.x() = std::max(max.x(), o.max.x()); max.y() = std::max(max.y(), o.max.y());
+        min_z = std::min(min_z, o.min_z);
+        max_z = std::max(max_z, o.max_z);
+        sum_z += o.sum_z;
+    }
+    [[nodiscard]]
+    double mean_z() const noexcept { return count ? sum_z / count : 0; }
+    [[nodiscard]]
+    double height() const noexcept { return count ? max_z - min_z : 0; }
+    /// <summary>
+    /// バウンディングボックスの水平面積。
+    /// </summary>
+    [[nodiscard]]
+    double footprint_area() const noexcept
+    {
+        return count ? (max.x() - min.x()) * (max.y() - min.y()) : 0;
+    }
+};
+
+/// <summary>
+/// ラベルごとの統計量の表。<see cref="surface_structure_isolate"/>がラベル付けと同時に作成する。
+/// 地面のラベル(最も点の多いラベル)は<see cref="finalize"/>で一度だけ求められる。
+/// </summary>
+class label_statistics {
+    std::vector<label_stat> stats_;
+    std::size_t ground_ = 0;
+public:
+    // 地面のラベルが存在しないことを表す
+    static constexpr std::size_t no_ground = static_cast<std::size_t>(-1);
+
+    label_statistics() = default;
+    explicit label_statistics(std::size_t label_count)
+        : stats_(label_count)
+    {}
+
+    void resize(std::size_t label_count) { stats_.resize(label_count); }
+    void clear() noexcept { stats_.clear(); ground_ = 0; }
+
+    void add(std::size_t label, const vec3f& p, bool border) noexcept
+    {
+        stats_[label].add(p, border);
+    }
+    /// <summary>
+    /// 全ての点を追加した後に呼び出し、地面のラベルを決定する。
+    /// </summary>
+    void finalize() noexcept
+    {
+        ground_ = stats_.empty()
+            ? 0
+            : std::distance(stats_.cbegin(),
+                            std::max_element(stats_.cbegin(), stats_.cend(),
+                                             [](auto& a, auto& b) { return a.count < b.count; }));
+    }
+    /// <summary>
+    /// ラベルfromの統計量をラベルintoに加え、fromを空にする。点のラベルは呼び出し側で付け替える。
+    /// </summary>
+    void merge(std::size_t from, std::size_t into) noexcept
+    {
+        stats_[into].merge(stats_[from]);
+        stats_[from] = label_stat{};
+    }
+    /// <summary>
+    /// 地面のラベルを<see cref="finalize"/>で求めたものから置き換える。
+    /// </summary>
+    void set_ground(std::size_t label) noexcept { ground_ = label; }
+
+    /// <summary>
+    /// labelsに残っているラベルだけを、出現順に0から詰めて番号を振り直す。統計量も同じ番号に移動する。
+    /// 地面のラベルが残っていなければ<see cref="ground"/>は<see cref="no_ground"/>になる。
+    /// </summary>
+    /// <returns>振り直した後のラベルの数</returns>
+    std::size_t compact(std::vector<label_t>& labels)
+    {
+        constexpr auto unused = static_cast<label_t>(-1);
+        std::vector<label_t> remap(stats_.size(), unused);
+        label_t next = 0;
+        for (auto& l : labels) {
+            auto& r = remap[label_id(l)];
+            if (r == unused) r = next++;
+            l = r | (l & label_border);
+        }
+        std::vector<label_stat> compacted(next);
+        for (auto i = 0u; i < remap.size(); ++i) {
+            if (remap[i] != unused) compacted[remap[i]] = stats_[i];
+        }
+        ground_ = ground_ < remap.size() && remap[ground_] != unused
+            ? static_cast<std::size_t>(remap[ground_])
+            : no_ground;
+        stats_.swap(compacted);
+        return stats_.size();
+    }
+
+    [[nodiscard]]
+    std::size_t size() const noexcept { return stats_.size(); }
+    [[nodiscard]]
+    bool empty() const noexcept { return stats_.empty(); }
+    [[nodiscard]]
+    const label_stat& operator[](std::size_t label) const noexcept { return stats_[label]; }
+    [[nodiscard]]
+    std::size_t count(std::size_t label) const noexcept { return stats_[label].count; }
+    /// <summary>
+    /// 地面と判定されたラベル。
+    /// </summary>
+    [[nodiscard]]
+    std::size_t ground() const noexcept { return ground_; }
+
+    auto begin() const noexcept { return stats_.cbegin(); }
+    auto end() const noexcept { return stats_.cend(); }
+};
+
+}
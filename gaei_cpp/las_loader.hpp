@@ -0,0 +1,209 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <bitset>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <variant>
+#include "ouchilib/result/result.hpp"
+#include "vertex.hpp"
+#include "color.hpp"
+#include "parallel.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// LASファイルの公開ヘッダーのうち、点の読み込みに必要な部分。
+/// </summary>
+struct las_header {
+    unsigned version_major = 0;
+    unsigned version_minor = 0;
+    unsigned point_format = 0;
+    std::size_t record_length = 0;
+    std::uint64_t point_count = 0;
+    std::size_t point_offset = 0;
+    double scale[3] = {};
+    double offset[3] = {};
+    vec3f min;
+    vec3f max;
+};
+
+/// <summary>
+/// 読み込む点の反射の種類。
+/// </summary>
+enum class las_returns {
+    all,
+    first,  // 最初の反射
+    last,   // 最後の反射。反射が1回の点を含む
+};
+
+/// <summary>
+/// LAS 1.0〜1.4の点群を読み込む。点レコードの形式は0〜10に対応する。LAZ(圧縮されたLAS)には対応しない。
+/// 座標にはヘッダーの倍率とオフセットを適用し、色は<see cref="dat_loader"/>と同じく<see cref="colors::none"/>とする。
+/// 分類と反射の種類による絞り込みはデコード時に行い、捨てた点は実体化しない。
+/// </summary>
+/// <remarks>
+/// 点レコードは区間に分けて並列にデコードする。結果の点の順序はファイル内の順序と同じである。
+/// リトルエンディアンの環境を前提とする。
+/// </remarks>
+class las_loader {
+public:
+    // 読み込む分類。既定では全ての分類を読み込む
+    std::bitset<256> classes;
+    las_returns returns = las_returns::all;
+
+    las_loader()
+    {
+        classes.set();
+    }
+
+    /// <summary>
+    /// "2,6,9"形式の文字列から読み込む分類を設定する。
+    /// </summary>
+    ouchi::result::result<std::monostate, std::string>
+    set_classes(std::string_view s)
+    {
+        using namespace std::string_literals;
+        std::bitset<256> c;
+        while (s.size()) {
+            auto p = s.find(',');
+            auto token = s.substr(0, p);
+            while (token.size() && token.front() == ' ') token.remove_prefix(1);
+            while (token.size() && token.back() == ' ') token.remove_suffix(1);
+            unsigned v = 0;
+            auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), v);
+            if (ec != std::errc{} || ptr != token.data() + token.size() || v > 255)
+                return ouchi::result::err("classification must be a list of 0-255: "s + std::string(token));
+            c.set(v);
+            if (p == std::string_view::npos) break;
+            s.remove_prefix(p + 1);
+        }
+        classes = c;
+        return ouchi::result::ok(std::monostate{});
+    }
+
+    /// <summary>
+    /// 公開ヘッダーを解釈する。点レコードがデータに収まらない場合もエラーを返す。
+    /// </summary>
+    static ouchi::result::result<las_header, std::string>
+    read_header(std::string_view s)
+    {
+        using namespace std::string_literals;
+        if (s.size() < 227 || s.substr(0, 4) != "LASF") return ouchi::result::err("not a LAS file"s);
+        las_header h;
+        h.version_major = get<std::uint8_t>(s, 24);
+        h.version_minor = get<std::uint8_t>(s, 25);
+        const auto header_size = get<std::uint16_t>(s, 94);
+        h.point_offset = get<std::uint32_t>(s, 96);
+        const auto format = get<std::uint8_t>(s, 104);
+        h.record_length = get<std::uint16_t>(s, 105);
+        h.point_count = get<std::uint32_t>(s, 107);
+        for (auto i = 0u; i < 3; ++i) {
+            h.scale[i] = get<double>(s, 131 + i * 8);
+            h.offset[i] = get<double>(s, 155 + i * 8);
+            // 最大値と最小値はx, yとzの順に交互に並ぶ
+            h.max.coord[i] = get<double>(s, 179 + i * 16);
+            h.min.coord[i] = get<double>(s, 187 + i * 16);
+        }
+        // 1.4では32bitに収まらない点数を64bitの欄に記録する
+        if (h.version_major == 1 && h.version_minor >= 4 && header_size >= 255 && s.size() >= 255) {
+            if (auto n = get<std::uint64_t>(s, 247); n) h.point_count = n;
+        }
+        if (h.version_major != 1 || h.version_minor > 4)
+            return ouchi::result::err("unsupported LAS version "s + std::to_string(h.version_major) + "." + std::to_string(h.version_minor));
+        // 上位2bitはLAZの圧縮を表す
+        if (format & 0xC0) return ouchi::result::err("compressed LAS (LAZ) is not supported"s);
+        h.point_format = format;
+        if (h.point_format > 10) return ouchi::result::err("unsupported LAS point format "s + std::to_string(h.point_format));
+        if (h.record_length < min_record_length[h.point_format])
+            return ouchi::result::err("LAS point record is too short"s);
+        if (h.point_offset > s.size() || (s.size() - h.point_offset) / h.record_length < h.point_count)
+            return ouchi::result::err("LAS file is truncated"s);
+        return ouchi::result::ok(std::move(h));
+    }
+
+    /// <summary>
+    /// メモリ上のLASファイルをデコードし、pred(点)がtrueとなる点だけをdestに追加する。
+    /// predはファイル内の順序で、呼び出したスレッドから呼ばれる。
+    /// </summary>
+    template<class Pred>
+    ouchi::result::result<std::monostate, std::string>
+    load_from_memory(std::string_view s, std::vector<vertex<vec3f, color>>& dest, Pred&& pred,
+                     std::size_t min_chunk = default_min_chunk) const
+    {
+        auto r = read_header(s);
+        if (!r) return ouchi::result::err(r.unwrap_err());
+        const auto& h = r.unwrap();
+        const auto n = static_cast<std::size_t>(h.point_count);
+        const auto chunks = chunk_count(n, min_chunk);
+        std::vector<std::vector<vertex<vec3f, color>>> parts(chunks);
+        parallel_chunks(n, chunks, [&](std::size_t b, std::size_t e, std::size_t c) {
+            auto& part = parts[c];
+            part.reserve(e - b);
+            const char* rec = s.data() + h.point_offset + b * h.record_length;
+            for (auto i = b; i < e; ++i, rec += h.record_length) {
+                if (!accept(rec, h.point_format)) continue;
+                vec3f pos;
+                for (auto k = 0u; k < 3; ++k) {
+                    pos.coord[k] = get<std::int32_t>(rec, k * 4) * h.scale[k] + h.offset[k];
+                }
+                part.push_back({ pos, colors::none });
+            }
+        });
+        std::size_t total = 0;
+        for (auto& p : parts) total += p.size();
+        dest.reserve(dest.size() + total);
+        for (auto& p : parts) {
+            for (auto& v : p) {
+                if (pred(v)) dest.push_back(v);
+            }
+            std::vector<vertex<vec3f, color>>().swap(p);
+        }
+        return ouchi::result::ok(std::monostate{});
+    }
+
+private:
+    // 点レコードの形式ごとの最小の長さ
+    static constexpr std::size_t min_record_length[11] = { 20, 28, 26, 34, 57, 63, 30, 36, 38, 59, 67 };
+
+    template<class T>
+    static T get(std::string_view s, std::size_t pos) noexcept
+    {
+        return get<T>(s.data(), pos);
+    }
+    template<class T>
+    static T get(const char* p, std::size_t pos) noexcept
+    {
+        T v;
+        std::memcpy(&v, p + pos, sizeof(T));
+        return v;
+    }
+
+    bool accept(const char* rec, unsigned format) const noexcept
+    {
+        unsigned number, count, classification;
+        if (format < 6) {
+            const auto r = static_cast<unsigned char>(rec[14]);
+            number = r & 0x07;
+            count = (r >> 3) & 0x07;
+            classification = static_cast<unsigned char>(rec[15]) & 0x1F;
+        }
+        else {
+            const auto r = static_cast<unsigned char>(rec[14]);
+            number = r & 0x0F;
+            count = r >> 4;
+            classification = static_cast<unsigned char>(rec[16]);
+        }
+        if (!classes.test(classification)) return false;
+        switch (returns) {
+        case las_returns::first: return number <= 1;
+        case las_returns::last: return number >= count;
+        default: return true;
+        }
+    }
+};
+
+}
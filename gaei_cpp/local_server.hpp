@@ -0,0 +1,233 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <variant>
+#include "ouchilib/result/result.hpp"
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace gaei {
+
+/// <summary>
+/// 1行のコマンドラインを引数に分割する。空白で区切り、""で囲まれた部分は空白を含む1つの引数とする。
+/// ""の中では\"と\\をそれぞれ"と\として扱う。
+/// </summary>
+inline std::vector<std::string> split_args(std::string_view line)
+{
+    std::vector<std::string> ret;
+    std::string cur;
+    bool in_arg = false, quoted = false;
+    for (std::size_t i = 0; i < line.size(); ++i) {
+        auto c = line[i];
+        if (quoted) {
+            if (c == '\\' && i + 1 < line.size() && (line[i + 1] == '"' || line[i + 1] == '\\')) cur += line[++i];
+            else if (c == '"') quoted = false;
+            else cur += c;
+        }
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            if (in_arg) ret.push_back(std::move(cur));
+            cur.clear();
+            in_arg = false;
+        }
+        else {
+            in_arg = true;
+            if (c == '"') quoted = true;
+            else cur += c;
+        }
+    }
+    if (in_arg) ret.push_back(std::move(cur));
+    return ret;
+}
+
+/// <summary>
+/// Unixドメインソケットで1行ずつジョブを受け付けるサーバー。
+/// 接続ごとに改行までの1行を受け取り、ハンドラーの戻り値を返して接続を閉じる。
+/// "shutdown"という行を受け取ると<see cref="serve"/>から戻る。
+/// </summary>
+/// <remarks>
+/// ジョブは受け付けた順に1つずつ処理する。Windowsでは使用できない。
+/// ジョブは任意のパスに書き込めるので、ソケットは作成した瞬間から作成したユーザーだけが読み書きできるようにする。
+/// umaskはプロセス全体の設定なので、<see cref="listen"/>は他のスレッドがファイルを作成していないときに呼ぶ。
+/// 1行を<see cref="read_timeout_seconds"/>秒以内に送らない接続は、処理せずに閉じる。
+/// </remarks>
+class local_server {
+public:
+    static constexpr std::string_view shutdown_command = "shutdown";
+    static constexpr int read_timeout_seconds = 30;
+
+    local_server() = default;
+    ~local_server() { close(); }
+    local_server(const local_server&) = delete;
+    local_server& operator=(const local_server&) = delete;
+
+    /// <summary>
+    /// pathにソケットを作成して待ち受けを開始する。pathに残っている古いソケットは削除する。
+    /// </summary>
+    ouchi::result::result<std::monostate, std::string>
+    listen(const std::string& path)
+    {
+        using namespace std::string_literals;
+#if defined(_WIN32)
+        (void)path;
+        return ouchi::result::err("daemon mode is not supported on this platform"s);
+#else
+        sockaddr_un addr{};
+        if (path.size() >= sizeof(addr.sun_path)) return ouchi::result::err("socket path is too long: "s + path);
+        close();
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd_ < 0) return ouchi::result::err("socket: "s + std::strerror(errno));
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        ::unlink(path.c_str());
+        // bindでソケットが作られた時点で他のユーザーが接続できないよう、作成時の許可をumaskで絞る
+        const auto mask = ::umask(S_IXUSR | S_IRWXG | S_IRWXO);
+        const bool bound = ::bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        const int bind_errno = errno;
+        ::umask(mask);
+        errno = bind_errno;
+        if (!bound ||
+            ::chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+            ::listen(fd_, 16) != 0) {
+            auto e = "cannot listen on "s + path + ": " + std::strerror(errno);
+            close();
+            return ouchi::result::err(e);
+        }
+        path_ = path;
+        return ouchi::result::ok(std::monostate{});
+#endif
+    }
+
+    /// <summary>
+    /// 待ち受けを続け、受け取った行ごとにhandler(std::string_view) -> std::stringを呼び出す。
+    /// </summary>
+    template<class F>
+    ouchi::result::result<std::monostate, std::string>
+    serve(F&& handler)
+    {
+        using namespace std::string_literals;
+#if defined(_WIN32)
+        (void)handler;
+        return ouchi::result::err("daemon mode is not supported on this platform"s);
+#else
+        if (fd_ < 0) return ouchi::result::err("server is not listening"s);
+        for (;;) {
+            int conn = ::accept(fd_, nullptr, nullptr);
+            if (conn < 0) {
+                if (errno == EINTR) continue;
+                return ouchi::result::err("accept: "s + std::strerror(errno));
+            }
+            // 行を送らないまま止まった接続で、後に続くジョブを待たせない
+            timeval timeout{};
+            timeout.tv_sec = read_timeout_seconds;
+            ::setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            auto line = read_line(conn);
+            if (!line) {
+                ::close(conn);
+                continue;
+            }
+            if (*line == shutdown_command) {
+                write_all(conn, "bye\n");
+                ::close(conn);
+                return ouchi::result::ok(std::monostate{});
+            }
+            write_all(conn, handler(std::string_view(*line)));
+            ::close(conn);
+        }
+#endif
+    }
+
+    void close() noexcept
+    {
+#if !defined(_WIN32)
+        if (fd_ >= 0) ::close(fd_);
+        if (!path_.empty()) ::unlink(path_.c_str());
+#endif
+        fd_ = -1;
+        path_.clear();
+    }
+
+    /// <summary>
+    /// pathで待ち受けているサーバーに1行を送り、応答の全体を返す。
+    /// </summary>
+    static ouchi::result::result<std::string, std::string>
+    request(const std::string& path, std::string_view line)
+    {
+        using namespace std::string_literals;
+#if defined(_WIN32)
+        (void)path; (void)line;
+        return ouchi::result::err("daemon mode is not supported on this platform"s);
+#else
+        sockaddr_un addr{};
+        if (path.size() >= sizeof(addr.sun_path)) return ouchi::result::err("socket path is too long: "s + path);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return ouchi::result::err("socket: "s + std::strerror(errno));
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            auto e = "cannot connect to "s + path + ": " + std::strerror(errno);
+            ::close(fd);
+            return ouchi::result::err(e);
+        }
+        write_all(fd, std::string(line) + '\n');
+        std::string ret;
+        char buf[4096];
+        for (;;) {
+            auto n = ::read(fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            ret.append(buf, static_cast<std::size_t>(n));
+        }
+        ::close(fd);
+        return ouchi::result::ok(std::move(ret));
+#endif
+    }
+
+private:
+    int fd_ = -1;
+    std::string path_;
+
+#if !defined(_WIN32)
+    // 改行か接続の終わりまでを読む。時間切れか読み込みに失敗したらstd::nulloptを返す
+    static std::optional<std::string> read_line(int fd)
+    {
+        std::string ret;
+        char c;
+        for (;;) {
+            auto n = ::read(fd, &c, 1);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return std::nullopt;
+            if (n == 0 || c == '\n') break;
+            ret += c;
+        }
+        if (ret.size() && ret.back() == '\r') ret.pop_back();
+        return ret;
+    }
+    static void write_all(int fd, std::string_view s)
+    {
+        while (s.size()) {
+#if defined(MSG_NOSIGNAL)
+            // 相手が先に接続を閉じてもSIGPIPEでデーモンを終了させない
+            auto n = ::send(fd, s.data(), s.size(), MSG_NOSIGNAL);
+#else
+            auto n = ::write(fd, s.data(), s.size());
+#endif
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            s.remove_prefix(static_cast<std::size_t>(n));
+        }
+    }
+#endif
+};
+
+}
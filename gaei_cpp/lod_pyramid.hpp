@@ -0,0 +1,155 @@
+﻿#pragma once
+#include <cstddef>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include "vertex.hpp"
+#include "vrml_writer.hpp"
+#include "ouchilib/result/result.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 解像度の異なる階層からなるタイルのピラミッド。階層0が最も詳細で、階層が1つ上がるごとにタイルの一辺は2倍になる。
+/// 階層kのタイル(i, j)は階層k-1のタイル(2i..2i+1, 2j..2j+1)を覆う。
+/// 書き込んだタイルを記録し、LODノードで入れ子にした目録を作る。
+/// </summary>
+/// <remarks>
+/// 座標は.datファイルと同じ向きの系で扱い、目録に書き込むときにVRMLの軸(y, z, x)に入れ替える。
+/// 目録の位置はaddに渡した点から求めるので、すべてのタイルを同じ原点の系で書き出し、その系の点を渡す。
+/// </remarks>
+class lod_pyramid {
+public:
+    using tile_key = std::pair<long long, long long>;
+
+    struct tile {
+        std::string url;
+        vec3f min;
+        vec3f max;
+    };
+
+    lod_pyramid(vec2f origin, double tile_size, unsigned levels)
+        : origin_{ origin }
+        , tile_size_{ tile_size }
+        , tiles_(levels)
+    {}
+
+    [[nodiscard]]
+    unsigned levels() const noexcept { return static_cast<unsigned>(tiles_.size()); }
+    [[nodiscard]]
+    double tile_size(unsigned level) const noexcept { return std::ldexp(tile_size_, static_cast<int>(level)); }
+    [[nodiscard]]
+    tile_key tile_of(unsigned level, double x, double y) const noexcept
+    {
+        auto t = tile_size(level);
+        return { (long long)std::floor((x - origin_.x()) / t), (long long)std::floor((y - origin_.y()) / t) };
+    }
+
+    /// <summary>
+    /// levelの点vsをタイルごとに分け、各タイルに含まれる点のインデックスを返す。
+    /// タイルの間に隙間ができないよう、タイルの外側margin以内の点も含める。
+    /// </summary>
+    std::map<tile_key, std::vector<std::size_t>>
+    partition(unsigned level, const std::vector<vertex<>>& vs, double margin) const
+    {
+        std::map<tile_key, std::vector<std::size_t>> ret;
+        for (std::size_t i = 0; i < vs.size(); ++i) {
+            auto x = vs[i].position.x(), y = vs[i].position.y();
+            auto [i0, j0] = tile_of(level, x - margin, y - margin);
+            auto [i1, j1] = tile_of(level, x + margin, y + margin);
+            for (auto ti = i0; ti <= i1; ++ti) {
+                for (auto tj = j0; tj <= j1; ++tj) ret[{ ti, tj }].push_back(i);
+            }
+        }
+        return ret;
+    }
+
+    /// <summary>
+    /// levelのタイルkeyをurlに書き込んだことを記録する。pointsはタイルの点。
+    /// </summary>
+    void add(unsigned level, tile_key key, std::string url, const std::vector<vertex<>>& points)
+    {
+        tile t{ std::move(url),
+                { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() },
+                { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() } };
+        for (auto& p : points) {
+            for (auto d = 0u; d < 3; ++d) {
+                t.min.coord[d] = std::min(t.min.coord[d], p.position.coord[d]);
+                t.max.coord[d] = std::max(t.max.coord[d], p.position.coord[d]);
+            }
+        }
+        tiles_.at(level).insert_or_assign(key, std::move(t));
+    }
+    [[nodiscard]]
+    const tile* find(unsigned level, tile_key key) const
+    {
+        auto it = tiles_.at(level).find(key);
+        return it == tiles_[level].end() ? nullptr : &it->second;
+    }
+
+    /// <summary>
+    /// 最も粗い階層のタイルごとにLODノードを入れ子にした目録を書き込む。
+    /// 視点がタイルの一辺のrange_factor倍より近づくと1つ詳細な階層に切り替わる。
+    /// </summary>
+    ouchi::result::result<std::monostate, std::string>
+    write_manifest(std::ostream& out, double range_factor = 2.0) const
+    {
+        vrml::vrml_writer vw;
+        if (!tiles_.empty()) {
+            const auto top = levels() - 1;
+            for (auto& [key, t] : tiles_[top]) {
+                if (auto n = node(top, key, range_factor)) vw.data().push_back(std::move(n));
+            }
+        }
+        return vw.write(out);
+    }
+
+private:
+    vec2f origin_;
+    double tile_size_;
+    std::vector<std::map<tile_key, tile>> tiles_;
+
+    static vec3f to_vrml(const vec3f& p) noexcept { return { p.y(), p.z(), p.x() }; }
+
+    std::unique_ptr<vrml::node_base> inline_of(const tile& t) const
+    {
+        auto n = std::make_unique<vrml::inline_node>();
+        n->url = t.url;
+        auto c = to_vrml(t.min), s = to_vrml(t.max);
+        for (auto d = 0u; d < 3; ++d) {
+            n->bbox_center.coord[d] = (c.coord[d] + s.coord[d]) / 2;
+            n->bbox_size.coord[d] = s.coord[d] - c.coord[d];
+        }
+        return n;
+    }
+    std::unique_ptr<vrml::node_base> node(unsigned level, tile_key key, double range_factor) const
+    {
+        auto t = find(level, key);
+        if (level == 0) return t ? inline_of(*t) : nullptr;
+        auto children = std::make_unique<vrml::group>();
+        for (auto ci = key.first * 2; ci < key.first * 2 + 2; ++ci) {
+            for (auto cj = key.second * 2; cj < key.second * 2 + 2; ++cj) {
+                if (auto n = node(level - 1, { ci, cj }, range_factor)) children->children.push_back(std::move(n));
+            }
+        }
+        if (!t) {
+            if (children->children.empty()) return nullptr;
+            return children;
+        }
+        if (children->children.empty()) return inline_of(*t);
+        auto l = std::make_unique<vrml::lod>();
+        auto c = to_vrml(t->min), s = to_vrml(t->max);
+        for (auto d = 0u; d < 3; ++d) l->center.coord[d] = (c.coord[d] + s.coord[d]) / 2;
+        l->range.push_back(static_cast<float>(tile_size(level) * range_factor));
+        l->level.push_back(std::move(children));
+        l->level.push_back(inline_of(*t));
+        return l;
+    }
+};
+
+}
@@ -0,0 +1,94 @@
+﻿#pragma once
+#include <cstddef>
+#include <atomic>
+#include <algorithm>
+#include <memory_resource>
+
+namespace gaei {
+
+/// <summary>
+/// 上流のメモリリソースへの確保と解放の回数と量を数えるメモリリソース。
+/// </summary>
+class counting_resource : public std::pmr::memory_resource {
+public:
+    explicit counting_resource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) noexcept
+        : upstream_{ upstream }
+    {}
+
+    [[nodiscard]]
+    std::size_t allocations() const noexcept { return allocations_.load(std::memory_order_relaxed); }
+    [[nodiscard]]
+    std::size_t deallocations() const noexcept { return deallocations_.load(std::memory_order_relaxed); }
+    // 確保されたままのバイト数
+    [[nodiscard]]
+    std::size_t bytes() const noexcept { return bytes_.load(std::memory_order_relaxed); }
+    [[nodiscard]]
+    std::size_t peak_bytes() const noexcept { return peak_.load(std::memory_order_relaxed); }
+    [[nodiscard]]
+    std::pmr::memory_resource* upstream() const noexcept { return upstream_; }
+
+private:
+    std::pmr::memory_resource* upstream_;
+    std::atomic<std::size_t> allocations_{ 0 };
+    std::atomic<std::size_t> deallocations_{ 0 };
+    std::atomic<std::size_t> bytes_{ 0 };
+    std::atomic<std::size_t> peak_{ 0 };
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        auto p = upstream_->allocate(bytes, alignment);
+        allocations_.fetch_add(1, std::memory_order_relaxed);
+        auto now = bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        auto peak = peak_.load(std::memory_order_relaxed);
+        while (peak < now && !peak_.compare_exchange_weak(peak, now, std::memory_order_relaxed));
+        return p;
+    }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        upstream_->deallocate(p, bytes, alignment);
+        deallocations_.fetch_add(1, std::memory_order_relaxed);
+        bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+/// <summary>
+/// 1つの処理段階の一時的なコンテナのためのアリーナ。
+/// 確保は単調に行い、解放はアリーナの破棄(または<see cref="release"/>)で一度に行う。
+/// 段階が要求した確保の回数と、実際にヒープから確保した回数を数える。
+/// </summary>
+/// <remarks>
+/// monotonicがfalseなら要求をそのままヒープに渡す。アリーナの効果を比べるときに使う。
+/// アリーナから確保したコンテナはアリーナより先に破棄しなければならない。
+/// </remarks>
+class stage_arena {
+public:
+    explicit stage_arena(bool monotonic = true, std::size_t initial_size = std::size_t{ 1 } << 20)
+        : heap_{ std::pmr::new_delete_resource() }
+        , arena_{ initial_size, &heap_ }
+        , requests_{ monotonic ? static_cast<std::pmr::memory_resource*>(&arena_) : &heap_ }
+    {}
+    stage_arena(const stage_arena&) = delete;
+    stage_arena& operator=(const stage_arena&) = delete;
+
+    [[nodiscard]]
+    std::pmr::memory_resource* resource() noexcept { return &requests_; }
+    // 段階が要求した確保
+    [[nodiscard]]
+    const counting_resource& requests() const noexcept { return requests_; }
+    // ヒープから実際に確保した量
+    [[nodiscard]]
+    const counting_resource& heap() const noexcept { return heap_; }
+
+    void release() { arena_.release(); }
+
+private:
+    counting_resource heap_;
+    std::pmr::monotonic_buffer_resource arena_;
+    counting_resource requests_;
+};
+
+}
@@ -0,0 +1,53 @@
+﻿#pragma once
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include "vertex.hpp"
+#include "vector_utl.hpp"
+#include "triangle_postprocess.hpp"
+#include "parallel.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 三角形ごとの法線(b - a)×(c - a)を返す。正規化しないので、長さは三角形の面積の2倍である。
+/// </summary>
+template<class V>
+std::vector<vec3f> face_normals(const std::vector<V>& vs, const std::vector<triangle>& ts)
+{
+    std::vector<vec3f> ns(ts.size());
+    parallel_for(ts.size(), [&](std::size_t b, std::size_t e) {
+        for (auto i = b; i < e; ++i) {
+            const auto& a = vs[ts[i][0]].position;
+            ns[i] = cross_product(vs[ts[i][1]].position - a, vs[ts[i][2]].position - a);
+        }
+    });
+    return ns;
+}
+
+/// <summary>
+/// 接する三角形の法線を面積で重み付けして平均した、頂点ごとの単位法線を返す。
+/// どの三角形にも使われない頂点や、接する三角形の面積が全て0の頂点は(0, 0, 1)とする。
+/// </summary>
+/// <remarks>
+/// 三角形の法線を1度だけ計算し、頂点ごとの集計は接する三角形の一覧を使って頂点の区間ごとに並列に行う。
+/// 書き込みが競合しないので、結果はスレッド数によらない。
+/// </remarks>
+template<class V>
+std::vector<vec3f> vertex_normals(const std::vector<V>& vs, const std::vector<triangle>& ts)
+{
+    const auto fn = face_normals(vs, ts);
+    const vertex_adjacency adjacency(ts, vs.size());
+    std::vector<vec3f> ns(vs.size());
+    parallel_for(vs.size(), [&](std::size_t b, std::size_t e) {
+        for (auto v = b; v < e; ++v) {
+            vec3f n = { 0, 0, 0 };
+            for (auto k = adjacency.offset[v]; k < adjacency.offset[v + 1]; ++k) n = n + fn[adjacency.triangles[k]];
+            const auto len = std::sqrt(inner_product(n, n));
+            ns[v] = len > 0 ? n / len : vec3f{ 0, 0, 1 };
+        }
+    });
+    return ns;
+}
+
+}
@@ -0,0 +1,127 @@
+﻿#pragma once
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include "vertex.hpp"
+#include "triangle_postprocess.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 大きさcache_sizeのFIFO頂点キャッシュで描画した場合の、三角形あたりの平均キャッシュミス数(ACMR)。
+/// 最良で約0.5、最悪で3になる。
+/// </summary>
+inline double average_cache_miss_ratio(const std::vector<triangle>& ts,
+                                       std::size_t vertex_count,
+                                       unsigned cache_size = 16)
+{
+    if (ts.empty()) return 0;
+    // 頂点がキャッシュに入った時刻。時刻がmisses - cache_size以下ならば追い出されている
+    std::vector<std::size_t> stamp(vertex_count, 0);
+    std::size_t misses = 0;
+    for (auto& t : ts) {
+        for (auto v : t) {
+            if (stamp[v] == 0 || misses - stamp[v] + 1 > cache_size) stamp[v] = ++misses;
+        }
+    }
+    return static_cast<double>(misses) / ts.size();
+}
+
+/// <summary>
+/// 描画時の頂点キャッシュの再利用が増えるよう三角形の順序を並べ替える(Tipsify)。
+/// 各三角形の頂点の並び、すなわち向きは変えない。
+/// </summary>
+/// <remarks>
+/// Sander, Nehab, Barczak. "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (2007)。
+/// 三角形の数に対して線形時間で動作する。
+/// </remarks>
+inline void optimize_triangle_order(std::vector<triangle>& ts,
+                                    std::size_t vertex_count,
+                                    unsigned cache_size = 16)
+{
+    constexpr auto none = static_cast<std::size_t>(-1);
+    const vertex_adjacency adjacency(ts, vertex_count);
+    // まだ出力していない三角形の数
+    std::vector<std::size_t> live(vertex_count);
+    for (std::size_t v = 0; v < vertex_count; ++v) live[v] = adjacency.degree(v);
+    std::vector<std::size_t> stamp(vertex_count, 0);
+    std::vector<char> emitted(ts.size(), 0);
+    std::vector<std::size_t> dead_end;
+    std::vector<std::size_t> candidates;
+    std::vector<triangle> out;
+    out.reserve(ts.size());
+    std::size_t time = cache_size + 1;
+    std::size_t cursor = 0;
+
+    auto skip_dead_end = [&]() {
+        while (!dead_end.empty()) {
+            auto d = dead_end.back();
+            dead_end.pop_back();
+            if (live[d]) return d;
+        }
+        for (; cursor < vertex_count; ++cursor) {
+            if (live[cursor]) return cursor;
+        }
+        return none;
+    };
+    auto next_vertex = [&]() {
+        auto best = none;
+        std::size_t best_priority = 0;
+        for (auto v : candidates) {
+            if (!live[v]) continue;
+            // 扇の残りを出力してもキャッシュに残る頂点のうち、最も古いもの
+            std::size_t priority = 1;
+            if (time - stamp[v] + 2 * live[v] <= cache_size) priority = time - stamp[v] + 1;
+            if (best == none || priority > best_priority) {
+                best = v;
+                best_priority = priority;
+            }
+        }
+        return best != none ? best : skip_dead_end();
+    };
+
+    for (auto fan = skip_dead_end(); fan != none; fan = next_vertex()) {
+        candidates.clear();
+        for (auto k = adjacency.offset[fan]; k < adjacency.offset[fan + 1]; ++k) {
+            auto i = adjacency.triangles[k];
+            if (emitted[i]) continue;
+            emitted[i] = 1;
+            out.push_back(ts[i]);
+            for (auto v : ts[i]) {
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - stamp[v] > cache_size) stamp[v] = time++;
+            }
+        }
+    }
+    ts.swap(out);
+}
+
+/// <summary>
+/// 頂点を三角形で最初に使われる順に並べ替え、三角形の頂点番号を付け替える。
+/// どの三角形にも使われない頂点は元の順序のまま末尾に置く。
+/// </summary>
+/// <returns>元の頂点番号から新しい頂点番号への対応</returns>
+template<class T>
+std::vector<std::size_t> reorder_vertices(std::vector<T>& vs, std::vector<triangle>& ts)
+{
+    constexpr auto unused = static_cast<std::size_t>(-1);
+    std::vector<std::size_t> remap(vs.size(), unused);
+    std::size_t next = 0;
+    for (auto& t : ts) {
+        for (auto& v : t) {
+            if (remap[v] == unused) remap[v] = next++;
+            v = remap[v];
+        }
+    }
+    for (auto& r : remap) {
+        if (r == unused) r = next++;
+    }
+    std::vector<T> sorted(vs.size());
+    for (std::size_t i = 0; i < vs.size(); ++i) sorted[remap[i]] = std::move(vs[i]);
+    vs.swap(sorted);
+    return remap;
+}
+
+}
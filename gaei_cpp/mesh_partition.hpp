@@ -0,0 +1,176 @@
+﻿#pragma once
+#include <cstddef>
+#include <cmath>
+#include <map>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <ostream>
+#include <variant>
+#include "vertex.hpp"
+#include "label_statistics.hpp"
+#include "triangle_postprocess.hpp"
+#include "parallel.hpp"
+#include "vrml_writer.hpp"
+#include "ouchilib/result/result.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// メッシュを分割する単位。
+/// </summary>
+enum class partition_mode {
+    label,       // ラベル(連結成分)ごと
+    tile,        // 水平面の正方形のタイルごと
+    label_tile,  // ラベルとタイルの組ごと
+};
+
+/// <summary>
+/// 分割したメッシュの1つ。頂点番号はこの部分の中で0から詰めてある。
+/// </summary>
+struct mesh_part {
+    // 分割の単位に含まれない要素は0
+    std::size_t label = 0;
+    long long tile_x = 0;
+    long long tile_y = 0;
+    std::vector<vertex<>> vertices;
+    std::vector<triangle> triangles;
+    // verticesに対応する法線。法線を与えずに分割した場合は空
+    std::vector<vec3f> normals;
+
+    /// <summary>
+    /// ファイル名に使う、分割の単位を表す文字列。
+    /// </summary>
+    [[nodiscard]]
+    std::string name(partition_mode mode) const
+    {
+        switch (mode) {
+        case partition_mode::label: return std::to_string(label);
+        case partition_mode::tile: return std::to_string(tile_x) + '_' + std::to_string(tile_y);
+        default: return std::to_string(label) + '_' + std::to_string(tile_x) + '_' + std::to_string(tile_y);
+        }
+    }
+};
+
+/// <summary>
+/// "label", "tile", "label_tile"のいずれかの文字列から分割の単位を得る。
+/// </summary>
+inline ouchi::result::result<partition_mode, std::string>
+parse_partition_mode(std::string_view s)
+{
+    using namespace std::string_literals;
+    if (s == "label") return ouchi::result::ok(partition_mode::label);
+    if (s == "tile") return ouchi::result::ok(partition_mode::tile);
+    if (s == "label_tile") return ouchi::result::ok(partition_mode::label_tile);
+    return ouchi::result::err("partition must be label, tile or label_tile: "s + std::string(s));
+}
+
+/// <summary>
+/// 三角形を分割の単位ごとに振り分け、部分ごとのメッシュを作る。
+/// 三角形のラベルは3頂点のラベルの多数決(同数ならば番号の小さい方)、タイルは重心を含むタイルとする。
+/// タイル(i, j)はoriginから一辺tile_sizeの格子で数えた位置である。
+/// 部分は(ラベル, タイル)の順に並び、各部分の三角形と頂点は元の順序を保つ。
+/// normalsが与えられれば頂点と同じく部分に分ける。分割前に計算した法線を使うので、継ぎ目でも陰影が連続する。
+/// </summary>
+inline std::vector<mesh_part>
+partition_mesh(const std::vector<vertex<>>& vs,
+               const std::vector<label_t>& labels,
+               const std::vector<triangle>& ts,
+               partition_mode mode,
+               vec2f origin = { 0, 0 },
+               double tile_size = 1,
+               const std::vector<vec3f>* normals = nullptr)
+{
+    using key = std::tuple<std::size_t, long long, long long>;
+    const bool by_label = mode != partition_mode::tile;
+    const bool by_tile = mode != partition_mode::label;
+    auto key_of = [&](const triangle& t) {
+        key k{ 0, 0, 0 };
+        if (by_label) {
+            auto a = label_id(labels[t[0]]), b = label_id(labels[t[1]]), c = label_id(labels[t[2]]);
+            std::get<0>(k) = static_cast<std::size_t>(a == b || a == c ? a : b == c ? b : std::min({ a, b, c }));
+        }
+        if (by_tile) {
+            auto x = (vs[t[0]].position.x() + vs[t[1]].position.x() + vs[t[2]].position.x()) / 3;
+            auto y = (vs[t[0]].position.y() + vs[t[1]].position.y() + vs[t[2]].position.y()) / 3;
+            std::get<1>(k) = static_cast<long long>(std::floor((x - origin.x()) / tile_size));
+            std::get<2>(k) = static_cast<long long>(std::floor((y - origin.y()) / tile_size));
+        }
+        return k;
+    };
+    std::map<key, std::size_t> index;
+    std::vector<std::size_t> part_of(ts.size());
+    for (std::size_t i = 0; i < ts.size(); ++i) {
+        part_of[i] = index.try_emplace(key_of(ts[i]), index.size()).first->second;
+    }
+    // 振り分けた順ではなくキーの順に並べる
+    std::vector<std::size_t> order(index.size());
+    std::vector<mesh_part> parts(index.size());
+    {
+        std::size_t n = 0;
+        for (auto& [k, i] : index) {
+            order[i] = n;
+            auto& p = parts[n++];
+            std::tie(p.label, p.tile_x, p.tile_y) = k;
+        }
+    }
+    for (std::size_t i = 0; i < ts.size(); ++i) parts[order[part_of[i]]].triangles.push_back(ts[i]);
+    // 部分ごとに使う頂点を集めて番号を詰める
+    parallel_for(parts.size(), [&vs, &parts, normals](std::size_t b, std::size_t e) {
+        for (auto i = b; i < e; ++i) {
+            auto& p = parts[i];
+            std::vector<std::size_t> used;
+            used.reserve(p.triangles.size() * 3);
+            for (auto& t : p.triangles) used.insert(used.end(), t.begin(), t.end());
+            std::sort(used.begin(), used.end());
+            used.erase(std::unique(used.begin(), used.end()), used.end());
+            p.vertices.reserve(used.size());
+            for (auto v : used) p.vertices.push_back(vs[v]);
+            if (normals) {
+                p.normals.reserve(used.size());
+                for (auto v : used) p.normals.push_back((*normals)[v]);
+            }
+            for (auto& t : p.triangles) {
+                for (auto& v : t) v = static_cast<std::size_t>(std::lower_bound(used.begin(), used.end(), v) - used.begin());
+            }
+        }
+    }, 1);
+    return parts;
+}
+
+/// <summary>
+/// 分割して書き出したファイルをInlineノードで参照する索引を書き込む。
+/// urls[i]はparts[i]を書き出したファイルの、索引からの相対パスである。
+/// バウンディングボックスはVRMLの軸(y, z, x)で書き込む。
+/// </summary>
+inline ouchi::result::result<std::monostate, std::string>
+write_partition_index(std::ostream& out, const std::vector<mesh_part>& parts, const std::vector<std::string>& urls)
+{
+    vrml::vrml_writer vw;
+    for (std::size_t i = 0; i < parts.size() && i < urls.size(); ++i) {
+        vec3f mn = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+        vec3f mx = { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+        for (auto& v : parts[i].vertices) {
+            const vec3f p = { v.position.y(), v.position.z(), v.position.x() };
+            for (auto d = 0u; d < 3; ++d) {
+                mn.coord[d] = std::min(mn.coord[d], p.coord[d]);
+                mx.coord[d] = std::max(mx.coord[d], p.coord[d]);
+            }
+        }
+        vrml::inline_node n;
+        n.url = urls[i];
+        if (!parts[i].vertices.empty()) {
+            for (auto d = 0u; d < 3; ++d) {
+                n.bbox_center.coord[d] = (mn.coord[d] + mx.coord[d]) / 2;
+                n.bbox_size.coord[d] = mx.coord[d] - mn.coord[d];
+            }
+        }
+        vw.push(std::move(n));
+    }
+    return vw.write(out);
+}
+
+}
@@ -1,47 +1,82 @@
 ﻿#pragma once
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <execution>
 #include <vector>
 
-#include <random>
-
 #include "vertex.hpp"
+#include "label_statistics.hpp"
 #include "surface_structure_isolate.hpp"
 
 namespace gaei {
 
+/// <summary>
+/// <see cref="normalize"/>で点を移した量。<see cref="inv_normalize"/>で元に戻すのに使う。
+/// </summary>
+struct normalization {
+    // 原点とした最初の点の元のxy座標
+    vec2f origin;
+    // 点ごとのxのずらし量。32倍した後の座標での値で、0以上16未満
+    std::vector<std::uint8_t> jitter;
+};
+
+/// <summary>
+/// 点の元のxy座標から決まるxのずらし量を返す。
+/// 同じ点はどの範囲を三角形分割しても同じだけずれるので、分割して処理したメッシュの境目でも同じ三角形ができる。
+/// </summary>
+inline std::uint8_t jitter_of(const vec3f& p) noexcept
+{
+    // 1mm単位に丸めた座標をsplitmix64で混ぜる
+    auto h = static_cast<std::uint64_t>(std::llround(p.x() * 1000)) * 0x9e3779b97f4a7c15ull
+           ^ static_cast<std::uint64_t>(std::llround(p.y() * 1000));
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return static_cast<std::uint8_t>((h ^ (h >> 31)) % 16);
+}
+
+/// <summary>
+/// 三角形分割の前に、最初の点を原点に移す。
+/// 格子上の点が同一円周上に並ばないよう、座標を32倍してxを<see cref="jitter_of"/>だけずらす。
+/// </summary>
 template<class ExecutionPolicy = std::execution::sequenced_policy>
-inline void normalize(std::vector<vertex<>>& vs)
+inline normalization normalize(std::vector<vertex<>>& vs)
 {
-    std::mt19937 mt;
+    normalization n{ { vs.front().position.x(), vs.front().position.y() }, std::vector<std::uint8_t>(vs.size()) };
     std::for_each(ExecutionPolicy{}, vs.begin(), vs.end(),
-                  [f = vs.front().position, mt](vertex<>& v) mutable
+                  [f = n.origin, &n, first = vs.data()](vertex<>& v)
     {
+        const auto j = jitter_of(v.position);
+        n.jitter[&v - first] = j;
         v.position.x() -= f.x(); v.position.y() -= f.y();
-        v.position.x() = 32 * v.position.x() + mt()%16; v.position.y() = 32 * v.position.y();
+        v.position.x() = 32 * v.position.x() + j; v.position.y() = 32 * v.position.y();
     });
+    return n;
 }
+/// <summary>
+/// <see cref="normalize"/>でずらした座標を戻す。原点は最初の点のままにするので、元の座標に戻すにはn.originを足す。
+/// vsは<see cref="normalize"/>に渡したときと同じ順に並んでいなければならない。
+/// </summary>
 template<class ExecutionPolicy = std::execution::sequenced_policy>
-inline void inv_normalize(std::vector<vertex<>>& vs)
+inline void inv_normalize(std::vector<vertex<>>& vs, const normalization& n)
 {
-    std::mt19937 mt;
     std::for_each(ExecutionPolicy{}, vs.begin(), vs.end(),
-                  [f = vs.front().position, mt](vertex<>& v) mutable
+                  [&n, first = vs.data()](vertex<>& v)
     {
-        v.position.x() -= mt()%16; v.position.y() -= 0;
+        v.position.x() -= n.jitter[&v - first];
         v.position.x() /= 32; v.position.y() /= 32;
     });
 }
 
 template<class ExecutionPolicy = std::execution::sequenced_policy>
-inline void simplify_color(std::vector<size_t>& lc, std::vector<vertex<>>& vs)
+inline void simplify_color(const label_statistics& lc, std::vector<vertex<>>& vs, const std::vector<label_t>& labels)
 {
-    auto ground = std::distance(lc.cbegin(), std::max_element(lc.cbegin(), lc.cend()));
-    std::for_each(ExecutionPolicy{}, vs.begin(), vs.end(),
-                  [ground](vertex<>& v)
-                  {if (idx_to_color(v.color.value()) == ground) v.color = colors::green;
-                  else v.color = colors::red; });
-    lc.clear();
+    auto ground = lc.ground();
+    std::transform(ExecutionPolicy{}, vs.begin(), vs.end(), labels.begin(), vs.begin(),
+                   [ground](vertex<> v, label_t l)
+                   {if (label_id(l) == ground) v.color = colors::green;
+                   else v.color = colors::red;
+                   return v; });
 }
 
 }
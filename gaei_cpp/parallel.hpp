@@ -0,0 +1,84 @@
+﻿#pragma once
+#include <cstddef>
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace gaei {
+
+/// <summary>
+/// このスレッドから始める並列処理のスレッド数の上限。0ならば制限しない。
+/// <see cref="work_stealing_pool"/>の作業スレッドでは1になり、入れ子の並列処理は直列に行われる。
+/// </summary>
+inline unsigned& thread_limit() noexcept
+{
+    thread_local unsigned n = 0;
+    return n;
+}
+
+/// <summary>
+/// 並列処理に使うスレッド数。取得できない環境では1を返す。
+/// </summary>
+inline unsigned hardware_threads() noexcept
+{
+    if (auto l = thread_limit()) return l;
+    auto n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+// 1つのスレッドに割り当てる要素数の下限の既定値
+inline constexpr std::size_t default_min_chunk = std::size_t{ 1 } << 14;
+
+/// <summary>
+/// n個の要素を分割する区間の数を返す。各区間はmin_chunk個以上の要素を持ち、区間の数はthreads以下である。
+/// </summary>
+inline std::size_t chunk_count(std::size_t n,
+                               std::size_t min_chunk = default_min_chunk,
+                               unsigned threads = hardware_threads()) noexcept
+{
+    return std::max<std::size_t>(1, std::min<std::size_t>(threads, n / std::max<std::size_t>(min_chunk, 1)));
+}
+
+/// <summary>
+/// [0, n)をchunks個の連続した区間に分け、f(begin, end, chunk)を区間ごとに別のスレッドで呼び出す。
+/// chunkは区間の番号で、区間は番号の順に並ぶ。最初の区間は呼び出したスレッドで処理する。
+/// fが例外を投げた場合、全てのスレッドを待ってから最初の区間の例外を投げ直す。
+/// </summary>
+template<class F>
+void parallel_chunks(std::size_t n, std::size_t chunks, F&& f)
+{
+    if (chunks <= 1) {
+        f(std::size_t{ 0 }, n, std::size_t{ 0 });
+        return;
+    }
+    std::vector<std::exception_ptr> errors(chunks);
+    std::vector<std::thread> threads;
+    threads.reserve(chunks - 1);
+    auto run = [&f, &errors, n, chunks](std::size_t c) {
+        try {
+            f(n * c / chunks, n * (c + 1) / chunks, c);
+        }
+        catch (...) {
+            errors[c] = std::current_exception();
+        }
+    };
+    for (std::size_t c = 1; c < chunks; ++c) threads.emplace_back(run, c);
+    run(0);
+    for (auto& t : threads) t.join();
+    for (auto& e : errors) {
+        if (e) std::rethrow_exception(e);
+    }
+}
+
+/// <summary>
+/// [0, n)を区間に分けてf(begin, end)を並列に呼び出す。
+/// </summary>
+template<class F>
+void parallel_for(std::size_t n, F&& f, std::size_t min_chunk = default_min_chunk)
+{
+    parallel_chunks(n, chunk_count(n, min_chunk),
+                    [&f](std::size_t b, std::size_t e, std::size_t) { f(b, e); });
+}
+
+}
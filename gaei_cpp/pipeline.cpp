@@ -0,0 +1,258 @@
+﻿#include "pipeline.hpp"
+#include <array>
+#include <utility>
+#include <iostream>
+#include <string_view>
+#include "surface_structure_isolate.hpp"
+#include "reduce_points.hpp"
+#include "normalize.hpp"
+#include "wall.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_normals.hpp"
+#include "stage_report.hpp"
+#include "memory_resource.hpp"
+
+#include "ouchilib/geometry/triangulation.hpp"
+
+namespace gaei {
+
+namespace {
+
+// 進捗の出力先。出力しない設定ならば何も書き込まないストリームを返す
+std::ostream& log_of(const pipeline_options& o)
+{
+    thread_local std::ostream null_stream(nullptr);
+    return o.log ? *o.log : null_stream;
+}
+
+}
+
+ouchi::result::result<mesh, std::string>
+pipeline::run(const vertex<>* first, std::size_t count) const
+{
+    return run(std::vector<vertex<>>(first, first + count));
+}
+
+ouchi::result::result<mesh, std::string>
+pipeline::run(std::vector<vertex<>> points) const
+{
+    using namespace std::string_literals;
+    mesh m;
+    m.vertices = std::move(points);
+    label_statistics lc;
+    {
+        scoped_stage s("label", m.vertices.size());
+        lc = label(m.vertices, m.labels);
+        s.points_out(m.vertices.size());
+    }
+    reduce(m.vertices, m.labels, lc);
+    // 三角形分割には同じ直線上にない3点以上が必要
+    if (m.vertices.size() < 3) return ouchi::result::err("too few points to triangulate: "s + std::to_string(m.vertices.size()));
+    {
+        scoped_stage s("triangulate", m.vertices.size());
+        m.triangles = triangulate(m.vertices, &m.labels, &m.origin);
+        m.normals = normals(m.vertices, m.triangles);
+        m.faces = build_faces(m.vertices, m.triangles);
+        s.points_out(m.vertices.size());
+    }
+    return ouchi::result::ok(std::move(m));
+}
+
+label_statistics pipeline::label(std::vector<vertex<>>& vs, std::vector<label_t>& labels) const
+{
+    auto& log = log_of(options_);
+    // 各段階を計測し、段階を終えたときの点数を記録する
+    auto step = [&vs](std::string_view name, auto&& f) {
+        scoped_stage s(name, vs.size());
+        f();
+        s.points_out(vs.size());
+    };
+    log << "calclating " << vs.size() << " points...\n";
+    step("remove_error_point", [&] { log << "removed error:" << remove_error_point(vs) << '\n'; });
+    // 同じxy座標の点が残ると、ラベル付けはどれか1つのzしか見ず、三角形分割は縮退した三角形を作る
+    step("dedup_points", [&] {
+        log << "duplicate points:" << remove_duplicate_points(vs, options_.dedup, options_.dedup_tolerance) << '\n';
+    });
+    // 鳥や電線による孤立した点は小さなラベルになり、remove_minor_labelsでは小さな構造物と区別できない
+    if (options_.spike_threshold > 0) {
+        step("remove_spikes", [&] {
+            log << "spikes:" << remove_spikes(vs, options_.spike_threshold, options_.spike_cell_size) << '\n';
+        });
+    }
+    log << "labeling points..." << std::endl;
+    std::size_t label_cnt = 0;
+    label_statistics lc;
+    {
+        // ラベル付けの作業領域はこのブロックを抜けるときにまとめて解放される
+        stage_arena arena(options_.arena);
+        surface_structure_isolate ssi{ options_.diff, arena.resource() };
+        scoped_stage s("surface_structure_isolate", vs.size());
+        label_cnt = ssi(vs, labels);
+        s.allocations(arena.requests().allocations(), arena.heap().allocations());
+        lc = std::move(ssi.statistics());
+    }
+    log << label_cnt << " labels" << std::endl;
+    if (options_.ground == ground_classifier::pmf) {
+        step("ground_filter", [&] {
+            const auto ground = progressive_morphological_filter(vs, options_.pmf);
+            log << merge_ground_labels(lc, labels, ground) << " ground labels merged" << std::endl;
+        });
+    }
+    log << "reducing points..." << std::endl;
+    if (options_.only_ground) { step("extract_ground", [&] { extract_ground(lc, vs, labels); }); }
+    else if (options_.only_building) { step("extract_building", [&] { extract_building(lc, vs, labels); }); }
+    step("remove_trivial_surface", [&] { remove_trivial_surface(lc, vs, labels); });
+    step("remove_minor_labels", [&] { remove_minor_labels(lc, vs, labels, options_.remove_minor_labels_threshold); });
+    step("compact_labels", [&] { label_cnt = lc.compact(labels); });
+    log << label_cnt << " labels remain" << std::endl;
+    return lc;
+}
+
+void pipeline::reduce(std::vector<vertex<>>& vs,
+                      std::vector<label_t>& labels,
+                      const label_statistics& lc,
+                      unsigned level) const
+{
+    const auto width = options_.thinout_width;
+    scoped_stage s("reduce", vs.size());
+    {
+        scoped_stage st("thinout", vs.size());
+        thinout(vs, labels, width << level);
+        st.points_out(vs.size());
+    }
+    if (level) {
+        scoped_stage st("decimate", vs.size());
+        decimate(vs, labels, width << level);
+        st.points_out(vs.size());
+    }
+    {
+        scoped_stage st("simplify_color", vs.size());
+        simplify_color(lc, vs, labels);
+    }
+    s.points_out(vs.size());
+}
+
+std::vector<triangle> pipeline::triangulate(std::vector<vertex<>>& vs,
+                                            std::vector<label_t>* labels,
+                                            vec2f* origin) const
+{
+    auto& log = log_of(options_);
+    if (options_.printer) {
+        scoped_stage s("bounding_box", vs.size());
+        bounding_box(vs);
+        s.points_out(vs.size());
+    }
+    normalization n;
+    {
+        scoped_stage s("normalize", vs.size());
+        n = normalize(vs);
+        if (origin) *origin = n.origin;
+    }
+    log << "triangulate " << vs.size() << " points...\n";
+    ouchi::geometry::triangulation<vertex<>, 1000> t;
+    std::vector<triangle> v;
+    {
+        scoped_stage s("delaunay", vs.size());
+        v = t(vs.cbegin(), vs.cend(), t.return_as_idx);
+        s.points_out(v.size());
+    }
+
+    log << "post-processing..." << std::endl;
+    {
+        triangle_postprocess_result res;
+        res.input = v.size();
+        {
+            scoped_stage s("dedup", v.size());
+            remove_duplicate_triangles(v, vs.size(), res);
+            s.points_out(v.size());
+        }
+        {
+            scoped_stage s("orientation", v.size());
+            fix_triangle_orientation(vs, v, res);
+        }
+        log << "duplicate:" << res.duplicates
+            << " repeated index:" << res.repeated_index
+            << " zero area:" << res.zero_area
+            << " flipped:" << res.flipped << std::endl;
+    }
+    {
+        scoped_stage s("inv_normalize", vs.size());
+        inv_normalize(vs, n);
+    }
+    // 描画時に頂点キャッシュが効くよう、三角形と頂点を並べ替える
+    if (options_.optimize) {
+        scoped_stage s("optimize_mesh", v.size());
+        const auto before = average_cache_miss_ratio(v, vs.size());
+        optimize_triangle_order(v, vs.size());
+        // create_wallは末尾の4点をバウンディングボックスの角として使うので、頂点の順序を変えない
+        if (!options_.printer) {
+            auto remap = reorder_vertices(vs, v);
+            if (labels) {
+                std::vector<label_t> sorted(labels->size());
+                for (std::size_t i = 0; i < labels->size(); ++i) sorted[remap[i]] = (*labels)[i];
+                labels->swap(sorted);
+            }
+        }
+        log << "ACMR " << before << " -> " << average_cache_miss_ratio(v, vs.size()) << std::endl;
+    }
+    return v;
+}
+
+shard_mesh pipeline::shard(std::vector<vertex<>> vs,
+                           std::vector<label_t> labels,
+                           const label_statistics& lc,
+                           unsigned index,
+                           const shard_layout& layout) const
+{
+    reduce(vs, labels, lc);
+    shard_mesh m;
+    m.shard = index;
+    m.layout = layout;
+    // 点が3つ未満の分担は三角形を持たない空のメッシュとし、統合では他の分担だけを使う
+    if (vs.size() < 3) return m;
+    m.ground = lc.ground();
+    {
+        scoped_stage s("triangulate", vs.size());
+        vec2f origin;
+        m.triangles = triangulate(vs, &labels, &origin);
+        for (auto& v : vs) {
+            v.position.x() += origin.x();
+            v.position.y() += origin.y();
+        }
+        s.points_out(vs.size());
+    }
+    m.vertices = std::move(vs);
+    m.labels = std::move(labels);
+    return m;
+}
+
+std::vector<vec3f> pipeline::normals(const std::vector<vertex<>>& vs, const std::vector<triangle>& ts) const
+{
+    // printerでは側面を加えるので計算しない
+    if (options_.printer || !options_.normals) return {};
+    scoped_stage s("normals", vs.size());
+    return vertex_normals(vs, ts);
+}
+
+std::vector<long> pipeline::build_faces(std::vector<vertex<>>& vs, const std::vector<triangle>& ts) const
+{
+    std::vector<long> faces;
+    faces.reserve(ts.size() * 4 + 128);
+    {
+        scoped_stage s("build_faces", ts.size());
+        for (auto& f : ts) {
+            for (auto idx : f) {
+                faces.push_back((long)idx);
+            }
+            faces.push_back(-1);
+        }
+    }
+    if (options_.printer) {
+        scoped_stage s("create_wall", vs.size());
+        create_wall(vs, faces);
+        s.points_out(vs.size());
+    }
+    return faces;
+}
+
+}
@@ -0,0 +1,142 @@
+﻿#pragma once
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "vertex.hpp"
+#include "label_statistics.hpp"
+#include "triangle_postprocess.hpp"
+#include "dedup.hpp"
+#include "ground_filter.hpp"
+#include "spike_filter.hpp"
+#include "shard.hpp"
+#include "ouchilib/result/result.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 点群からメッシュを作る処理の設定。コマンドラインのオプションと同じ意味を持つ。
+/// </summary>
+struct pipeline_options {
+    // この値[m]だけzが異なる点に異なるラベルを付ける
+    float diff = 1.0f;
+    // この値以下のサイズのラベルを削除する
+    std::size_t remove_minor_labels_threshold = 5;
+    // 点を間引く幅
+    int thinout_width = 2;
+    // xy座標が同じ点のまとめ方と、同じとみなす格子の間隔[m]
+    dedup_policy dedup = dedup_policy::first;
+    double dedup_tolerance = default_dedup_tolerance;
+    // 周囲の点の中央値からこの値[m]を超えて離れた点を取り除く。0ならば行わない
+    double spike_threshold = 0;
+    // 中央値をとる格子の間隔[m]
+    double spike_cell_size = 1.0;
+    // 地面のラベルの決め方と、pmfの場合のフィルタの設定
+    ground_classifier ground = ground_classifier::label;
+    pmf_parameters pmf;
+    // 3Dプリンター用に側面と底面を加える
+    bool printer = false;
+    // 地面または建物と判定された点だけを残す
+    bool only_ground = false;
+    bool only_building = false;
+    // 三角形と頂点を頂点キャッシュに合わせて並べ替える
+    bool optimize = true;
+    // 頂点ごとの法線を計算する。printerがtrueなら計算しない
+    bool normals = true;
+    // ラベル付けの作業領域にアリーナを使う
+    bool arena = true;
+    // 進捗の出力先。nullptrなら出力しない
+    std::ostream* log = nullptr;
+};
+
+/// <summary>
+/// <see cref="pipeline"/>が返すメッシュ。
+/// </summary>
+struct mesh {
+    // xy座標はoriginからの相対座標。originを足すと入力と同じ座標に戻る
+    std::vector<vertex<>> vertices;
+    vec2f origin;
+    // verticesに対応するラベル
+    std::vector<label_t> labels;
+    // 地表面の三角形
+    std::vector<triangle> triangles;
+    // IndexedFaceSetのcoordIndex。各面は-1で終わり、printerがtrueなら側面と底面を含む
+    std::vector<long> faces;
+    // verticesに対応する単位法線。計算しない場合は空
+    std::vector<vec3f> normals;
+};
+
+/// <summary>
+/// ラベル付け、間引き、三角形分割、後処理をメモリ上で行う。ファイルの読み書きはしない。
+/// 各段階は<see cref="scoped_stage"/>で計測される。
+/// </summary>
+/// <example>
+/// <code>
+/// gaei::pipeline_options o;
+/// o.thinout_width = 4;
+/// auto m = gaei::pipeline(o).run(points.data(), points.size());
+/// if (m) draw(m.unwrap().vertices, m.unwrap().triangles);
+/// </code>
+/// </example>
+class pipeline {
+public:
+    explicit pipeline(pipeline_options options = {})
+        : options_{ options }
+    {}
+
+    [[nodiscard]]
+    const pipeline_options& options() const noexcept { return options_; }
+
+    /// <summary>
+    /// 呼び出し側が所有する点[first, first + count)を複製してメッシュを作る。
+    /// </summary>
+    [[nodiscard]]
+    ouchi::result::result<mesh, std::string> run(const vertex<>* first, std::size_t count) const;
+    /// <summary>
+    /// 点を受け取ってメッシュを作る。点の領域はメッシュの頂点に再利用する。
+    /// </summary>
+    [[nodiscard]]
+    ouchi::result::result<mesh, std::string> run(std::vector<vertex<>> points) const;
+
+    /// <summary>
+    /// xy座標が同じ点をまとめ、孤立した点を取り除いてからラベルを付けて不要な点を取り除き、残ったラベルの統計量を返す。
+    /// </summary>
+    label_statistics label(std::vector<vertex<>>& vs, std::vector<label_t>& labels) const;
+    /// <summary>
+    /// 点を間引いて色を付ける。levelが1以上なら幅を2^level倍にし、境界以外の点も間引く。
+    /// </summary>
+    void reduce(std::vector<vertex<>>& vs,
+                std::vector<label_t>& labels,
+                const label_statistics& lc,
+                unsigned level = 0) const;
+    /// <summary>
+    /// 三角形分割と後処理を行う。labelsが与えられれば、頂点の並べ替えに合わせてラベルも並べ替える。
+    /// vsは最初の点を原点とする座標に移される。originが与えられれば、原点とした点の元のxy座標を格納する。
+    /// </summary>
+    std::vector<triangle> triangulate(std::vector<vertex<>>& vs,
+                                      std::vector<label_t>* labels = nullptr,
+                                      vec2f* origin = nullptr) const;
+    /// <summary>
+    /// 頂点ごとの法線を計算する。法線を計算しない設定ならば空を返す。
+    /// </summary>
+    std::vector<vec3f> normals(const std::vector<vertex<>>& vs, const std::vector<triangle>& ts) const;
+    /// <summary>
+    /// IndexedFaceSetのcoordIndexを作る。printerがtrueなら側面と底面を加え、そのための頂点をvsに追加する。
+    /// </summary>
+    std::vector<long> build_faces(std::vector<vertex<>>& vs, const std::vector<triangle>& ts) const;
+    /// <summary>
+    /// <see cref="label"/>を終えた分担indexの点を間引いて三角形分割し、分担のメッシュを作る。
+    /// 分担ごとに三角形分割の原点が異なるので、頂点は入力と同じ座標に戻す。
+    /// 間引いた後の点が3つ未満なら、頂点も三角形も地面のラベルも持たないメッシュを返す。
+    /// </summary>
+    shard_mesh shard(std::vector<vertex<>> vs,
+                     std::vector<label_t> labels,
+                     const label_statistics& lc,
+                     unsigned index,
+                     const shard_layout& layout) const;
+
+private:
+    pipeline_options options_;
+};
+
+}
@@ -0,0 +1,216 @@
+﻿#pragma once
+#include <cstddef>
+#include <cmath>
+#include <limits>
+
+namespace gaei {
+
+/// <summary>
+/// 浮動小数点数の和で誤差なく値を表す展開(expansion)の演算。
+/// 成分は絶対値の小さい順に並び、互いに重ならない。0の成分は取り除く。
+/// J. R. Shewchuk, "Adaptive Precision Floating-Point Arithmetic and Fast Robust Geometric Predicates"による。
+/// </summary>
+/// <remarks>
+/// -ffast-mathや、積和演算への自動的な置き換え(-ffp-contract=fast)を有効にすると正しく動作しない。
+/// </remarks>
+namespace exact {
+
+template<std::size_t N>
+struct expansion {
+    static constexpr std::size_t capacity = N;
+    double c[N];
+    std::size_t n = 0;
+
+    // 最も絶対値の大きい成分。符号は展開全体の符号と一致する
+    [[nodiscard]]
+    double estimate() const noexcept { return n ? c[n - 1] : 0.0; }
+    void push(double v) noexcept { c[n++] = v; }
+};
+
+inline void two_sum(double a, double b, double& x, double& y) noexcept
+{
+    x = a + b;
+    const double bv = x - a;
+    const double av = x - bv;
+    y = (a - av) + (b - bv);
+}
+inline void fast_two_sum(double a, double b, double& x, double& y) noexcept
+{
+    x = a + b;
+    y = b - (x - a);
+}
+inline void two_diff(double a, double b, double& x, double& y) noexcept
+{
+    x = a - b;
+    const double bv = a - x;
+    const double av = x + bv;
+    y = (a - av) + (bv - b);
+}
+inline void two_product(double a, double b, double& x, double& y) noexcept
+{
+    x = a * b;
+    y = std::fma(a, b, -x);
+}
+
+/// <summary>
+/// a - bを2成分の展開で返す。
+/// </summary>
+inline expansion<2> difference(double a, double b) noexcept
+{
+    expansion<2> e;
+    double x, y;
+    two_diff(a, b, x, y);
+    if (y != 0) e.push(y);
+    if (x != 0) e.push(x);
+    return e;
+}
+
+/// <summary>
+/// hにbを加える(Grow-Expansion)。hには成分を1つ追加する余裕がなければならない。
+/// </summary>
+template<std::size_t N>
+void grow(expansion<N>& h, double b) noexcept
+{
+    double q = b;
+    std::size_t out = 0;
+    for (std::size_t i = 0; i < h.n; ++i) {
+        double hh;
+        two_sum(q, h.c[i], q, hh);
+        if (hh != 0) h.c[out++] = hh;
+    }
+    if (q != 0) h.c[out++] = q;
+    h.n = out;
+}
+
+template<std::size_t M, std::size_t N>
+expansion<M + N> sum(const expansion<M>& e, const expansion<N>& f) noexcept
+{
+    expansion<M + N> h;
+    for (std::size_t i = 0; i < e.n; ++i) h.c[i] = e.c[i];
+    h.n = e.n;
+    for (std::size_t i = 0; i < f.n; ++i) grow(h, f.c[i]);
+    return h;
+}
+
+template<std::size_t N>
+expansion<N> negate(expansion<N> e) noexcept
+{
+    for (std::size_t i = 0; i < e.n; ++i) e.c[i] = -e.c[i];
+    return e;
+}
+
+/// <summary>
+/// eとbの積(Scale-Expansion)。
+/// </summary>
+template<std::size_t N>
+expansion<2 * N> scale(const expansion<N>& e, double b) noexcept
+{
+    expansion<2 * N> h;
+    if (e.n == 0 || b == 0) return h;
+    double q, hh;
+    two_product(e.c[0], b, q, hh);
+    if (hh != 0) h.push(hh);
+    for (std::size_t i = 1; i < e.n; ++i) {
+        double t1, t0, q1;
+        two_product(e.c[i], b, t1, t0);
+        two_sum(q, t0, q1, hh);
+        if (hh != 0) h.push(hh);
+        fast_two_sum(t1, q1, q, hh);
+        if (hh != 0) h.push(hh);
+    }
+    if (q != 0) h.push(q);
+    return h;
+}
+
+template<std::size_t M, std::size_t N>
+expansion<2 * M * N> product(const expansion<M>& e, const expansion<N>& f) noexcept
+{
+    expansion<2 * M * N> h;
+    for (std::size_t j = 0; j < f.n; ++j) {
+        auto s = scale(e, f.c[j]);
+        for (std::size_t i = 0; i < s.n; ++i) grow(h, s.c[i]);
+    }
+    return h;
+}
+
+inline double orient2d(double ax, double ay, double bx, double by, double cx, double cy) noexcept
+{
+    auto acx = difference(ax, cx), bcx = difference(bx, cx);
+    auto acy = difference(ay, cy), bcy = difference(by, cy);
+    return sum(product(acx, bcy), negate(product(acy, bcx))).estimate();
+}
+
+inline double incircle(double ax, double ay, double bx, double by,
+                       double cx, double cy, double dx, double dy) noexcept
+{
+    auto adx = difference(ax, dx), ady = difference(ay, dy);
+    auto bdx = difference(bx, dx), bdy = difference(by, dy);
+    auto cdx = difference(cx, dx), cdy = difference(cy, dy);
+    auto alift = sum(product(adx, adx), product(ady, ady));
+    auto blift = sum(product(bdx, bdx), product(bdy, bdy));
+    auto clift = sum(product(cdx, cdx), product(cdy, cdy));
+    auto bc = sum(product(bdx, cdy), negate(product(bdy, cdx)));
+    auto ca = sum(product(cdx, ady), negate(product(cdy, adx)));
+    auto ab = sum(product(adx, bdy), negate(product(ady, bdx)));
+    return sum(sum(product(alift, bc), product(blift, ca)), product(clift, ab)).estimate();
+}
+
+}
+
+namespace predicate_bound {
+inline constexpr double epsilon = std::numeric_limits<double>::epsilon() / 2;
+inline constexpr double orient2d = (3.0 + 16.0 * epsilon) * epsilon;
+inline constexpr double incircle = (10.0 + 96.0 * epsilon) * epsilon;
+}
+
+/// <summary>
+/// a, b, cが反時計回りなら正、時計回りなら負、同一直線上なら0を返す。
+/// 通常の浮動小数点演算の誤差が符号を変えうる場合だけ厳密な計算を行うので、符号は常に正しい。
+/// </summary>
+inline double orient2d(double ax, double ay, double bx, double by, double cx, double cy) noexcept
+{
+    const double left = (ax - cx) * (by - cy);
+    const double right = (ay - cy) * (bx - cx);
+    const double det = left - right;
+    const double bound = predicate_bound::orient2d * (std::abs(left) + std::abs(right));
+    if (det > bound || -det > bound) return det;
+    return exact::orient2d(ax, ay, bx, by, cx, cy);
+}
+
+/// <summary>
+/// 反時計回りのa, b, cを通る円の内側にdがあれば正、外側なら負、円周上なら0を返す。
+/// <see cref="orient2d"/>と同じく、必要な場合だけ厳密な計算を行う。
+/// </summary>
+inline double incircle(double ax, double ay, double bx, double by,
+                       double cx, double cy, double dx, double dy) noexcept
+{
+    const double adx = ax - dx, ady = ay - dy;
+    const double bdx = bx - dx, bdy = by - dy;
+    const double cdx = cx - dx, cdy = cy - dy;
+    const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+    const double cdxady = cdx * ady, adxcdy = adx * cdy;
+    const double adxbdy = adx * bdy, bdxady = bdx * ady;
+    const double alift = adx * adx + ady * ady;
+    const double blift = bdx * bdx + bdy * bdy;
+    const double clift = cdx * cdx + cdy * cdy;
+    const double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+    const double permanent = (std::abs(bdxcdy) + std::abs(cdxbdy)) * alift
+                           + (std::abs(cdxady) + std::abs(adxcdy)) * blift
+                           + (std::abs(adxbdy) + std::abs(bdxady)) * clift;
+    const double bound = predicate_bound::incircle * permanent;
+    if (det > bound || -det > bound) return det;
+    return exact::incircle(ax, ay, bx, by, cx, cy, dx, dy);
+}
+
+template<class P>
+double orient2d(const P& a, const P& b, const P& c) noexcept
+{
+    return orient2d(a.x(), a.y(), b.x(), b.y(), c.x(), c.y());
+}
+template<class P>
+double incircle(const P& a, const P& b, const P& c, const P& d) noexcept
+{
+    return incircle(a.x(), a.y(), b.x(), b.y(), c.x(), c.y(), d.x(), d.y());
+}
+
+}
@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include "parallel.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 8bitずつのLSD基数ソートでvを安定にソートする。digit(要素, pass)はpass番目(0が最下位)の桁を返す。
+/// 各パスでは区間ごとの度数分布を並列に数え、区間の順を保って並列に振り分ける。
+/// 全ての要素で同じ桁になるパスは飛ばす。
+/// </summary>
+template<class T, class Digit>
+void radix_sort(std::vector<T>& v, unsigned passes, Digit&& digit,
+                std::size_t min_chunk = default_min_chunk)
+{
+    const auto n = v.size();
+    if (n < 2) return;
+    const auto chunks = chunk_count(n, min_chunk);
+    std::vector<T> tmp(n);
+    std::vector<std::array<std::size_t, 256>> hist(chunks);
+    for (unsigned pass = 0; pass < passes; ++pass) {
+        parallel_chunks(n, chunks, [&](std::size_t b, std::size_t e, std::size_t c) {
+            auto& h = hist[c];
+            h.fill(0);
+            for (auto i = b; i < e; ++i) ++h[static_cast<std::uint8_t>(digit(v[i], pass))];
+        });
+        std::size_t offset = 0;
+        bool trivial = false;
+        for (auto d = 0u; d < 256 && !trivial; ++d) {
+            std::size_t total = 0;
+            for (auto& h : hist) {
+                auto count = h[d];
+                h[d] = offset;
+                offset += count;
+                total += count;
+            }
+            trivial = total == n;
+        }
+        if (trivial) continue;
+        parallel_chunks(n, chunks, [&](std::size_t b, std::size_t e, std::size_t c) {
+            auto& h = hist[c];
+            for (auto i = b; i < e; ++i) tmp[h[static_cast<std::uint8_t>(digit(v[i], pass))]++] = v[i];
+        });
+        v.swap(tmp);
+    }
+}
+
+}
@@ -1,73 +1,134 @@
 ﻿#pragma once
 #include <vector>
 #include <algorithm>
+#include <cmath>
+#include <tuple>
 
 #include <iostream>
 
 #include "ouchilib/thread/thread-pool.hpp"
 #include "vertex.hpp"
+#include "label_statistics.hpp"
 #include "surface_structure_isolate.hpp"
 
 namespace gaei {
 
-inline std::vector<size_t> count_label(size_t label_size, const std::vector<vertex<>>& vs)
+/// <summary>
+/// vsとlabelsから、pred(点, ラベル)を満たす要素を並びを保ったまま同時に取り除く。
+/// </summary>
+template<class Pred>
+inline void erase_labeled_if(std::vector<vertex<>>& vs, std::vector<label_t>& labels, Pred pred)
 {
-    std::vector<size_t> lc(label_size, 0);
-    for (auto&& i : vs) {
-        ++lc[color_to_idx(i.color.value())];
+    size_t out = 0;
+    for (size_t i = 0; i < vs.size(); ++i) {
+        if (pred(vs[i], labels[i])) continue;
+        if (out != i) {
+            vs[out] = vs[i];
+            labels[out] = labels[i];
+        }
+        ++out;
     }
-    return std::move(lc);
+    vs.resize(out);
+    labels.resize(out);
 }
 
-inline void remove_trivial_surface(const std::vector<size_t>& lc, std::vector<vertex<>>& vs)
+/// <summary>
+/// ラベル付け済みの点集合からラベルごとの統計量を作り直す。
+/// <see cref="surface_structure_isolate"/>の結果には統計量が含まれるので、通常は必要ない。
+/// </summary>
+inline label_statistics count_label(size_t label_size, const std::vector<vertex<>>& vs, const std::vector<label_t>& labels)
 {
-    using ssi = surface_structure_isolate;
-    auto max = std::distance(lc.cbegin(), std::max_element(lc.cbegin(), lc.cend()));
-    vs.erase(std::remove_if(vs.begin(), vs.end(),
-                            [max](const vertex<>& v) { return v.color.value() == max; }),
-             vs.end());
+    label_statistics lc(label_size);
+    for (size_t i = 0; i < vs.size(); ++i) {
+        lc.add(label_id(labels[i]), vs[i].position, is_border(labels[i]));
+    }
+    lc.finalize();
+    return lc;
 }
 
-inline void remove_minor_labels(std::vector<size_t> lc, std::vector<vertex<>>& vs, size_t threshold = 5) noexcept
+// 境界でない地面の点を削除する
+inline void remove_trivial_surface(const label_statistics& lc, std::vector<vertex<>>& vs, std::vector<label_t>& labels)
 {
-    vs.erase(std::remove_if(vs.begin(), vs.end(),
-                            [threshold, &lc](const vertex<>& v) { return lc[color_to_idx(v.color.value())] < threshold; }),
-             vs.end());
+    auto max = lc.ground();
+    erase_labeled_if(vs, labels, [max](const vertex<>&, label_t l) { return l == max; });
+}
+
+/// <summary>
+/// 統計量がpredを満たすラベルの点を削除する。
+/// </summary>
+template<class Pred>
+inline void remove_labels_if(const label_statistics& lc, std::vector<vertex<>>& vs, std::vector<label_t>& labels, Pred pred)
+{
+    erase_labeled_if(vs, labels, [&pred, &lc](const vertex<>&, label_t l) { return pred(lc[label_id(l)]); });
+}
+
+inline void remove_minor_labels(const label_statistics& lc, std::vector<vertex<>>& vs, std::vector<label_t>& labels, size_t threshold = 5) noexcept
+{
+    remove_labels_if(lc, vs, labels, [threshold](const label_stat& s) { return s.count < threshold; });
 }
 
-inline void remove_error_point(std::vector<vertex<>>& vs) noexcept
+// 取り除いた点の数を返す
+inline size_t remove_error_point(std::vector<vertex<>>& vs) noexcept
 {
 //-9999.99
     auto b = vs.size();
     vs.erase(std::remove_if(vs.begin(), vs.end(),
                             [](const vertex<>& v) { return v.position.z() < -9000; }),
              vs.end());
-    std::cout << "removed error:" << b - vs.size() << '\n';
+    return b - vs.size();
 }
 
-inline void extract_ground(const std::vector<size_t>& lc, std::vector<vertex<>>& vs)
+inline void extract_ground(const label_statistics& lc, std::vector<vertex<>>& vs, std::vector<label_t>& labels)
 {
-    auto ground = std::distance(lc.cbegin(), std::max_element(lc.cbegin(), lc.cend()));
-    vs.erase(std::remove_if(vs.begin(), vs.end(),
-                            [ground](const vertex<>& v) { return ground != idx_to_color(v.color.value()); }),
-             vs.end());
+    auto ground = lc.ground();
+    erase_labeled_if(vs, labels, [ground](const vertex<>&, label_t l) { return ground != label_id(l); });
 }
-inline void extract_building(const std::vector<size_t>& lc, std::vector<vertex<>>& vs)
+inline void extract_building(const label_statistics& lc, std::vector<vertex<>>& vs, std::vector<label_t>& labels)
 {
-    auto ground = std::distance(lc.cbegin(), std::max_element(lc.cbegin(), lc.cend()));
-    vs.erase(std::remove_if(vs.begin(), vs.end(),
-                            [ground](const vertex<>& v) { return ground == idx_to_color(v.color.value()); }),
-             vs.end());
+    auto ground = lc.ground();
+    erase_labeled_if(vs, labels, [ground](const vertex<>&, label_t l) { return ground == label_id(l); });
 
 }
 
-inline void thinout(std::vector<vertex<>>& vs, int width) noexcept
+// 境界の点を間引き、残った点を座標順に並べる
+inline void thinout(std::vector<vertex<>>& vs, std::vector<label_t>& labels, int width)
 {
-    std::sort(vs.begin(), vs.end(),
-              [](auto&& a, auto&& b) {return a.position < b.position; });
-    vs.erase(std::remove_if(vs.begin(), vs.end(),
-                            [width](const vertex<>& v) mutable {return v.color.a() != 0 &&((int)v.position.x() % width || (int)v.position.y() % width); }),
-             vs.end());
+    erase_labeled_if(vs, labels,
+                     [width](const vertex<>& v, label_t l) {return is_border(l) &&((int)v.position.x() % width || (int)v.position.y() % width); });
+    std::vector<size_t> order(vs.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [&vs](size_t a, size_t b) {return vs[a].position < vs[b].position; });
+    std::vector<vertex<>> sorted_vs(vs.size());
+    std::vector<label_t> sorted_labels(labels.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        sorted_vs[i] = vs[order[i]];
+        sorted_labels[i] = labels[order[i]];
+    }
+    vs.swap(sorted_vs);
+    labels.swap(sorted_labels);
+}
+
+/// <summary>
+/// ラベルごとに、cell四方の格子の各マスに最初の1点だけを残す。境界かどうかによらず全ての点を間引く。
+/// 解像度の低い階層を作るときに使う。
+/// </summary>
+inline void decimate(std::vector<vertex<>>& vs, std::vector<label_t>& labels, double cell)
+{
+    using key = std::tuple<label_t, long long, long long>;
+    std::vector<std::pair<key, size_t>> keys(vs.size());
+    for (size_t i = 0; i < vs.size(); ++i) {
+        keys[i] = { { label_id(labels[i]),
+                      (long long)std::floor(vs[i].position.x() / cell),
+                      (long long)std::floor(vs[i].position.y() / cell) }, i };
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<char> keep(vs.size(), 0);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (i == 0 || keys[i].first != keys[i - 1].first) keep[keys[i].second] = 1;
+    }
+    size_t idx = 0;
+    erase_labeled_if(vs, labels, [&keep, &idx](const vertex<>&, label_t) { return !keep[idx++]; });
 }
 
 }
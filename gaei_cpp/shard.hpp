@@ -0,0 +1,457 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <numeric>
+#include "vertex.hpp"
+#include "color.hpp"
+#include "label_statistics.hpp"
+#include "triangle_postprocess.hpp"
+#include "dedup.hpp"
+#include "ouchilib/result/result.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 点群を複数のプロセスで分担するための、xy平面の分け方。
+/// 入力全体の範囲を長い方の軸に沿ってcount本の等しい幅の帯に分け、番号の順に分担に割り当てる。
+/// 最初と最後の帯は範囲の外側にも伸びるので、全ての点がいずれかの分担に属する。
+/// </summary>
+/// <remarks>
+/// 分担の領域が連結していないと、その分担では地面が複数のラベルに分かれ、最大のもの以外は地面として扱われない。
+/// 帯に分けることで各分担の領域は連結し、継ぎ目もcount - 1本で済む。
+/// 各分担は自身の帯に加えて、その両側margin以内の点も読み込む。
+/// 縁の点はラベル付けと三角形分割が帯の外の点に依存するので、のりしろの結果は捨て、隣の分担の結果を使う。
+/// </remarks>
+struct shard_layout {
+    unsigned count = 1;
+    // 帯を並べる軸(0: x, 1: y)と、その軸での入力の範囲
+    unsigned axis = 0;
+    double min = 0;
+    double max = 0;
+    double margin = 50;
+
+    /// <summary>
+    /// 範囲[mn, mx]の点群をcount個の分担に分ける。
+    /// </summary>
+    [[nodiscard]]
+    static shard_layout fit(unsigned count, const vec2f& mn, const vec2f& mx, double margin) noexcept
+    {
+        const unsigned axis = mx.y() - mn.y() > mx.x() - mn.x() ? 1 : 0;
+        return { count, axis, axis ? mn.y() : mn.x(), axis ? mx.y() : mx.x(), margin };
+    }
+
+    /// <summary>
+    /// 座標(x, y)を担当する分担の番号を返す。
+    /// </summary>
+    [[nodiscard]]
+    unsigned shard_of(double x, double y) const noexcept
+    {
+        return strip_of(axis ? y : x);
+    }
+    /// <summary>
+    /// 座標(x, y)が分担shardの帯からmargin以内にあればtrueを返す。
+    /// </summary>
+    [[nodiscard]]
+    bool covers(unsigned shard, double x, double y) const noexcept
+    {
+        return intersects(shard, x, y, x, y);
+    }
+    /// <summary>
+    /// 矩形[min_x, max_x]x[min_y, max_y]が分担shardの帯からmargin以内にかかればtrueを返す。
+    /// 索引から範囲が分かるタイルのうち、読み込む必要のないものを除くのに使う。
+    /// </summary>
+    [[nodiscard]]
+    bool intersects(unsigned shard, double min_x, double min_y, double max_x, double max_y) const noexcept
+    {
+        if (count <= 1) return true;
+        // 帯の番号は座標について単調なので、矩形を広げた両端の帯の間にあればよい
+        const auto lo = axis ? min_y : min_x;
+        const auto hi = axis ? max_y : max_x;
+        return strip_of(lo - margin) <= shard && shard <= strip_of(hi + margin);
+    }
+    /// <summary>
+    /// 分け方を表す文字列。キャッシュのキーに使う。
+    /// </summary>
+    [[nodiscard]]
+    std::string to_string() const
+    {
+        return std::to_string(count) + ',' + std::to_string(axis) + ',' + std::to_string(min) + ',' +
+               std::to_string(max) + ',' + std::to_string(margin);
+    }
+
+    friend bool operator==(const shard_layout& a, const shard_layout& b) noexcept
+    {
+        return a.count == b.count && a.axis == b.axis && a.min == b.min && a.max == b.max && a.margin == b.margin;
+    }
+    friend bool operator!=(const shard_layout& a, const shard_layout& b) noexcept { return !(a == b); }
+
+private:
+    [[nodiscard]]
+    unsigned strip_of(double v) const noexcept
+    {
+        if (count <= 1 || !(max > min)) return 0;
+        const auto k = std::floor((v - min) / (max - min) * count);
+        if (!(k > 0)) return 0;
+        return k >= count ? count - 1 : static_cast<unsigned>(k);
+    }
+};
+
+/// <summary>
+/// 差分処理のために、xy平面を一辺cell_sizeの正方形のパッチに分ける格子。
+/// 列と行はそれぞれx軸とy軸に沿った<see cref="shard_layout"/>で表し、パッチの番号は行 * 列数 + 列とする。
+/// 格子の線は座標がcell_sizeの倍数の位置に揃えるので、タイルの内容が変わって入力の範囲が少し動いても同じ格子になりやすい。
+/// </summary>
+/// <remarks>
+/// 各パッチは<see cref="shard_layout"/>の分担と同じく、自身の正方形からmargin以内の点を読み込み、のりしろの結果は隣のパッチのものを使う。
+/// 最も外側の列と行は範囲の外側にも伸びる。
+/// </remarks>
+struct patch_grid {
+    shard_layout columns;
+    shard_layout rows;
+
+    /// <summary>
+    /// 範囲[mn, mx]を覆う格子を作る。
+    /// </summary>
+    [[nodiscard]]
+    static patch_grid fit(const vec2f& mn, const vec2f& mx, double cell_size, double margin) noexcept
+    {
+        auto fit_axis = [cell_size, margin](unsigned axis, double lo, double hi) -> shard_layout {
+            const auto first = std::floor(lo / cell_size) * cell_size;
+            const auto count = std::max(1.0, std::ceil((hi - first) / cell_size));
+            return { static_cast<unsigned>(count), axis, first, first + count * cell_size, margin };
+        };
+        return { fit_axis(0, mn.x(), mx.x()), fit_axis(1, mn.y(), mx.y()) };
+    }
+
+    [[nodiscard]]
+    unsigned size() const noexcept { return columns.count * rows.count; }
+    /// <summary>
+    /// 座標(x, y)を含むパッチの番号を返す。
+    /// </summary>
+    [[nodiscard]]
+    unsigned cell_of(double x, double y) const noexcept
+    {
+        return rows.shard_of(x, y) * columns.count + columns.shard_of(x, y);
+    }
+    /// <summary>
+    /// 座標(x, y)がパッチcellの正方形からmargin以内にあればtrueを返す。
+    /// </summary>
+    [[nodiscard]]
+    bool covers(unsigned cell, double x, double y) const noexcept
+    {
+        return intersects(cell, x, y, x, y);
+    }
+    /// <summary>
+    /// 矩形[min_x, max_x]x[min_y, max_y]がパッチcellの正方形からmargin以内にかかればtrueを返す。
+    /// </summary>
+    [[nodiscard]]
+    bool intersects(unsigned cell, double min_x, double min_y, double max_x, double max_y) const noexcept
+    {
+        return columns.intersects(cell % columns.count, min_x, min_y, max_x, max_y) &&
+               rows.intersects(cell / columns.count, min_x, min_y, max_x, max_y);
+    }
+    /// <summary>
+    /// 分け方を表す文字列。キャッシュのキーに使う。
+    /// </summary>
+    [[nodiscard]]
+    std::string to_string() const
+    {
+        return columns.to_string() + ';' + rows.to_string();
+    }
+};
+
+/// <summary>
+/// 1つの分担で作ったラベル付きのメッシュ。ラベルは分担ごとの番号である。
+/// 頂点は入力と同じ座標で持ち、<see cref="merge_shards"/>は分担の範囲との比較と継ぎ目の溶接にそのまま使う。
+/// </summary>
+struct shard_mesh {
+    unsigned shard = 0;
+    shard_layout layout;
+    std::vector<vertex<>> vertices;
+    std::vector<label_t> labels;
+    std::vector<triangle> triangles;
+    // 地面のラベル。なければlabel_statistics::no_ground
+    std::size_t ground = label_statistics::no_ground;
+};
+
+/// <summary>
+/// 出力ファイルoutに対する、分担indexの中間ファイルのパス。
+/// </summary>
+inline std::filesystem::path shard_file(const std::filesystem::path& out, unsigned index)
+{
+    auto p = out;
+    p.replace_filename(out.stem().string() + ".shard" + std::to_string(index));
+    return p;
+}
+
+namespace detail {
+
+inline constexpr char shard_magic[8] = { 'G', 'A', 'E', 'I', 'S', 'H', 'D', '1' };
+
+template<class T>
+void write_pod(std::ofstream& out, const T& v) { out.write(reinterpret_cast<const char*>(&v), sizeof(T)); }
+template<class T>
+bool read_pod(std::ifstream& in, T& v) { return static_cast<bool>(in.read(reinterpret_cast<char*>(&v), sizeof(T))); }
+
+}
+
+/// <summary>
+/// 分担のメッシュをpathに書き込む。
+/// </summary>
+inline ouchi::result::result<std::monostate, std::string>
+write_shard(const std::filesystem::path& path, const shard_mesh& m)
+{
+    using namespace std::string_literals;
+    // 書き込み途中のファイルを統合しないよう、一時ファイルに書いてから置き換える
+    auto tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(detail::shard_magic, 8);
+        detail::write_pod(out, static_cast<std::uint64_t>(m.shard));
+        detail::write_pod(out, static_cast<std::uint64_t>(m.layout.count));
+        detail::write_pod(out, static_cast<std::uint64_t>(m.layout.axis));
+        detail::write_pod(out, m.layout.min);
+        detail::write_pod(out, m.layout.max);
+        detail::write_pod(out, m.layout.margin);
+        detail::write_pod(out, static_cast<std::uint64_t>(m.ground));
+        detail::write_pod(out, static_cast<std::uint64_t>(m.vertices.size()));
+        for (std::size_t i = 0; i < m.vertices.size(); ++i) {
+            out.write(reinterpret_cast<const char*>(m.vertices[i].position.coord), sizeof(double) * 3);
+            detail::write_pod(out, m.vertices[i].color.value());
+            detail::write_pod(out, static_cast<std::uint64_t>(m.labels[i]));
+        }
+        detail::write_pod(out, static_cast<std::uint64_t>(m.triangles.size()));
+        for (auto& t : m.triangles) {
+            for (auto idx : t) detail::write_pod(out, static_cast<std::uint64_t>(idx));
+        }
+        if (!out) return ouchi::result::err("cannot write shard "s + tmp.string());
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) return ouchi::result::err(ec.message());
+    return ouchi::result::ok(std::monostate{});
+}
+
+/// <summary>
+/// <see cref="write_shard"/>で書き込んだ分担のメッシュを読み込む。
+/// </summary>
+inline ouchi::result::result<shard_mesh, std::string>
+read_shard(const std::filesystem::path& path)
+{
+    using namespace std::string_literals;
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return ouchi::result::err("cannot open shard "s + path.string());
+    const auto broken = [&path] { return ouchi::result::err("broken shard "s + path.string()); };
+    char magic[8] = {};
+    std::uint64_t shard = 0, shards = 0, axis = 0, ground = 0, count = 0;
+    shard_mesh m;
+    if (!in.read(magic, 8) || !std::equal(magic, magic + 8, detail::shard_magic)) return broken();
+    if (!detail::read_pod(in, shard) || !detail::read_pod(in, shards) || !detail::read_pod(in, axis) ||
+        !detail::read_pod(in, m.layout.min) || !detail::read_pod(in, m.layout.max) || !detail::read_pod(in, m.layout.margin) ||
+        !detail::read_pod(in, ground) || !detail::read_pod(in, count)) return broken();
+    m.shard = static_cast<unsigned>(shard);
+    m.layout.count = static_cast<unsigned>(shards);
+    m.layout.axis = static_cast<unsigned>(axis);
+    m.ground = static_cast<std::size_t>(ground);
+    m.vertices.resize(count);
+    m.labels.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        std::uint32_t c = 0;
+        std::uint64_t l = 0;
+        if (!in.read(reinterpret_cast<char*>(m.vertices[i].position.coord), sizeof(double) * 3) ||
+            !detail::read_pod(in, c) || !detail::read_pod(in, l)) return broken();
+        m.vertices[i].color = color{ c };
+        m.labels[i] = l;
+    }
+    if (!detail::read_pod(in, count)) return broken();
+    m.triangles.resize(count);
+    for (auto& t : m.triangles) {
+        for (auto& idx : t) {
+            std::uint64_t v = 0;
+            if (!detail::read_pod(in, v) || v >= m.vertices.size()) return broken();
+            idx = static_cast<std::size_t>(v);
+        }
+    }
+    return ouchi::result::ok(std::move(m));
+}
+
+/// <summary>
+/// 要素の組を併合する素集合。併合した組の代表は番号が最も小さい要素になる。
+/// </summary>
+class disjoint_set {
+    std::vector<std::size_t> parent_;
+public:
+    explicit disjoint_set(std::size_t n)
+        : parent_(n)
+    {
+        std::iota(parent_.begin(), parent_.end(), std::size_t{ 0 });
+    }
+
+    [[nodiscard]]
+    std::size_t find(std::size_t x) noexcept
+    {
+        while (parent_[x] != x) {
+            parent_[x] = parent_[parent_[x]];
+            x = parent_[x];
+        }
+        return x;
+    }
+    /// <summary>
+    /// aとbの組を併合する。別の組だったならtrueを返す。
+    /// </summary>
+    bool unite(std::size_t a, std::size_t b) noexcept
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b) return false;
+        if (b < a) std::swap(a, b);
+        parent_[b] = a;
+        return true;
+    }
+};
+
+/// <summary>
+/// 分担ごとのメッシュを統合した結果。
+/// </summary>
+struct merged_shards {
+    std::vector<vertex<>> vertices;
+    std::vector<label_t> labels;
+    std::vector<triangle> triangles;
+    std::size_t ground = label_statistics::no_ground;
+    // 継ぎ目で溶接した頂点の数
+    std::size_t welded = 0;
+};
+
+namespace detail {
+
+// 分担ごとのメッシュを統合する。ownsは三角形の重心(x, y)がそのメッシュの担当ならtrueを返す
+template<class Owns>
+merged_shards merge_meshes(std::vector<shard_mesh>& meshes, double tolerance, Owns owns)
+{
+    std::sort(meshes.begin(), meshes.end(), [](const shard_mesh& a, const shard_mesh& b) { return a.shard < b.shard; });
+    std::vector<std::size_t> vertex_offset, label_offset;
+    std::size_t vertex_count = 0, label_count = 0;
+    for (auto& s : meshes) {
+        vertex_offset.push_back(vertex_count);
+        label_offset.push_back(label_count);
+        vertex_count += s.vertices.size();
+        std::size_t labels = 0;
+        for (auto l : s.labels) labels = std::max<std::size_t>(labels, label_id(l) + 1);
+        if (s.ground != label_statistics::no_ground) labels = std::max(labels, s.ground + 1);
+        label_count += labels;
+    }
+    std::vector<vertex<>> all;
+    std::vector<label_t> labels;
+    all.reserve(vertex_count);
+    labels.reserve(vertex_count);
+    for (std::size_t s = 0; s < meshes.size(); ++s) {
+        all.insert(all.end(), meshes[s].vertices.begin(), meshes[s].vertices.end());
+        for (auto l : meshes[s].labels) labels.push_back((label_id(l) + label_offset[s]) | (l & label_border));
+    }
+
+    merged_shards ret;
+    // 同じ位置の頂点を最初の頂点に溶接し、そのラベルを併合する
+    disjoint_set sets(label_count);
+    std::vector<std::size_t> weld(vertex_count);
+    std::iota(weld.begin(), weld.end(), std::size_t{ 0 });
+    const auto keys = sort_by_xy(all, tolerance);
+    for (std::size_t b = 0; b < keys.size();) {
+        auto e = b + 1;
+        for (; e < keys.size() && keys[b].same_position(keys[e]); ++e) {
+            weld[keys[e].index] = keys[b].index;
+            sets.unite(label_id(labels[keys[b].index]), label_id(labels[keys[e].index]));
+            ++ret.welded;
+        }
+        b = e;
+    }
+
+    // 重心を担当する分担の三角形を、溶接した頂点で張り直す
+    std::vector<std::size_t> remap(vertex_count, static_cast<std::size_t>(-1));
+    std::size_t used = 0;
+    for (std::size_t s = 0; s < meshes.size(); ++s) {
+        const auto& vs = meshes[s].vertices;
+        for (auto& t : meshes[s].triangles) {
+            const auto cx = (vs[t[0]].position.x() + vs[t[1]].position.x() + vs[t[2]].position.x()) / 3;
+            const auto cy = (vs[t[0]].position.y() + vs[t[1]].position.y() + vs[t[2]].position.y()) / 3;
+            if (!owns(meshes[s], cx, cy)) continue;
+            triangle out;
+            for (std::size_t k = 0; k < 3; ++k) {
+                const auto v = weld[vertex_offset[s] + t[k]];
+                if (remap[v] == static_cast<std::size_t>(-1)) remap[v] = used++;
+                out[k] = remap[v];
+            }
+            ret.triangles.push_back(out);
+        }
+    }
+
+    // 地面のラベルは分担の多数決で決める
+    std::vector<std::size_t> ground_votes(label_count);
+    for (std::size_t s = 0; s < meshes.size(); ++s) {
+        if (meshes[s].ground != label_statistics::no_ground) ++ground_votes[sets.find(meshes[s].ground + label_offset[s])];
+    }
+    std::size_t ground = label_statistics::no_ground;
+    for (std::size_t l = 0; l < label_count; ++l) {
+        if (ground_votes[l] && (ground == label_statistics::no_ground || ground_votes[l] > ground_votes[ground])) ground = l;
+    }
+
+    // 使われた頂点を三角形が参照する順に並べ、ラベルの番号を詰める
+    std::vector<std::size_t> compact(label_count, static_cast<std::size_t>(-1));
+    std::size_t compact_count = 0;
+    ret.vertices.resize(used);
+    ret.labels.resize(used);
+    for (std::size_t v = 0; v < vertex_count; ++v) {
+        if (remap[v] == static_cast<std::size_t>(-1)) continue;
+        const auto root = sets.find(label_id(labels[v]));
+        if (compact[root] == static_cast<std::size_t>(-1)) compact[root] = compact_count++;
+        auto& out = ret.vertices[remap[v]];
+        out = all[v];
+        out.color = root == ground ? colors::green : colors::red;
+        ret.labels[remap[v]] = compact[root] | (labels[v] & label_border);
+    }
+    if (ground != label_statistics::no_ground) ret.ground = compact[ground];
+    return ret;
+}
+
+}
+
+/// <summary>
+/// 同じ<see cref="shard_layout"/>で分けた分担のメッシュを1つのメッシュに統合する。
+/// 三角形は重心を担当する分担のものだけを残し、のりしろで重複した三角形を捨てる。
+/// xy座標を間隔toleranceの格子に丸めて同じになる頂点は1つに溶接し、その頂点を持つラベルを同じラベルとする。
+/// 統合したラベルは番号を詰め、地面のラベルは各分担の地面のラベルのうち最も多くの分担で一致したものとする。
+/// 頂点の色は<see cref="simplify_color"/>と同じく、地面を緑、それ以外を赤に塗り直す。
+/// </summary>
+/// <remarks>
+/// 分担は同じ点を同じ条件で処理するので、のりしろにある点は隣の分担にも同じ座標で残る。
+/// 三角形分割の前のずらし量も点の座標だけで決まるので、格子上の点でも継ぎ目の両側で同じ対角線が選ばれる。
+/// のりしろが足りず、間引きや三角形分割が分担ごとに異なった頂点は溶接されず、その位置では継ぎ目に隙間が残りうる。
+/// 頂点の対応は<see cref="sort_by_xy"/>で求め、溶接した頂点は分担の番号が小さい方を残す。
+/// </remarks>
+inline merged_shards merge_shards(std::vector<shard_mesh>& shards, double tolerance = default_dedup_tolerance)
+{
+    return detail::merge_meshes(shards, tolerance, [](const shard_mesh& m, double x, double y) {
+        return m.layout.shard_of(x, y) == m.shard;
+    });
+}
+
+/// <summary>
+/// <see cref="patch_grid"/>で分けたパッチのメッシュを1つのメッシュに統合する。<see cref="shard_mesh::shard"/>はパッチの番号とする。
+/// 三角形は重心を含むパッチのものだけを残し、溶接とラベルの統合は<see cref="merge_shards"/>と同じく行う。
+/// </summary>
+inline merged_shards merge_patches(std::vector<shard_mesh>& patches,
+                                   const patch_grid& grid,
+                                   double tolerance = default_dedup_tolerance)
+{
+    return detail::merge_meshes(patches, tolerance, [&grid](const shard_mesh& m, double x, double y) {
+        return grid.cell_of(x, y) == m.shard;
+    });
+}
+
+}
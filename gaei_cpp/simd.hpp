@@ -0,0 +1,190 @@
+﻿#pragma once
+#include <cstddef>
+#include <type_traits>
+#include <algorithm>
+#include "vertex.hpp"
+
+#if !defined(GAEI_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GAEI_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#define GAEI_SIMD_AVX 1
+#include <immintrin.h>
+#endif
+#endif
+
+namespace gaei::simd {
+
+/// <summary>
+/// 明示的なSIMDの実装を持つ型と次元。それ以外はスカラーのループで計算する。
+/// </summary>
+template<class T, std::size_t Dim>
+inline constexpr bool has_kernel =
+    (std::is_same_v<T, double> || std::is_same_v<T, float>) && 2 <= Dim && Dim <= 4;
+
+namespace kernel {
+
+#if defined(GAEI_SIMD_SSE2)
+// 各成分の積(Sub=trueなら差の2乗)を、スカラーのループと同じ順に足し合わせる
+template<std::size_t N, bool Sub>
+double reduce(const double* a, const double* b) noexcept
+{
+    auto term = [](__m128d x, __m128d y) {
+        if constexpr (Sub) {
+            auto d = _mm_sub_pd(x, y);
+            return _mm_mul_pd(d, d);
+        }
+        else return _mm_mul_pd(x, y);
+    };
+    __m128d s;
+#if defined(GAEI_SIMD_AVX)
+    if constexpr (N >= 3) {
+        const auto mask = _mm256_set_epi64x(N == 4 ? -1 : 0, -1, -1, -1);
+        auto x = _mm256_maskload_pd(a, mask), y = _mm256_maskload_pd(b, mask);
+        auto m = [&] {
+            if constexpr (Sub) {
+                auto d = _mm256_sub_pd(x, y);
+                return _mm256_mul_pd(d, d);
+            }
+            else return _mm256_mul_pd(x, y);
+        }();
+        auto lo = _mm256_castpd256_pd128(m), hi = _mm256_extractf128_pd(m, 1);
+        s = _mm_add_sd(_mm_setzero_pd(), lo);
+        s = _mm_add_sd(s, _mm_unpackhi_pd(lo, lo));
+        s = _mm_add_sd(s, hi);
+        if constexpr (N == 4) s = _mm_add_sd(s, _mm_unpackhi_pd(hi, hi));
+        return _mm_cvtsd_f64(s);
+    }
+#endif
+    auto m = term(_mm_loadu_pd(a), _mm_loadu_pd(b));
+    s = _mm_add_sd(_mm_setzero_pd(), m);
+    s = _mm_add_sd(s, _mm_unpackhi_pd(m, m));
+    if constexpr (N == 3) {
+        s = _mm_add_sd(s, term(_mm_load_sd(a + 2), _mm_load_sd(b + 2)));
+    }
+    else if constexpr (N == 4) {
+        auto h = term(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2));
+        s = _mm_add_sd(s, h);
+        s = _mm_add_sd(s, _mm_unpackhi_pd(h, h));
+    }
+    return _mm_cvtsd_f64(s);
+}
+
+template<std::size_t N>
+__m128 load(const float* p) noexcept
+{
+    if constexpr (N == 2) return _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(p));
+    else if constexpr (N == 3) return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(p)), _mm_load_ss(p + 2));
+    else return _mm_loadu_ps(p);
+}
+
+template<std::size_t N, bool Sub>
+float reduce(const float* a, const float* b) noexcept
+{
+    auto x = load<N>(a), y = load<N>(b);
+    __m128 m;
+    if constexpr (Sub) {
+        auto d = _mm_sub_ps(x, y);
+        m = _mm_mul_ps(d, d);
+    }
+    else m = _mm_mul_ps(x, y);
+    auto s = _mm_add_ss(_mm_setzero_ps(), m);
+    s = _mm_add_ss(s, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+    if constexpr (N >= 3) s = _mm_add_ss(s, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2)));
+    if constexpr (N == 4) s = _mm_add_ss(s, _mm_shuffle_ps(m, m, _MM_SHUFFLE(3, 3, 3, 3)));
+    return _mm_cvtss_f32(s);
+}
+#endif
+
+template<std::size_t N, bool Sub, class T>
+T reduce_scalar(const T* a, const T* b) noexcept
+{
+    T sum{};
+    for (auto i = 0u; i < N; ++i) {
+        if constexpr (Sub) {
+            auto c = a[i] - b[i];
+            sum += c * c;
+        }
+        else sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+}
+
+/// <summary>
+/// <see cref="gaei::sqdistance"/>と同じ値を返す。2〜4次元のfloatとdoubleではSSE2/AVXを使う。
+/// </summary>
+template<class T, std::size_t Dim>
+T sqdistance(const vector<T, Dim>& a, const vector<T, Dim>& b) noexcept
+{
+#if defined(GAEI_SIMD_SSE2)
+    if constexpr (has_kernel<T, Dim>) return kernel::reduce<Dim, true>(a.coord, b.coord);
+    else
+#endif
+    return kernel::reduce_scalar<Dim, true>(a.coord, b.coord);
+}
+
+/// <summary>
+/// <see cref="gaei::inner_product"/>と同じ値を返す。
+/// </summary>
+template<class T, std::size_t Dim>
+T inner_product(const vector<T, Dim>& a, const vector<T, Dim>& b) noexcept
+{
+#if defined(GAEI_SIMD_SSE2)
+    if constexpr (has_kernel<T, Dim>) return kernel::reduce<Dim, false>(a.coord, b.coord);
+    else
+#endif
+    return kernel::reduce_scalar<Dim, false>(a.coord, b.coord);
+}
+
+/// <summary>
+/// <see cref="gaei::cross_product"/>と同じ値を返す。
+/// </summary>
+template<class T>
+vector<T, 3> cross_product(const vector<T, 3>& a, const vector<T, 3>& b) noexcept
+{
+    vector<T, 3> c;
+#if defined(GAEI_SIMD_SSE2)
+    if constexpr (std::is_same_v<T, double>) {
+        const auto a01 = _mm_loadu_pd(a.coord), b01 = _mm_loadu_pd(b.coord);
+        const auto a2 = _mm_load_sd(a.coord + 2), b2 = _mm_load_sd(b.coord + 2);
+        // (a1, a2) * (b2, b0) - (a2, a0) * (b1, b2)
+        const auto l = _mm_mul_pd(_mm_shuffle_pd(a01, a2, 1), _mm_shuffle_pd(b2, b01, 0));
+        const auto r = _mm_mul_pd(_mm_shuffle_pd(a2, a01, 0), _mm_shuffle_pd(b01, b2, 1));
+        _mm_storeu_pd(c.coord, _mm_sub_pd(l, r));
+        c.coord[2] = a.coord[0] * b.coord[1] - a.coord[1] * b.coord[0];
+        return c;
+    }
+#endif
+    c.coord[0] = a.coord[1] * b.coord[2] - a.coord[2] * b.coord[1];
+    c.coord[1] = a.coord[2] * b.coord[0] - a.coord[0] * b.coord[2];
+    c.coord[2] = a.coord[0] * b.coord[1] - a.coord[1] * b.coord[0];
+    return c;
+}
+
+/// <summary>
+/// a, b, cの各要素の中央値をout[0, n)に書き込む。outはa, b, cと重なってはならない。
+/// </summary>
+inline void median3(const double* a, const double* b, const double* c, double* out, std::size_t n) noexcept
+{
+    // median(a, b, c) = max(min(a, b), min(max(a, b), c))
+    std::size_t i = 0;
+#if defined(GAEI_SIMD_AVX)
+    for (; i + 4 <= n; i += 4) {
+        const auto x = _mm256_loadu_pd(a + i), y = _mm256_loadu_pd(b + i), z = _mm256_loadu_pd(c + i);
+        _mm256_storeu_pd(out + i, _mm256_max_pd(_mm256_min_pd(x, y), _mm256_min_pd(_mm256_max_pd(x, y), z)));
+    }
+#endif
+#if defined(GAEI_SIMD_SSE2)
+    for (; i + 2 <= n; i += 2) {
+        const auto x = _mm_loadu_pd(a + i), y = _mm_loadu_pd(b + i), z = _mm_loadu_pd(c + i);
+        _mm_storeu_pd(out + i, _mm_max_pd(_mm_min_pd(x, y), _mm_min_pd(_mm_max_pd(x, y), z)));
+    }
+#endif
+    for (; i < n; ++i) out[i] = std::max(std::min(a[i], b[i]), std::min(std::max(a[i], b[i]), c[i]));
+}
+
+}
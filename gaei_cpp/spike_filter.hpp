@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "vertex.hpp"
+#include "parallel.hpp"
+#include "ground_filter.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 周囲の点から孤立して高い、または低い点(鳥や電線、多重反射による誤差点)を取り除き、取り除いた点の数を返す。
+/// 点の高さを間隔cell_sizeの格子に集計して<see cref="height_grid::median3"/>で平滑化し、
+/// zが平滑化した面からthresholdを超えて離れている点を取り除く。残った点は元の順序を保つ。
+/// </summary>
+/// <remarks>
+/// 中央値は左右、上下の順に3セルずつとるので、幅が1セルの突起だけが取り除かれ、建物の角や縁は残る。
+/// 中央値はSIMDで計算し、格子の行と点の区間ごとに並列に処理する。
+/// </remarks>
+inline std::size_t remove_spikes(std::vector<vertex<>>& vs, double threshold, double cell_size = 1.0)
+{
+    if (vs.size() < 3) return 0;
+    height_grid grid(vs, cell_size);
+    grid.median3();
+    std::vector<char> spike(vs.size());
+    parallel_for(vs.size(), [&](std::size_t b, std::size_t e) {
+        for (auto i = b; i < e; ++i) spike[i] = std::abs(vs[i].position.z() - grid[grid.cell_of(vs[i].position)]) > threshold;
+    });
+    // 誤差点がなければ点を動かさない
+    auto out = static_cast<std::size_t>(std::find(spike.begin(), spike.end(), 1) - spike.begin());
+    for (auto i = out; i < vs.size(); ++i) {
+        if (spike[i]) continue;
+        if (out != i) vs[out] = vs[i];
+        ++out;
+    }
+    const auto removed = vs.size() - out;
+    vs.resize(out);
+    return removed;
+}
+
+}
@@ -0,0 +1,257 @@
+﻿#pragma once
+#include <cstddef>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <ostream>
+#include <sstream>
+#include <fstream>
+#include <locale>
+#include "trace.hpp"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#endif
+
+namespace gaei {
+
+/// <summary>
+/// プロセス開始からのピーク常駐メモリ量[byte]を返す。取得できない環境では0を返す。
+/// </summary>
+inline std::size_t peak_rss() noexcept
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return static_cast<std::size_t>(pmc.PeakWorkingSetSize);
+#else
+    rusage ru{};
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+    return static_cast<std::size_t>(ru.ru_maxrss);
+#else
+    // linuxではKiB単位
+    return static_cast<std::size_t>(ru.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+/// <summary>
+/// <see cref="peak_rss"/>が返すピーク常駐メモリ量を現在の常駐メモリ量に戻す。
+/// linuxでのみ対応し、戻せなかった場合はfalseを返す。
+/// </summary>
+inline bool reset_peak_rss() noexcept
+{
+#if defined(__linux__)
+    std::ofstream f("/proc/self/clear_refs");
+    return f && (f << '5') && f.flush();
+#else
+    return false;
+#endif
+}
+
+/// <summary>
+/// 処理段階ごとの実行時間、点数、ピークメモリ量を記録する。
+/// 記録は<see cref="scoped_stage"/>によって行われる。
+/// </summary>
+/// <example>
+/// <code>
+/// stage_report rep;
+/// rep.activate();
+/// {
+///     scoped_stage s("thinout", vs.size());
+///     thinout(vs, 2);
+///     s.points_out(vs.size());
+/// }
+/// rep.write_json(std::cout);
+/// </code>
+/// </example>
+class stage_report {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct record {
+        std::string name;
+        unsigned depth = 0;
+        double begin = 0;   // レポート開始からの秒数
+        double seconds = 0;
+        std::size_t points_in = 0;
+        std::size_t points_out = 0;
+        std::size_t peak_rss = 0;
+        // 段階のアリーナが受けた確保の要求と、実際にヒープから確保した回数
+        std::size_t allocations = 0;
+        std::size_t heap_allocations = 0;
+    };
+
+    stage_report()
+        : begin_{ clock::now() }
+    {}
+    ~stage_report() { deactivate(); }
+    stage_report(const stage_report&) = delete;
+    stage_report& operator=(const stage_report&) = delete;
+
+    /// <summary>
+    /// このレポートを<see cref="scoped_stage"/>の記録先にする。
+    /// </summary>
+    void activate() noexcept { current_.store(this); }
+    void deactivate() noexcept
+    {
+        auto self = this;
+        current_.compare_exchange_strong(self, nullptr);
+    }
+    [[nodiscard]]
+    static stage_report* current() noexcept { return current_.load(std::memory_order_relaxed); }
+
+    [[nodiscard]]
+    double elapsed() const noexcept
+    {
+        return std::chrono::duration<double>(clock::now() - begin_).count();
+    }
+    [[nodiscard]]
+    std::vector<record> records() const
+    {
+        std::lock_guard lk(mtx_);
+        return records_;
+    }
+
+    void write_text(std::ostream& out) const
+    {
+        std::lock_guard lk(mtx_);
+        out << "elapsed time";
+        for (auto& r : records_) {
+            out << '\n' << std::string(r.depth * 2, ' ') << r.name << '\t' << r.seconds;
+            if (r.points_in || r.points_out)
+                out << "\t(" << r.points_in << " -> " << r.points_out << " points)";
+            if (r.allocations)
+                out << "\t[" << r.allocations << " allocations -> " << r.heap_allocations << " heap]";
+        }
+        out << "\ntotal\t" << elapsed()
+            << "\npeak memory\t" << (peak_rss() >> 20) << "MiB\n";
+    }
+    void write_json(std::ostream& out) const
+    {
+        std::ostringstream s;
+        s.imbue(std::locale::classic());
+        s.precision(9);
+        {
+            std::lock_guard lk(mtx_);
+            s << "{\"total_seconds\":" << elapsed()
+              << ",\"peak_rss\":" << peak_rss()
+              << ",\"stages\":[";
+            for (auto i = 0u; i < records_.size(); ++i) {
+                auto& r = records_[i];
+                if (i) s << ',';
+                s << "{\"name\":";
+                write_json_string(s, r.name);
+                s << ",\"depth\":" << r.depth
+                  << ",\"begin\":" << r.begin
+                  << ",\"seconds\":" << r.seconds
+                  << ",\"points_in\":" << r.points_in
+                  << ",\"points_out\":" << r.points_out
+                  << ",\"points_per_second\":" << (r.seconds > 0 ? r.points_in / r.seconds : 0.0)
+                  << ",\"peak_rss\":" << r.peak_rss
+                  << ",\"allocations\":" << r.allocations
+                  << ",\"heap_allocations\":" << r.heap_allocations << '}';
+            }
+            s << "]}\n";
+        }
+        out << s.str();
+    }
+
+private:
+    friend class scoped_stage;
+    static inline std::atomic<stage_report*> current_{ nullptr };
+
+    clock::time_point begin_;
+    std::vector<record> records_;
+    mutable std::mutex mtx_;
+
+    std::size_t open(std::string_view name, unsigned depth, std::size_t points_in)
+    {
+        std::lock_guard lk(mtx_);
+        records_.push_back({ std::string(name), depth, elapsed(), 0, points_in, points_in, 0, 0, 0 });
+        return records_.size() - 1;
+    }
+    void close(std::size_t idx, double seconds, std::size_t points_out,
+               std::size_t allocations, std::size_t heap_allocations)
+    {
+        auto rss = peak_rss();
+        std::lock_guard lk(mtx_);
+        auto& r = records_[idx];
+        r.seconds = seconds;
+        r.points_out = points_out;
+        r.peak_rss = rss;
+        r.allocations = allocations;
+        r.heap_allocations = heap_allocations;
+    }
+};
+
+/// <summary>
+/// スコープの間の実行時間を、有効な<see cref="stage_report"/>に記録する。
+/// 有効なレポートがなければ何もしない。
+/// トレースが有効ならば同じ区間を<see cref="trace_recorder"/>にも記録する。
+/// </summary>
+class scoped_stage {
+public:
+    explicit scoped_stage(std::string_view name, std::size_t points_in = 0)
+        : trace_{ name }
+        , report_{ stage_report::current() }
+        , points_out_{ points_in }
+    {
+        if (!report_) return;
+        idx_ = report_->open(name, depth()++, points_in);
+        begin_ = stage_report::clock::now();
+    }
+    ~scoped_stage()
+    {
+        if (!report_) return;
+        --depth();
+        report_->close(idx_,
+                       std::chrono::duration<double>(stage_report::clock::now() - begin_).count(),
+                       points_out_, allocations_, heap_allocations_);
+    }
+    scoped_stage(const scoped_stage&) = delete;
+    scoped_stage& operator=(const scoped_stage&) = delete;
+
+    /// <summary>
+    /// この段階を終えたときの点数を設定する。設定しなければ入力点数と同じとみなす。
+    /// </summary>
+    void points_out(std::size_t n) noexcept { points_out_ = n; }
+    /// <summary>
+    /// この段階で要求されたメモリ確保の回数と、そのうち実際にヒープから確保した回数を設定する。
+    /// </summary>
+    void allocations(std::size_t requested, std::size_t heap) noexcept
+    {
+        allocations_ = requested;
+        heap_allocations_ = heap;
+    }
+
+private:
+    trace_scope trace_;
+    stage_report* report_;
+    std::size_t idx_ = 0;
+    std::size_t points_out_;
+    std::size_t allocations_ = 0;
+    std::size_t heap_allocations_ = 0;
+    stage_report::clock::time_point begin_;
+
+    static unsigned& depth() noexcept
+    {
+        thread_local unsigned d = 0;
+        return d;
+    }
+};
+
+}
@@ -10,11 +10,14 @@
 #include <queue>
 #include <unordered_set>
 #include <unordered_map>
+#include <memory_resource>
 
 #include <chrono>
 
 #include "vertex.hpp"
 #include "color.hpp"
+#include "label_statistics.hpp"
+#include "trace.hpp"
 #include "ouchilib/crypto/common.hpp"
 
 namespace std {
@@ -45,65 +48,97 @@ constexpr auto abs(T a) noexcept
     return a < 0 ? -a : a;
 }
 
-constexpr std::uint32_t idx_to_color(unsigned int idx) noexcept
-{
-    return 0xFFFFFF & idx;
-}
-
-constexpr unsigned int color_to_idx(std::uint32_t color) noexcept
-{
-    return 0xFFFFFF & color;
-}
-
 class surface_structure_isolate {
 public:
-    static constexpr std::uint32_t border = 1u << 31;
-    surface_structure_isolate(float diff = 4)
-        : not_visited_{}
+    // トレースに記録する1イベントあたりの連結成分数
+    static constexpr unsigned bfs_batch_size = 4096;
+    /// <summary>
+    /// 作業領域のコンテナはmrから確保する。段階ごとのアリーナを渡せば、ラベル付けの後に一度に解放できる。
+    /// </summary>
+    surface_structure_isolate(float diff = 4, std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+        : not_visited_{ mr }
+        , work_space_{ mr }
+        , queue_{ mr }
         , diff_{ diff }
     {}
+    /// <summary>
+    /// 点にラベルを付け、ラベルの数を返す。vertexes[i]のラベルはlabels[i]に格納される。
+    /// 同時にラベルごとの統計量を<see cref="statistics"/>に作成する。
+    /// </summary>
     /// <remarks>
-    /// vertexesは変更されないが、要素を変更するためconst参照ではない。
+    /// 同じxy座標の点が複数ある場合、最後の点の属するラベルがすべてに付けられる。
     /// </remarks>
     template<class C>
-    auto operator()(C&& vertexes)
+    std::size_t operator()(const C& vertexes, std::vector<label_t>& labels)
     {
-        std::uint32_t color = 0;
-        work_space_.reserve(vertexes.size());
-        not_visited_.reserve(vertexes.size());
-        for (auto it = vertexes.begin(); it != vertexes.end(); ++it) {
-            work_space_.insert_or_assign({it->position.x(), it->position.y()}, *it);
-            not_visited_.insert({ it->position.x(), it->position.y() });
+        label_t label = 0;
+        {
+            trace_scope ts("ssi_hash");
+            work_space_.clear();
+            not_visited_.clear();
+            work_space_.reserve(vertexes.size());
+            not_visited_.reserve(vertexes.size());
+            for (auto it = vertexes.begin(); it != vertexes.end(); ++it) {
+                work_space_.insert_or_assign({it->position.x(), it->position.y()}, node{ it->position.z(), not_labeled });
+                not_visited_.insert({ it->position.x(), it->position.y() });
+            }
         }
         while (not_visited_.size()) {
-            visit(*not_visited_.begin(), idx_to_color(color++));
+            trace_scope ts("ssi_bfs_batch");
+            for (auto i = 0u; i < bfs_batch_size && not_visited_.size(); ++i)
+                visit(*not_visited_.begin(), label++);
         }
+        trace_scope ts("ssi_write_back");
+        stats_.clear();
+        stats_.resize(label);
+        labels.resize(vertexes.size());
+        auto l = labels.begin();
         for (auto& v : vertexes) {
-            v.color = work_space_.find({ v.position.x(), v.position.y() })->second.color;
+            *l = work_space_.find({ v.position.x(), v.position.y() })->second.label;
+            stats_.add(label_id(*l), v.position, is_border(*l));
+            ++l;
         }
-        return color;
+        stats_.finalize();
+        return label;
     }
+    /// <summary>
+    /// 直前のラベル付けで作成されたラベルごとの統計量。
+    /// </summary>
+    [[nodiscard]]
+    const label_statistics& statistics() const noexcept { return stats_; }
+    [[nodiscard]]
+    label_statistics& statistics() noexcept { return stats_; }
 private:
-    std::unordered_set<vec2f> not_visited_;
-    std::unordered_map<vec2f, vertex<>> work_space_;
-    std::deque<vec2f> queue_;
+    // ラベル付けの途中状態を表す特別な値
+    static constexpr label_t not_labeled = ~label_border;
+    static constexpr label_t queued = not_labeled - 1;
+
+    struct node {
+        double z;
+        label_t label;
+    };
+
+    std::pmr::unordered_set<vec2f> not_visited_;
+    std::pmr::unordered_map<vec2f, node> work_space_;
+    std::pmr::deque<vec2f> queue_;
+    label_statistics stats_;
     float diff_;
     static constexpr vec2f d[4] = { {0, -1}, {0, 1}, {1, 0}, {-1, 0} };
 
 
-    void visit(vec2f t, std::uint32_t label)
+    void visit(vec2f t, label_t label)
     {
         queue_.push_back(t);
         auto look = [this, label](auto&& nv, auto&& ot, auto&& cpos, auto&& invalid) {
             // nvの位置に要素がないならば境界印を付けて次の探索候補を見る
             // nvの位置の要素に別のラベルを付けるべきなら境界印をつけて次の探索候補を見る
-            if (nv == invalid || abs(nv->second.position.z() - ot->second.position.z()) > diff_) {
-                ot->second.color = color{ label | border };
+            if (nv == invalid || abs(nv->second.z - ot->second.z) > diff_) {
+                ot->second.label = label | label_border;
                 return;
             }
             // すでに訪問済みならば次の探索候補を見る
-            if (nv->second.color.is_valid()) return;
-            nv->second.color.validate();
+            if (nv->second.label != not_labeled) return;
+            nv->second.label = queued;
             queue_.push_back(cpos);
         };
         while (queue_.size()) {
@@ -111,14 +146,13 @@ private:
             auto ot = work_space_.find(ov);
             queue_.pop_front();
             // 訪問済みのしるしをつける
-            ot->second.color = color{ label };
+            ot->second.label = label;
             // 未訪問リストから消す
             not_visited_.erase(ov);
-            const vec2f tv{ ot->second.position.x(), ot->second.position.y() };
             // 探索は4方向に伸びていく
 
             for (auto i = 0u; i < 4; ++i) {
-                const vec2f cpos = tv + d[i];
+                const vec2f cpos = ov + d[i];
                 auto nitr = work_space_.find(cpos);
                 look(nitr, ot, cpos, work_space_.end());
             }
@@ -126,4 +160,4 @@ private:
     }
 };
 
-}
+}
\ No newline at end of file
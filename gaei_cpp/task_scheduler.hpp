@@ -0,0 +1,356 @@
+﻿#pragma once
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+#include <algorithm>
+#include "parallel.hpp"
+#include "ouchilib/result/result.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 作業スレッドごとに両端キューを持つスレッドプール。
+/// 作業スレッドは自分のキューの末尾から仕事を取り、空ならば他のスレッドのキューの先頭から盗む。
+/// </summary>
+/// <remarks>
+/// キューはそれぞれミューテックスで保護する。仕事の粒度はタイル単位なので、ロックの費用は問題にならない。
+/// 作業スレッドの中では<see cref="hardware_threads"/>が1を返すので、仕事の中の<see cref="parallel_for"/>は直列に実行され、
+/// スレッドが作業スレッドの数を超えて増えることはない。
+/// </remarks>
+class work_stealing_pool {
+public:
+    explicit work_stealing_pool(unsigned threads = hardware_threads())
+        : queues_(std::max(threads, 1u))
+    {
+        workers_.reserve(queues_.size());
+        for (unsigned i = 0; i < queues_.size(); ++i) workers_.emplace_back([this, i] { work(i); });
+    }
+    ~work_stealing_pool()
+    {
+        {
+            std::lock_guard lk(mtx_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    /// <summary>
+    /// 作業スレッドの数。
+    /// </summary>
+    [[nodiscard]]
+    unsigned size() const noexcept { return static_cast<unsigned>(queues_.size()); }
+    /// <summary>
+    /// 他のスレッドのキューから仕事を盗んだ回数。
+    /// </summary>
+    [[nodiscard]]
+    std::size_t steals() const
+    {
+        std::lock_guard lk(mtx_);
+        return steals_;
+    }
+
+    /// <summary>
+    /// 仕事を追加する。作業スレッドから呼べば自分のキューに、それ以外からは順番にキューに追加する。
+    /// </summary>
+    void submit(std::function<void()> task)
+    {
+        auto i = self().pool == this ? self().index : static_cast<unsigned>(next_++ % queues_.size());
+        {
+            std::lock_guard lk(queues_[i].mtx);
+            queues_[i].tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard lk(mtx_);
+            ++queued_;
+            ++pending_;
+        }
+        wake_.notify_one();
+    }
+
+    /// <summary>
+    /// 追加された仕事が全て終わるまで待つ。仕事が例外を投げていれば、最初の例外を投げ直す。
+    /// 作業スレッドから呼んではならない。
+    /// </summary>
+    void wait_idle()
+    {
+        std::unique_lock lk(mtx_);
+        idle_.wait(lk, [this] { return pending_ == 0; });
+        if (auto e = std::exchange(error_, nullptr)) std::rethrow_exception(e);
+    }
+
+private:
+    struct queue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+    // 呼び出したスレッドが属するプールと、その中での番号
+    struct identity {
+        const work_stealing_pool* pool = nullptr;
+        unsigned index = 0;
+    };
+
+    std::vector<queue> queues_;
+    std::vector<std::thread> workers_;
+    mutable std::mutex mtx_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    // キューにあってまだ取られていない仕事の数と、終わっていない仕事の数
+    std::size_t queued_ = 0;
+    std::size_t pending_ = 0;
+    std::size_t steals_ = 0;
+    std::size_t next_ = 0;
+    std::exception_ptr error_;
+    bool stop_ = false;
+
+    static identity& self() noexcept
+    {
+        thread_local identity id;
+        return id;
+    }
+
+    // queued_を減らして取る権利を得てから呼ぶ。権利の数だけ仕事がキューにあるので、必ず見つかる
+    std::function<void()> take(unsigned index)
+    {
+        for (;;) {
+            {
+                auto& q = queues_[index];
+                std::lock_guard lk(q.mtx);
+                if (!q.tasks.empty()) {
+                    auto t = std::move(q.tasks.back());
+                    q.tasks.pop_back();
+                    return t;
+                }
+            }
+            for (unsigned k = 1; k < queues_.size(); ++k) {
+                auto& q = queues_[(index + k) % queues_.size()];
+                std::unique_lock lk(q.mtx);
+                if (q.tasks.empty()) continue;
+                auto t = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                lk.unlock();
+                std::lock_guard g(mtx_);
+                ++steals_;
+                return t;
+            }
+        }
+    }
+
+    void work(unsigned index)
+    {
+        self() = { this, index };
+        thread_limit() = 1;
+        for (;;) {
+            {
+                std::unique_lock lk(mtx_);
+                wake_.wait(lk, [this] { return stop_ || queued_ > 0; });
+                if (!queued_) return;
+                --queued_;
+            }
+            auto task = take(index);
+            std::exception_ptr e;
+            try {
+                task();
+            }
+            catch (...) {
+                e = std::current_exception();
+            }
+            std::lock_guard lk(mtx_);
+            if (e && !error_) error_ = e;
+            if (--pending_ == 0) idle_.notify_all();
+        }
+    }
+};
+
+/// <summary>
+/// 要素を複数の段階に順に通す処理の流れ。異なる要素の異なる段階を<see cref="work_stealing_pool"/>で並行して実行する。
+/// 各段階は同時に処理する要素の数の上限(容量)を持ち、次の段階が満杯の要素は現在の段階に留まる。
+/// これにより、例えば読み込みが先走って未処理の要素がメモリを占めることを防ぐ。
+/// </summary>
+/// <example>
+/// <code>
+/// gaei::stage_graph<tile> g;
+/// g.add("load", load, 2).add("triangulate", triangulate, 4);
+/// gaei::work_stealing_pool pool;
+/// if (auto r = g.run(tiles, pool); !r) std::cout << r.unwrap_err();
+/// g.write_text(std::cout);
+/// </code>
+/// </example>
+template<class T>
+class stage_graph {
+public:
+    using stage_function = std::function<ouchi::result::result<std::monostate, std::string>(T&)>;
+
+    struct stage_stats {
+        std::string name;
+        std::size_t capacity = 1;
+        // 処理した要素の数と、その処理に要した時間の合計[s]
+        std::size_t items = 0;
+        double busy_seconds = 0;
+        // 同時にこの段階にあった要素の数の最大値。次の段階を待っている要素を含む
+        std::size_t max_occupancy = 0;
+    };
+
+    /// <summary>
+    /// 最後の段階の後に段階を加える。capacityは同時にこの段階にある要素の数の上限で、0は1とみなす。
+    /// </summary>
+    stage_graph& add(std::string name, stage_function f, std::size_t capacity = 1)
+    {
+        stats_.push_back({ std::move(name), std::max<std::size_t>(capacity, 1) });
+        stages_.push_back(std::move(f));
+        return *this;
+    }
+
+    /// <summary>
+    /// 全ての要素を全ての段階に順に通す。同じ要素の段階は順に実行される。
+    /// 段階がエラーを返すと新しい要素の投入をやめ、実行中の段階が終わるのを待って最初のエラーを返す。
+    /// 段階が例外を投げた場合も同様に待ってから例外を投げ直す。
+    /// </summary>
+    ouchi::result::result<std::monostate, std::string>
+    run(std::vector<T>& items, work_stealing_pool& pool)
+    {
+        for (auto& s : stats_) s = { s.name, s.capacity };
+        workers_ = pool.size();
+        const auto begin = std::chrono::steady_clock::now();
+        if (!stages_.empty() && !items.empty()) {
+            state st(items, pool, stages_.size());
+            std::vector<std::pair<std::size_t, std::size_t>> ready;
+            {
+                std::lock_guard lk(st.mtx);
+                admit(st, ready);
+            }
+            dispatch(st, ready);
+            pool.wait_idle();
+            wall_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            if (st.failed) return ouchi::result::err(std::move(st.error));
+        }
+        else wall_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return ouchi::result::ok(std::monostate{});
+    }
+
+    /// <summary>
+    /// 直前の<see cref="run"/>での段階ごとの統計。
+    /// </summary>
+    [[nodiscard]]
+    const std::vector<stage_stats>& stats() const noexcept { return stats_; }
+    [[nodiscard]]
+    double wall_seconds() const noexcept { return wall_seconds_; }
+    /// <summary>
+    /// 直前の<see cref="run"/>で、作業スレッドの時間のうちstageの処理に使われた割合。
+    /// </summary>
+    [[nodiscard]]
+    double utilization(const stage_stats& stage) const noexcept
+    {
+        return wall_seconds_ > 0 ? stage.busy_seconds / (wall_seconds_ * workers_) : 0.0;
+    }
+
+    void write_text(std::ostream& out) const
+    {
+        out << "stage\titems\tbusy[s]\tutilization\tmax_occupancy/capacity\n";
+        for (auto& s : stats_) {
+            out << s.name << '\t' << s.items << '\t' << s.busy_seconds << '\t'
+                << utilization(s) << '\t' << s.max_occupancy << '/' << s.capacity << '\n';
+        }
+        out << "wall\t" << wall_seconds_ << "\tworkers\t" << workers_ << '\n';
+    }
+
+private:
+    struct state {
+        state(std::vector<T>& v, work_stealing_pool& p, std::size_t stages)
+            : items(v), pool(p), occupancy(stages), waiting(stages)
+        {}
+
+        std::vector<T>& items;
+        work_stealing_pool& pool;
+        // 段階にある要素の数と、段階に入るのを待っている要素
+        std::vector<std::size_t> occupancy;
+        std::vector<std::deque<std::size_t>> waiting;
+        std::mutex mtx;
+        std::size_t next = 0;
+        bool failed = false;
+        std::string error;
+    };
+
+    std::vector<stage_function> stages_;
+    std::vector<stage_stats> stats_;
+    double wall_seconds_ = 0;
+    unsigned workers_ = 1;
+
+    // 要素iを段階kに入れる。st.mtxを持って呼ぶ
+    void enter(state& st, std::size_t k, std::size_t i, std::vector<std::pair<std::size_t, std::size_t>>& ready)
+    {
+        stats_[k].max_occupancy = std::max(stats_[k].max_occupancy, ++st.occupancy[k]);
+        ready.emplace_back(k, i);
+    }
+    // 空きがある限り新しい要素を最初の段階に入れる。st.mtxを持って呼ぶ
+    void admit(state& st, std::vector<std::pair<std::size_t, std::size_t>>& ready)
+    {
+        while (!st.failed && st.next < st.items.size() && st.occupancy[0] < stats_[0].capacity) {
+            enter(st, 0, st.next++, ready);
+        }
+    }
+    // 段階kの枠を1つ空け、空いた枠に待っている要素を入れる。st.mtxを持って呼ぶ
+    void release(state& st, std::size_t k, std::vector<std::pair<std::size_t, std::size_t>>& ready)
+    {
+        for (;;) {
+            --st.occupancy[k];
+            if (k == 0) {
+                admit(st, ready);
+                return;
+            }
+            // 失敗した後は待っている要素を先に進めない
+            if (st.failed || st.waiting[k].empty()) return;
+            auto i = st.waiting[k].front();
+            st.waiting[k].pop_front();
+            enter(st, k, i, ready);
+            // 待っていた要素が前の段階の枠を空ける
+            --k;
+        }
+    }
+    void dispatch(state& st, std::vector<std::pair<std::size_t, std::size_t>>& ready)
+    {
+        // 作業スレッドは自分のキューの末尾から取るので、後の段階の仕事を最後に追加して先に処理させる
+        std::sort(ready.begin(), ready.end());
+        for (auto [k, i] : ready) st.pool.submit([this, &st, k = k, i = i] { process(st, k, i); });
+    }
+    void process(state& st, std::size_t k, std::size_t i)
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        auto r = stages_[k](st.items[i]);
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::vector<std::pair<std::size_t, std::size_t>> ready;
+        {
+            std::lock_guard lk(st.mtx);
+            stats_[k].busy_seconds += seconds;
+            ++stats_[k].items;
+            if (!r && !st.failed) {
+                st.failed = true;
+                st.error = std::string(r.unwrap_err());
+            }
+            if (r && !st.failed && k + 1 < stages_.size()) {
+                if (st.occupancy[k + 1] < stats_[k + 1].capacity) {
+                    enter(st, k + 1, i, ready);
+                    release(st, k, ready);
+                }
+                // 次の段階が満杯ならば、この段階の枠を持ったまま待つ
+                else st.waiting[k + 1].push_back(i);
+            }
+            else release(st, k, ready);
+        }
+        dispatch(st, ready);
+    }
+};
+
+}
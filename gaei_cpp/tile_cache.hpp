@@ -0,0 +1,356 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#include <istream>
+#include <fstream>
+#include <filesystem>
+#include <system_error>
+#include <variant>
+#include "vertex.hpp"
+#include "tile_index.hpp"
+#include "shard.hpp"
+#include "ouchilib/result/result.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// FNV-1aによる64bitハッシュ。hに前回の戻り値を渡すと続きから計算する。
+/// </summary>
+[[nodiscard]]
+constexpr std::uint64_t fnv1a(std::string_view data, std::uint64_t h = 14695981039346656037ull) noexcept
+{
+    for (auto c : data) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+[[nodiscard]]
+constexpr std::uint64_t fnv1a(std::uint64_t value, std::uint64_t h) noexcept
+{
+    for (auto i = 0u; i < 8; ++i) {
+        h ^= (value >> (i * 8)) & 0xFF;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/// <summary>
+/// タイルごとのパース結果をローカルディスクに保存するキャッシュ。
+/// キーはタイルの内容のハッシュと読み込み条件のハッシュから作られるので、内容が変わったタイルだけがパースし直される。
+/// 実行全体の結果も、全タイルのハッシュとオプションから作ったキーで記録する。
+/// </summary>
+/// <remarks>
+/// ラベル付けと三角形分割はタイルをまたいで行うので、タイルごとではなく<see cref="patch_grid"/>のパッチごとに、
+/// 間引いた点とそのラベル、三角形を<see cref="store_patch"/>で保存する。
+/// パッチのキーは<see cref="patch_key"/>で作り、内容が変わったタイルにかかるパッチだけが作り直される。
+/// </remarks>
+class tile_cache {
+    std::filesystem::path dir_;
+    static constexpr char points_magic[8] = { 'G', 'A', 'E', 'I', 'P', 'T', 'S', '1' };
+    static constexpr char bounds_magic[8] = { 'G', 'A', 'E', 'I', 'B', 'B', 'X', '1' };
+public:
+    explicit tile_cache(std::filesystem::path dir)
+        : dir_{ std::move(dir) }
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+    }
+
+    [[nodiscard]]
+    const std::filesystem::path& directory() const noexcept { return dir_; }
+
+    /// <summary>
+    /// keyに対応する点集合をdestの末尾に追加する。キャッシュがなければfalseを返す。
+    /// errorsには読み込み時に捨てた誤差点の数が格納される。
+    /// </summary>
+    bool load_points(std::uint64_t key, std::vector<vertex<>>& dest, std::size_t& errors) const
+    {
+        std::ifstream in(path_of("pts_", key, ".bin"), std::ios::binary);
+        char magic[8] = {};
+        std::uint64_t count = 0, err = 0;
+        if (!in.read(magic, 8) || !std::equal(magic, magic + 8, points_magic)) return false;
+        if (!in.read(reinterpret_cast<char*>(&count), sizeof(count)) ||
+            !in.read(reinterpret_cast<char*>(&err), sizeof(err))) return false;
+        std::vector<double> buf(count * 3);
+        if (!in.read(reinterpret_cast<char*>(buf.data()), buf.size() * sizeof(double))) return false;
+        dest.reserve(dest.size() + count);
+        for (std::size_t i = 0; i < count; ++i) {
+            dest.push_back({ { buf[i * 3], buf[i * 3 + 1], buf[i * 3 + 2] }, colors::none });
+        }
+        errors = static_cast<std::size_t>(err);
+        return true;
+    }
+    ouchi::result::result<std::monostate, std::string>
+    store_points(std::uint64_t key, const vertex<>* first, std::size_t count, std::size_t errors) const
+    {
+        using namespace std::string_literals;
+        // 書き込み途中のファイルを読まないよう、一時ファイルに書いてから置き換える
+        auto path = path_of("pts_", key, ".bin");
+        auto tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            std::uint64_t c = count, e = errors;
+            out.write(points_magic, 8);
+            out.write(reinterpret_cast<const char*>(&c), sizeof(c));
+            out.write(reinterpret_cast<const char*>(&e), sizeof(e));
+            for (std::size_t i = 0; i < count; ++i) {
+                out.write(reinterpret_cast<const char*>(first[i].position.coord), sizeof(double) * 3);
+            }
+            if (!out) return ouchi::result::err("cannot write cache "s + tmp.string());
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) return ouchi::result::err(ec.message());
+        return ouchi::result::ok(std::monostate{});
+    }
+
+    /// <summary>
+    /// 内容のハッシュがcontent_hashのタイルの範囲をdestに格納する。キャッシュがなければfalseを返す。
+    /// 範囲は誤差点を除く全ての点から求め、読み込み条件によらない。
+    /// </summary>
+    bool load_bounds(std::uint64_t content_hash, tile_entry& dest) const
+    {
+        std::ifstream in(path_of("bbox_", content_hash, ".bin"), std::ios::binary);
+        char magic[8] = {};
+        std::uint64_t count = 0;
+        double v[4] = {};
+        if (!in.read(magic, 8) || !std::equal(magic, magic + 8, bounds_magic)) return false;
+        if (!in.read(reinterpret_cast<char*>(&count), sizeof(count)) ||
+            !in.read(reinterpret_cast<char*>(v), sizeof(v))) return false;
+        dest.min = { v[0], v[1] };
+        dest.max = { v[2], v[3] };
+        dest.count = static_cast<std::size_t>(count);
+        return true;
+    }
+    ouchi::result::result<std::monostate, std::string>
+    store_bounds(std::uint64_t content_hash, const tile_entry& bounds) const
+    {
+        using namespace std::string_literals;
+        auto path = path_of("bbox_", content_hash, ".bin");
+        auto tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            const std::uint64_t count = bounds.count;
+            const double v[4] = { bounds.min.x(), bounds.min.y(), bounds.max.x(), bounds.max.y() };
+            out.write(bounds_magic, 8);
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            out.write(reinterpret_cast<const char*>(v), sizeof(v));
+            if (!out) return ouchi::result::err("cannot write cache "s + tmp.string());
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) return ouchi::result::err(ec.message());
+        return ouchi::result::ok(std::monostate{});
+    }
+
+    /// <summary>
+    /// keyに対応するパッチのメッシュをdestに格納する。キャッシュがないか壊れていればfalseを返す。
+    /// </summary>
+    bool load_patch(std::uint64_t key, shard_mesh& dest) const
+    {
+        auto r = read_shard(path_of("patch_", key, ".bin"));
+        if (!r) return false;
+        dest = std::move(r.unwrap());
+        return true;
+    }
+    ouchi::result::result<std::monostate, std::string>
+    store_patch(std::uint64_t key, const shard_mesh& patch) const
+    {
+        return write_shard(path_of("patch_", key, ".bin"), patch);
+    }
+
+    /// <summary>
+    /// keyの実行結果として記録された出力ファイルが、記録時から変わっていなければtrueを返す。
+    /// 目録とともに記録した部分のファイルも、全て記録時から変わっていなければならない。
+    /// </summary>
+    [[nodiscard]]
+    bool has_result(std::uint64_t key, const std::filesystem::path& output) const
+    {
+        std::ifstream in(path_of("run_", key, ".txt"));
+        std::uintmax_t size = 0;
+        std::int64_t mtime = 0;
+        std::string name;
+        std::size_t files = 0;
+        std::error_code ec;
+        // 1行目がoutput、続く行がoutputから参照される部分のファイル
+        while (in >> size >> mtime && std::getline(in >> std::ws, name)) {
+            if (files++ == 0 && name != std::filesystem::absolute(output, ec).string()) return false;
+            auto actual = std::filesystem::file_size(name, ec);
+            if (ec || actual != size || file_stamp(name) != mtime) return false;
+        }
+        return files > 0;
+    }
+    /// <summary>
+    /// keyの実行結果としてoutputを記録する。partsにはoutputが参照する部分のファイル(lodやpartitionのタイル)を渡す。
+    /// </summary>
+    ouchi::result::result<std::monostate, std::string>
+    store_result(std::uint64_t key,
+                 const std::filesystem::path& output,
+                 const std::vector<std::filesystem::path>& parts = {}) const
+    {
+        using namespace std::string_literals;
+        std::string record;
+        std::error_code ec;
+        auto add = [&record, &ec](const std::filesystem::path& file) {
+            auto size = std::filesystem::file_size(file, ec);
+            if (ec) return false;
+            record += std::to_string(size) + ' ' + std::to_string(file_stamp(file)) + ' ' +
+                      std::filesystem::absolute(file, ec).string() + '\n';
+            return true;
+        };
+        if (!add(output)) return ouchi::result::err(ec.message());
+        for (auto& part : parts) {
+            if (!add(part)) return ouchi::result::err(ec.message());
+        }
+        std::ofstream out(path_of("run_", key, ".txt"));
+        if (!(out << record)) return ouchi::result::err("cannot write cache in "s + dir_.string());
+        return ouchi::result::ok(std::monostate{});
+    }
+
+private:
+    std::filesystem::path path_of(const char* prefix, std::uint64_t key, const char* ext) const
+    {
+        char hex[17] = {};
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+        return dir_ / (std::string(prefix) + hex + ext);
+    }
+};
+
+/// <summary>
+/// 範囲がboundsのタイルのうち、<see cref="patch_grid"/>のパッチcellの正方形からmargin以内にかかるものの番号を返す。
+/// パッチの結果はこれらのタイルの点だけで決まる。
+/// </summary>
+[[nodiscard]]
+inline std::vector<std::size_t> patch_tiles(const patch_grid& grid, unsigned cell, const std::vector<tile_entry>& bounds)
+{
+    std::vector<std::size_t> ret;
+    for (std::size_t i = 0; i < bounds.size(); ++i) {
+        const auto& b = bounds[i];
+        if (b.count && grid.intersects(cell, b.min.x(), b.min.y(), b.max.x(), b.max.y())) ret.push_back(i);
+    }
+    return ret;
+}
+
+/// <summary>
+/// パッチcellのキャッシュのキー。optionsは出力に影響するオプションと読み込み条件のハッシュ、
+/// tilesは<see cref="patch_tiles"/>で求めたタイルの番号、hashesはタイルごとの内容のハッシュである。
+/// 内容が変わったタイルは、そのタイルにかかるパッチと、のりしろがかかる隣のパッチのキーだけを変える。
+/// </summary>
+[[nodiscard]]
+inline std::uint64_t patch_key(std::uint64_t options,
+                               const patch_grid& grid,
+                               unsigned cell,
+                               const std::vector<std::size_t>& tiles,
+                               const std::vector<std::uint64_t>& hashes)
+{
+    // タイルを列挙する順によらないよう、ハッシュを並べ替えてから加える
+    std::vector<std::uint64_t> sorted;
+    sorted.reserve(tiles.size());
+    for (auto t : tiles) sorted.push_back(hashes[t]);
+    std::sort(sorted.begin(), sorted.end());
+    auto h = fnv1a(grid.to_string() + '/' + std::to_string(cell), options);
+    for (auto c : sorted) h = fnv1a(c, h);
+    return h;
+}
+
+/// <summary>
+/// デーモンモードでジョブをまたいでメモリ上に保持するタイルの点集合。
+/// 合計の大きさが予算を超えると、最も長く使われていないタイルから捨てる。
+/// ファイルの大きさか更新時刻が変わったタイルは無効とみなす。
+/// </summary>
+class resident_tiles {
+public:
+    struct tile {
+        std::uint64_t content_hash = 0;
+        // 読み込み時に捨てた誤差点の数
+        std::size_t errors = 0;
+        std::vector<vertex<>> points;
+    };
+
+    explicit resident_tiles(std::size_t budget_bytes) noexcept
+        : budget_{ budget_bytes }
+    {}
+
+    /// <summary>
+    /// fileをroi_hashの条件で読み込んだ結果を返す。なければnullptrを返す。
+    /// 戻り値は次に<see cref="insert"/>を呼ぶまで有効である。
+    /// </summary>
+    const tile* find(const std::filesystem::path& file, std::uint64_t roi_hash)
+    {
+        auto it = map_.find(key_of(file, roi_hash));
+        if (it == map_.end()) return nullptr;
+        auto e = it->second;
+        std::error_code ec;
+        if (std::filesystem::file_size(file, ec) != e->size || ec || file_stamp(file) != e->mtime) {
+            erase(it);
+            return nullptr;
+        }
+        lru_.splice(lru_.begin(), lru_, e);
+        return &e->value;
+    }
+    void insert(const std::filesystem::path& file, std::uint64_t roi_hash, tile t)
+    {
+        auto key = key_of(file, roi_hash);
+        if (auto it = map_.find(key); it != map_.end()) erase(it);
+        const auto bytes = bytes_of(t);
+        // 1つで予算を超えるタイルは保持しない
+        if (bytes > budget_) return;
+        std::error_code ec;
+        auto size = std::filesystem::file_size(file, ec);
+        lru_.push_front({ key, size, file_stamp(file), std::move(t) });
+        map_.emplace(std::move(key), lru_.begin());
+        bytes_ += bytes;
+        while (bytes_ > budget_) erase(map_.find(lru_.back().key));
+    }
+
+    [[nodiscard]]
+    std::size_t size() const noexcept { return lru_.size(); }
+    [[nodiscard]]
+    std::size_t bytes() const noexcept { return bytes_; }
+    [[nodiscard]]
+    std::size_t budget() const noexcept { return budget_; }
+
+private:
+    struct entry {
+        std::string key;
+        std::uintmax_t size;
+        std::int64_t mtime;
+        tile value;
+    };
+    std::size_t budget_;
+    std::size_t bytes_ = 0;
+    // 先頭が最も最近使われたタイル
+    std::list<entry> lru_;
+    using map_type = std::unordered_map<std::string, std::list<entry>::iterator>;
+    map_type map_;
+
+    static std::string key_of(const std::filesystem::path& file, std::uint64_t roi_hash)
+    {
+        std::error_code ec;
+        auto key = std::filesystem::absolute(file, ec).string();
+        key += '\0';
+        key.append(reinterpret_cast<const char*>(&roi_hash), sizeof(roi_hash));
+        return key;
+    }
+    static std::size_t bytes_of(const tile& t) noexcept
+    {
+        return t.points.capacity() * sizeof(vertex<>) + sizeof(entry);
+    }
+    void erase(map_type::iterator it)
+    {
+        bytes_ -= bytes_of(it->second->value);
+        lru_.erase(it->second);
+        map_.erase(it);
+    }
+};
+
+}
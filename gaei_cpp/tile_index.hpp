@@ -0,0 +1,233 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <limits>
+#include <locale>
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <system_error>
+#include <variant>
+#include "vertex.hpp"
+#include "ouchilib/result/result.hpp"
+
+namespace gaei {
+
+/// <summary>
+/// 処理対象とする水平領域。矩形と多角形の両方が指定されたときは両方に含まれる点を対象とする。
+/// 座標は.datファイルのx, yと同じ系で表す。
+/// </summary>
+struct region {
+    vec2f min = { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+    vec2f max = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    std::vector<vec2f> polygon;
+
+    [[nodiscard]]
+    bool unbounded() const noexcept
+    {
+        return polygon.empty()
+            && min.x() == std::numeric_limits<double>::lowest() && min.y() == std::numeric_limits<double>::lowest()
+            && max.x() == std::numeric_limits<double>::max() && max.y() == std::numeric_limits<double>::max();
+    }
+    [[nodiscard]]
+    bool contains(double x, double y) const noexcept
+    {
+        if (x < min.x() || max.x() < x || y < min.y() || max.y() < y) return false;
+        if (polygon.empty()) return true;
+        // 偶奇規則による内外判定
+        bool in = false;
+        for (std::size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+            auto& a = polygon[i];
+            auto& b = polygon[j];
+            if ((a.y() > y) != (b.y() > y) &&
+                x < (b.x() - a.x()) * (y - a.y()) / (b.y() - a.y()) + a.x())
+                in = !in;
+        }
+        return in;
+    }
+    /// <summary>
+    /// 矩形[mn, mx]とこの領域のバウンディングボックスが重なるならtrue。
+    /// </summary>
+    [[nodiscard]]
+    bool intersects(const vec2f& mn, const vec2f& mx) const noexcept
+    {
+        return !(mx.x() < min.x() || max.x() < mn.x() || mx.y() < min.y() || max.y() < mn.y());
+    }
+
+    /// <summary>
+    /// "minx,miny,maxx,maxy"形式の文字列から矩形を設定する。
+    /// </summary>
+    ouchi::result::result<std::monostate, std::string>
+    set_bbox(std::string_view s)
+    {
+        using namespace std::string_literals;
+        auto v = parse_list(s);
+        if (v.size() != 4) return ouchi::result::err("bbox must be minx,miny,maxx,maxy: "s + std::string(s));
+        min = { std::max(min.x(), std::min(v[0], v[2])), std::max(min.y(), std::min(v[1], v[3])) };
+        max = { std::min(max.x(), std::max(v[0], v[2])), std::min(max.y(), std::max(v[1], v[3])) };
+        return ouchi::result::ok(std::monostate{});
+    }
+    /// <summary>
+    /// "x1,y1,x2,y2,..."形式の文字列から多角形を設定する。矩形は多角形のバウンディングボックスに狭められる。
+    /// </summary>
+    ouchi::result::result<std::monostate, std::string>
+    set_polygon(std::string_view s)
+    {
+        using namespace std::string_literals;
+        auto v = parse_list(s);
+        if (v.size() < 6 || v.size() % 2) return ouchi::result::err("polygon must be x1,y1,x2,y2,x3,y3,...: "s + std::string(s));
+        polygon.clear();
+        vec2f pmin = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+        vec2f pmax = { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+        for (std::size_t i = 0; i < v.size(); i += 2) {
+            polygon.push_back({ v[i], v[i + 1] });
+            pmin = { std::min(pmin.x(), v[i]), std::min(pmin.y(), v[i + 1]) };
+            pmax = { std::max(pmax.x(), v[i]), std::max(pmax.y(), v[i + 1]) };
+        }
+        min = { std::max(min.x(), pmin.x()), std::max(min.y(), pmin.y()) };
+        max = { std::min(max.x(), pmax.x()), std::min(max.y(), pmax.y()) };
+        return ouchi::result::ok(std::monostate{});
+    }
+
+private:
+    // 解釈できない要素があれば空のvectorを返す
+    static std::vector<double> parse_list(std::string_view s)
+    {
+        std::vector<double> ret;
+        while (s.size()) {
+            auto p = s.find(',');
+            auto token = s.substr(0, p);
+            while (token.size() && token.front() == ' ') token.remove_prefix(1);
+            while (token.size() && token.back() == ' ') token.remove_suffix(1);
+            double d;
+            auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), d);
+            if (ec != std::errc{} || ptr != token.data() + token.size()) return {};
+            ret.push_back(d);
+            if (p == std::string_view::npos) break;
+            s.remove_prefix(p + 1);
+        }
+        return ret;
+    }
+};
+
+/// <summary>
+/// ファイルの更新時刻。内容が変わったかどうかの判定にだけ使う。取得できなければ0を返す。
+/// </summary>
+inline std::int64_t file_stamp(const std::filesystem::path& file)
+{
+    std::error_code ec;
+    auto t = std::filesystem::last_write_time(file, ec);
+    if (ec) return 0;
+    return static_cast<std::int64_t>(t.time_since_epoch().count());
+}
+
+/// <summary>
+/// 1つの.datファイルの範囲。
+/// </summary>
+struct tile_entry {
+    std::uintmax_t size = 0;
+    std::int64_t mtime = 0;
+    vec2f min = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    vec2f max = { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+    std::size_t count = 0;
+
+    void add(double x, double y) noexcept
+    {
+        min = { std::min(min.x(), x), std::min(min.y(), y) };
+        max = { std::max(max.x(), x), std::max(max.y(), y) };
+        ++count;
+    }
+};
+
+/// <summary>
+/// ディレクトリ内の.datファイルごとの範囲を記録した索引。データと同じディレクトリに保存される。
+/// 領域が指定されたとき、範囲が重ならないファイルは開かずに済む。
+/// ファイルの大きさか更新時刻が索引と異なる場合、その項目は無効とみなす。
+/// </summary>
+class tile_index {
+    std::map<std::string, tile_entry> entries_;
+    bool dirty_ = false;
+public:
+    static constexpr const char* file_name = "gaei_tile_index.txt";
+    static constexpr std::string_view header = "#gaei tile index v1";
+
+    /// <summary>
+    /// dirにある索引を読み込む。索引がないか壊れている場合は空の索引を返す。
+    /// </summary>
+    static tile_index load(const std::filesystem::path& dir)
+    {
+        tile_index ret;
+        std::ifstream in(dir / file_name);
+        std::string line;
+        if (!in || !std::getline(in, line) || line != header) return ret;
+        while (std::getline(in, line)) {
+            std::istringstream ls(line);
+            ls.imbue(std::locale::classic());
+            tile_entry e;
+            double mnx, mny, mxx, mxy;
+            std::string name;
+            if (!(ls >> e.size >> e.mtime >> mnx >> mny >> mxx >> mxy >> e.count)) continue;
+            ls.get();
+            if (!std::getline(ls, name) || name.empty()) continue;
+            e.min = { mnx, mny };
+            e.max = { mxx, mxy };
+            ret.entries_.insert_or_assign(std::move(name), e);
+        }
+        return ret;
+    }
+
+    ouchi::result::result<std::monostate, std::string>
+    save(const std::filesystem::path& dir) const
+    {
+        using namespace std::string_literals;
+        std::ofstream out(dir / file_name);
+        if (!out) return ouchi::result::err("cannot write tile index in "s + dir.string());
+        out.imbue(std::locale::classic());
+        out.precision(17);
+        out << header << '\n';
+        for (auto& [name, e] : entries_) {
+            out << e.size << ' ' << e.mtime << ' '
+                << e.min.x() << ' ' << e.min.y() << ' ' << e.max.x() << ' ' << e.max.y() << ' '
+                << e.count << ' ' << name << '\n';
+        }
+        if (!out) return ouchi::result::err("cannot write tile index in "s + dir.string());
+        return ouchi::result::ok(std::monostate{});
+    }
+
+    /// <summary>
+    /// fileの項目が現在のファイルと一致すればその項目を、そうでなければnullptrを返す。
+    /// </summary>
+    [[nodiscard]]
+    const tile_entry* find(const std::filesystem::path& file) const
+    {
+        auto it = entries_.find(file.filename().string());
+        if (it == entries_.end()) return nullptr;
+        std::error_code ec;
+        auto size = std::filesystem::file_size(file, ec);
+        if (ec || size != it->second.size || file_stamp(file) != it->second.mtime) return nullptr;
+        return &it->second;
+    }
+    /// <summary>
+    /// fileの項目を置き換える。大きさと更新時刻は現在のファイルから取得する。
+    /// </summary>
+    void update(const std::filesystem::path& file, tile_entry e)
+    {
+        std::error_code ec;
+        e.size = std::filesystem::file_size(file, ec);
+        e.mtime = file_stamp(file);
+        entries_.insert_or_assign(file.filename().string(), e);
+        dirty_ = true;
+    }
+    [[nodiscard]]
+    bool dirty() const noexcept { return dirty_; }
+    [[nodiscard]]
+    std::size_t size() const noexcept { return entries_.size(); }
+
+};
+
+}
@@ -0,0 +1,260 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <ostream>
+#include <sstream>
+#include <locale>
+
+namespace gaei {
+
+/// <summary>
+/// 文字列をJSONの文字列リテラルとして書き込む。
+/// </summary>
+inline void write_json_string(std::ostream& out, std::string_view s)
+{
+    out.put('"');
+    for (char c : s) {
+        switch (c) {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\r': out << "\\r"; break;
+        case '\t': out << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                out << buf;
+            }
+            else out.put(c);
+        }
+    }
+    out.put('"');
+}
+
+/// <summary>
+/// Chrome trace-event形式のタイムラインを記録する。
+/// スレッドごとに固定長のリングバッファを持ち、古いイベントから上書きする。
+/// 無効なときの<see cref="trace_scope"/>のコストはatomic変数の読み込み1回だけである。
+/// </summary>
+class trace_recorder {
+public:
+    using clock = std::chrono::steady_clock;
+    static constexpr std::size_t name_length = 48;
+    static constexpr std::size_t detail_length = 96;
+
+    struct event {
+        char name[name_length];
+        char detail[detail_length];
+        std::int64_t begin_ns;
+        std::int64_t duration_ns;
+    };
+
+    [[nodiscard]]
+    static trace_recorder& instance() noexcept
+    {
+        static trace_recorder rec;
+        return rec;
+    }
+
+    /// <summary>
+    /// 記録を開始する。capacityはスレッドごとに保持するイベントの最大数。
+    /// </summary>
+    void enable(std::size_t capacity = 1 << 14)
+    {
+        std::lock_guard lk(mtx_);
+        capacity_ = capacity ? capacity : 1;
+        origin_ = clock::now();
+        for (auto& b : buffers_) b->reset(capacity_);
+        enabled_.store(true, std::memory_order_release);
+    }
+    void disable() noexcept { enabled_.store(false, std::memory_order_release); }
+    [[nodiscard]]
+    bool enabled() const noexcept { return enabled_.load(std::memory_order_acquire); }
+
+    /// <summary>
+    /// 呼び出したスレッドにタイムライン上で表示する名前をつける。
+    /// </summary>
+    void name_thread(std::string_view name)
+    {
+        auto& b = local_buffer();
+        std::lock_guard lk(b.mtx);
+        copy(b.thread_name, name);
+    }
+
+    void record(std::string_view name, std::string_view detail,
+                clock::time_point begin, clock::time_point end)
+    {
+        auto& b = local_buffer();
+        std::lock_guard lk(b.mtx);
+        if (b.ring.empty()) return;
+        auto& e = b.ring[b.head];
+        copy(e.name, name);
+        copy(e.detail, detail);
+        e.begin_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - origin_).count();
+        e.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        b.head = (b.head + 1) % b.ring.size();
+        if (b.count < b.ring.size()) ++b.count;
+        else ++b.dropped;
+    }
+
+    /// <summary>
+    /// リングバッファからあふれて失われたイベントの数を返す。
+    /// </summary>
+    [[nodiscard]]
+    std::size_t dropped() const
+    {
+        std::lock_guard lk(mtx_);
+        std::size_t d = 0;
+        for (auto& b : buffers_) {
+            std::lock_guard blk(b->mtx);
+            d += b->dropped;
+        }
+        return d;
+    }
+
+    /// <summary>
+    /// 記録したイベントをChrome trace-event形式のJSONとして書き込む。
+    /// chrome://tracing や ui.perfetto.dev で開くことができる。
+    /// </summary>
+    void write_json(std::ostream& out) const
+    {
+        std::ostringstream s;
+        s.imbue(std::locale::classic());
+        s.setf(std::ios::fixed);
+        s.precision(3);
+        s << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        auto sep = [&s, &first] { if (!first) s << ",\n"; first = false; };
+        std::lock_guard lk(mtx_);
+        for (auto& b : buffers_) {
+            std::lock_guard blk(b->mtx);
+            sep();
+            s << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << b->tid
+              << ",\"args\":{\"name\":";
+            write_json_string(s, b->thread_name);
+            s << "}}";
+            const auto n = b->ring.size();
+            for (auto i = 0u; i < b->count; ++i) {
+                auto& e = b->ring[(b->head + n - b->count + i) % n];
+                sep();
+                s << "{\"ph\":\"X\",\"cat\":\"gaei\",\"pid\":1,\"tid\":" << b->tid
+                  << ",\"ts\":" << e.begin_ns / 1000.0
+                  << ",\"dur\":" << e.duration_ns / 1000.0
+                  << ",\"name\":";
+                write_json_string(s, e.name);
+                if (*e.detail) {
+                    s << ",\"args\":{\"detail\":";
+                    write_json_string(s, e.detail);
+                    s << '}';
+                }
+                s << '}';
+            }
+        }
+        s << "]}\n";
+        out << s.str();
+    }
+
+private:
+    struct buffer {
+        std::vector<event> ring;
+        std::size_t head = 0;
+        std::size_t count = 0;
+        std::size_t dropped = 0;
+        std::uint32_t tid = 0;
+        char thread_name[name_length] = {};
+        mutable std::mutex mtx;
+
+        void reset(std::size_t capacity)
+        {
+            std::lock_guard lk(mtx);
+            ring.assign(capacity, event{});
+            head = count = dropped = 0;
+        }
+    };
+
+    std::atomic<bool> enabled_{ false };
+    std::size_t capacity_ = 1 << 14;
+    clock::time_point origin_ = clock::now();
+    // スレッドが終了してもイベントを書き出せるよう、バッファはレコーダーが所有する
+    std::vector<std::unique_ptr<buffer>> buffers_;
+    mutable std::mutex mtx_;
+
+    trace_recorder() = default;
+
+    buffer& local_buffer()
+    {
+        thread_local buffer* tls = nullptr;
+        if (tls) return *tls;
+        std::lock_guard lk(mtx_);
+        auto b = std::make_unique<buffer>();
+        b->tid = static_cast<std::uint32_t>(buffers_.size() + 1);
+        copy(b->thread_name, b->tid == 1 ? "main" : "worker");
+        b->ring.assign(capacity_, event{});
+        tls = b.get();
+        buffers_.push_back(std::move(b));
+        return *tls;
+    }
+
+    template<std::size_t N>
+    static void copy(char (&dest)[N], std::string_view src) noexcept
+    {
+        auto n = std::min(src.size(), N - 1);
+        std::memcpy(dest, src.data(), n);
+        dest[n] = 0;
+    }
+};
+
+/// <summary>
+/// スコープの間を1つのイベントとして<see cref="trace_recorder"/>に記録する。
+/// </summary>
+/// <remarks>
+/// nameとdetailの参照先はスコープを抜けるまで有効でなければならない。
+/// 一時オブジェクトのstd::stringをdetailに渡したときはスコープが所有する。
+/// </remarks>
+class trace_scope {
+public:
+    explicit trace_scope(std::string_view name, std::string_view detail = {}) noexcept
+        : enabled_{ trace_recorder::instance().enabled() }
+    {
+        if (!enabled_) return;
+        name_ = name;
+        detail_ = detail;
+        begin_ = trace_recorder::clock::now();
+    }
+    template<class String, std::enable_if_t<std::is_same_v<String, std::string>, int> = 0>
+    trace_scope(std::string_view name, String&& detail) noexcept
+        : trace_scope(name)
+    {
+        if (!enabled_) return;
+        owned_ = std::move(detail);
+        detail_ = owned_;
+    }
+    ~trace_scope()
+    {
+        if (!enabled_) return;
+        trace_recorder::instance().record(name_, detail_, begin_, trace_recorder::clock::now());
+    }
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+private:
+    bool enabled_;
+    std::string_view name_;
+    std::string_view detail_;
+    std::string owned_;
+    trace_recorder::clock::time_point begin_;
+};
+
+}
@@ -0,0 +1,138 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include "vertex.hpp"
+#include "parallel.hpp"
+#include "radix_sort.hpp"
+#include "predicates.hpp"
+
+namespace gaei {
+
+using triangle = std::array<std::size_t, 3>;
+
+/// <summary>
+/// 頂点ごとに接する三角形の一覧(CSR)。頂点vに接する三角形の番号はtriangles[offset[v]]からtriangles[offset[v + 1]]の手前までに、番号の順で並ぶ。
+/// </summary>
+struct vertex_adjacency {
+    std::vector<std::size_t> offset;
+    std::vector<std::size_t> triangles;
+
+    vertex_adjacency(const std::vector<triangle>& ts, std::size_t vertex_count)
+        : offset(vertex_count + 1, 0)
+    {
+        for (auto& t : ts) {
+            for (auto v : t) ++offset[v + 1];
+        }
+        for (std::size_t v = 0; v < vertex_count; ++v) offset[v + 1] += offset[v];
+        triangles.resize(offset.back());
+        auto pos = offset;
+        for (std::size_t i = 0; i < ts.size(); ++i) {
+            for (auto v : ts[i]) triangles[pos[v]++] = i;
+        }
+    }
+    [[nodiscard]]
+    std::size_t degree(std::size_t v) const noexcept { return offset[v + 1] - offset[v]; }
+};
+
+/// <summary>
+/// 三角形の後処理で取り除いた、または見つけた三角形の数。
+/// </summary>
+struct triangle_postprocess_result {
+    std::size_t input = 0;
+    // 頂点の順序が違うだけのものを含む重複
+    std::size_t duplicates = 0;
+    // 同じ頂点を2回以上含む三角形
+    std::size_t repeated_index = 0;
+    // 面積が0の三角形。向きが決まらないのでそのまま残す
+    std::size_t zero_area = 0;
+    // 向きを反転した三角形
+    std::size_t flipped = 0;
+};
+
+/// <summary>
+/// 各三角形の頂点番号を昇順に並べ替える。向きは失われるので後で<see cref="fix_triangle_orientation"/>で決め直す。
+/// </summary>
+inline void canonicalize_triangles(std::vector<triangle>& ts)
+{
+    parallel_for(ts.size(), [&ts](std::size_t b, std::size_t e) {
+        for (auto i = b; i < e; ++i) {
+            auto& t = ts[i];
+            if (t[0] > t[1]) std::swap(t[0], t[1]);
+            if (t[1] > t[2]) std::swap(t[1], t[2]);
+            if (t[0] > t[1]) std::swap(t[0], t[1]);
+        }
+    });
+}
+
+/// <summary>
+/// 頂点番号を正規化した三角形を基数ソートし、重複と同じ頂点を含む三角形を取り除く。
+/// vertex_countは頂点の数で、ソートの桁数を決める。結果は頂点番号の辞書順に並ぶ。
+/// </summary>
+inline void remove_duplicate_triangles(std::vector<triangle>& ts,
+                                       std::size_t vertex_count,
+                                       triangle_postprocess_result& res)
+{
+    canonicalize_triangles(ts);
+    unsigned bytes = 1;
+    while (bytes < sizeof(std::size_t) && (vertex_count >> (bytes * 8))) ++bytes;
+    // 最下位の桁はt[2]の最下位バイト、最上位の桁はt[0]の最上位バイト
+    radix_sort(ts, 3 * bytes, [bytes](const triangle& t, unsigned pass) {
+        return static_cast<std::uint8_t>(t[2 - pass / bytes] >> (pass % bytes * 8));
+    });
+    const auto before = ts.size();
+    ts.erase(std::remove_if(ts.begin(), ts.end(),
+                            [](const triangle& t) { return t[0] == t[1] || t[1] == t[2]; }),
+             ts.end());
+    res.repeated_index += before - ts.size();
+    const auto unique = ts.size();
+    ts.erase(std::unique(ts.begin(), ts.end()), ts.end());
+    res.duplicates += unique - ts.size();
+}
+
+/// <summary>
+/// xy平面に投影した三角形が反時計回りになるよう向きを揃える。
+/// 向きの判定は<see cref="orient2d"/>で行うので、面積が0かどうかも正確に判定される。区間ごとに並列に処理する。
+/// </summary>
+template<class V>
+void fix_triangle_orientation(const std::vector<V>& vs,
+                              std::vector<triangle>& ts,
+                              triangle_postprocess_result& res)
+{
+    std::atomic<std::size_t> flipped{ 0 }, zero{ 0 };
+    parallel_for(ts.size(), [&](std::size_t b, std::size_t e) {
+        std::size_t f = 0, z = 0;
+        for (auto i = b; i < e; ++i) {
+            auto& t = ts[i];
+            const double det = orient2d(vs[t[0]].position, vs[t[1]].position, vs[t[2]].position);
+            const bool neg = det < 0;
+            const auto t0 = t[0], t2 = t[2];
+            t[0] = neg ? t2 : t0;
+            t[2] = neg ? t0 : t2;
+            f += neg;
+            z += det == 0;
+        }
+        flipped += f;
+        zero += z;
+    });
+    res.flipped += flipped;
+    res.zero_area += zero;
+}
+
+/// <summary>
+/// 三角形分割の結果から重複と不正な三角形を取り除き、向きを揃える。
+/// </summary>
+template<class V>
+triangle_postprocess_result postprocess_triangles(const std::vector<V>& vs, std::vector<triangle>& ts)
+{
+    triangle_postprocess_result res;
+    res.input = ts.size();
+    remove_duplicate_triangles(ts, vs.size(), res);
+    fix_triangle_orientation(vs, ts, res);
+    return res;
+}
+
+}
@@ -2,6 +2,8 @@
 #include <cmath>
 #include <type_traits>
 #include "vertex.hpp"
+#include "predicates.hpp"
+#include "simd.hpp"
 
 namespace gaei {
 template<class T, size_t Dim>
@@ -69,19 +71,30 @@ struct point_traits<gaei::vector<T, Dim>> {
     static constexpr T& set(type& p, size_t d, const T& v) noexcept { return p.coord[d] = v; }
     static constexpr type add(const type& p1, const type& p2) noexcept { return p1 + p2; }
     static constexpr type sub(const type& p1, const type& p2) noexcept { return p1 - p2; }
-    static constexpr T inner_product(const type& p1, const type& p2) noexcept
+    // 三角形分割の内側のループで使われるので、SIMDの実装を使う
+    static T inner_product(const type& p1, const type& p2) noexcept
     {
-        return gaei::inner_product(p1, p2);
+        return gaei::simd::inner_product(p1, p2);
     }
     static type mul(const type& v, const T& scalar) noexcept { return v * scalar; }
     static constexpr type zero() noexcept { return type{}; }
-    static constexpr T sqdistance(const type& p1, const type& p2) noexcept
+    static T sqdistance(const type& p1, const type& p2) noexcept
     {
-        return gaei::sqdistance(p1, p2);
+        return gaei::simd::sqdistance(p1, p2);
     }
-    static constexpr T distance(const type& p1, const type& p2) noexcept
+    static T distance(const type& p1, const type& p2) noexcept
     {
-        return gaei::distance(p1, p2);
+        return static_cast<T>(std::sqrt(gaei::simd::sqdistance(p1, p2)));
+    }
+    // xy平面での向きと内接円の判定。符号は常に正しい
+    // 三角形分割はこれらを使わないので、格子上の点はnormalizeでずらしてから分割する
+    static double orient2d(const type& a, const type& b, const type& c) noexcept
+    {
+        return gaei::orient2d(a.x(), a.y(), b.x(), b.y(), c.x(), c.y());
+    }
+    static double incircle(const type& a, const type& b, const type& c, const type& d) noexcept
+    {
+        return gaei::incircle(a.x(), a.y(), b.x(), b.y(), c.x(), c.y(), d.x(), d.y());
     }
 };
 
@@ -96,19 +109,27 @@ struct point_traits<gaei::vertex<Pt, Col>> {
     static constexpr coord_type& set(type& p, size_t d, const coord_type& v) noexcept { return pt::set(p.position, d, v); }
     static constexpr type add(const type& p1, const type& p2) noexcept { return { pt::add(p1.position, p2.position), {} }; }
     static constexpr type sub(const type& p1, const type& p2) noexcept { return { pt::sub(p1.position, p2.position), {} }; }
-    static constexpr coord_type inner_product(const type& p1, const type& p2) noexcept
+    static coord_type inner_product(const type& p1, const type& p2) noexcept
     {
-        return gaei::inner_product(p1.position, p2.position);
+        return gaei::simd::inner_product(p1.position, p2.position);
     }
     static type mul(const type& v, const coord_type& scalar) noexcept { return { v.position * scalar, {} }; }
     static constexpr type zero() noexcept { return type{ {}, {} }; }
-    static constexpr coord_type sqdistance(const type& p1, const type& p2) noexcept
+    static coord_type sqdistance(const type& p1, const type& p2) noexcept
+    {
+        return gaei::simd::sqdistance(p1.position, p2.position);
+    }
+    static coord_type distance(const type& p1, const type& p2) noexcept
+    {
+        return static_cast<coord_type>(std::sqrt(gaei::simd::sqdistance(p1.position, p2.position)));
+    }
+    static double orient2d(const type& a, const type& b, const type& c) noexcept
     {
-        return gaei::sqdistance(p1.position, p2.position);
+        return pt::orient2d(a.position, b.position, c.position);
     }
-    static constexpr coord_type distance(const type& p1, const type& p2) noexcept
+    static double incircle(const type& a, const type& b, const type& c, const type& d) noexcept
     {
-        return gaei::distance(p1.position, p2.position);
+        return pt::incircle(a.position, b.position, c.position, d.position);
     }
 };
 
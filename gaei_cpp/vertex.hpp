@@ -3,7 +3,6 @@
 #include <type_traits>
 #include <algorithm>
 #include "color.hpp"
-#include "ouchilib/utl/multiitr.hpp"
 #include "ouchilib/geometry/point_traits.hpp"
 #include "meta.hpp"
 
@@ -78,9 +77,8 @@ struct vector<T, Dim, std::enable_if_t<(Dim > 0) && can_4_operation_v<T>, void>>
 
     friend constexpr vector operator-(const vector& v) noexcept
     {
-        vector r = v;
-        for (auto [d, s] : ouchi::multiitr{ r.coord, v.coord })
-            d = -s;
+        vector r{};
+        for (auto i = 0u; i < Dim; ++i) r.coord[i] = -v.coord[i];
         return r;
     }
 
@@ -106,15 +104,22 @@ struct vector<T, Dim, std::enable_if_t<(Dim > 0) && can_4_operation_v<T>, void>>
     [[nodiscard]]
     friend constexpr vector<T, std::max(Dim, D)> operator-(const vector& lhs, const vector<T, D>& rhs) noexcept
     {
-        return lhs + (-rhs);
+        // lhs + (-rhs)と同じ結果を、中間のベクトルを作らずに求める
+        vector<T, std::max(Dim, D)> r{};
+        for (auto i = 0u; i < std::max(Dim, D); ++i) {
+            if (i < Dim && i < D) r.coord[i] = lhs.coord[i] - rhs.coord[i];
+            else if (i < Dim) r.coord[i] = lhs.coord[i];
+            else r.coord[i] = -rhs.coord[i];
+        }
+        return r;
     }
     template<class U>
     [[nodiscard]]
     friend constexpr auto operator*(U num, const vector& rhs) noexcept
     {
         using nt = std::common_type_t<T, U>;
-        vector<nt, Dim> result;
-        for (auto [d, s] : ouchi::multiitr{result.coord, rhs.coord}) d = s * num;
+        vector<nt, Dim> result{};
+        for (auto i = 0u; i < Dim; ++i) result.coord[i] = rhs.coord[i] * num;
         return result;
     }
     template<class U>
@@ -128,8 +133,8 @@ struct vector<T, Dim, std::enable_if_t<(Dim > 0) && can_4_operation_v<T>, void>>
     friend constexpr auto operator/(const vector& rhs, U num) noexcept
     {
         using nt = std::common_type_t<T, U>;
-        vector<nt, Dim> result;
-        for (auto [d, s] : ouchi::multiitr{result.coord, rhs.coord}) d = s / num;
+        vector<nt, Dim> result{};
+        for (auto i = 0u; i < Dim; ++i) result.coord[i] = rhs.coord[i] / num;
         return result;
     }
 
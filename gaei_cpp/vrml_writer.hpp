@@ -1,7 +1,10 @@
 ﻿#pragma once
 #include <iostream>
+#include <cmath>
 #include <vector>
+#include <array>
 #include <list>
+#include <memory_resource>
 #include <fstream>
 #include <memory>
 #include <filesystem>
@@ -11,6 +14,7 @@
 #include "color.hpp"
 #include "vertex.hpp"
 #include "meta.hpp"
+#include "stage_report.hpp"
 
 #include "ouchilib/result/result.hpp"
 
@@ -30,7 +34,7 @@ bool write_if_different(const T& default_value,
     return true;
 }
 
-std::string stream_error_message(const std::ios_base& s)
+inline std::string stream_error_message(const std::ios_base& s)
 {
     using namespace std::string_literals;
     return s.good() ? ""
@@ -39,7 +43,7 @@ std::string stream_error_message(const std::ios_base& s)
         : "associated input sequence has reached end-of-file";
 }
 
-ouchi::result::result<std::monostate, std::string> streamtoresult(const std::ios_base& s)
+inline ouchi::result::result<std::monostate, std::string> streamtoresult(const std::ios_base& s)
 {
     using namespace std::string_literals;
     using namespace ouchi::result;
@@ -59,8 +63,11 @@ struct node_base {
 };
 
 class vrml_writer {
-    std::list<std::unique_ptr<node_base>> nodes_;
+    std::pmr::list<std::unique_ptr<node_base>> nodes_;
 public:
+    explicit vrml_writer(std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+        : nodes_{ mr }
+    {}
 
     template<class Node, std::enable_if_t<std::is_base_of_v<node_base, remove_cvref_t<Node>>, int> = 0>
     void push(Node&& node)
@@ -134,6 +141,10 @@ class shape : public shape_base {
 public:
     virtual ~shape() = default;
     shape() = default;
+    explicit shape(Geometry geometry, Appearance appearance = Appearance{})
+        : geometry_{ std::move(geometry) }
+        , appearance_{ std::move(appearance) }
+    {}
 
     Geometry& geometry() noexcept { return geometry_; }
     const Geometry& geometry() const noexcept { return geometry_; }
@@ -241,26 +252,47 @@ struct appearance {
 struct indexed_face_set {
     std::vector<gaei::vertex<>> coord_;
     std::vector<long> coord_index_;
+    // 頂点ごとの単位法線。空ならNormalノードを書き込まず、法線の計算はビューアに任せる
+    std::vector<vec3f> normal_;
+    // 法線の各成分を丸める小数点以下の桁数
+    unsigned normal_digits = 3;
+    // 座標と法線を書き込む成分の順序。{1, 2, 0}ならば(y, z, x)の順に書き込む
+    std::array<unsigned, 3> axis_order = { 0, 1, 2 };
     bool ccw = true;
     bool convex = false;
     bool solid = false;
+
+    indexed_face_set() = default;
+    /// <summary>
+    /// 頂点、面、法線の配列を複製せずに受け取る。
+    /// </summary>
+    indexed_face_set(std::vector<gaei::vertex<>> coord,
+                     std::vector<long> coord_index,
+                     std::vector<vec3f> normal = {}) noexcept
+        : coord_{ std::move(coord) }
+        , coord_index_{ std::move(coord_index) }
+        , normal_{ std::move(normal) }
+    {}
 public:
     ouchi::result::result<std::monostate, std::string>
     write(std::ostream& out) const
     {
+        // 全体を1つの文字列にせず、flush_size毎に書き出す
         std::string buffer;
         ouchi::result::result<std::monostate, std::string> success = ouchi::result::ok{ std::monostate{} };
-        buffer.reserve(coord_.size() * 128);
+        buffer.reserve(flush_size + 256);
         buffer.append("geometry IndexedFaceSet{\n");
         buffer.append("\nccw "); buffer.append(ccw ? "TRUE" : "FALSE");
         buffer.append("\nconvex ");buffer.append(convex ? "TRUE" : "FALSE");
         buffer.append("\nsolid ");buffer.append(solid ? "TRUE" : "FALSE");
         buffer.append("\n");
-        auto [s, write] = write_coord(buffer);
+        auto [s, write] = write_coord(buffer, out);
         success = success && s;
-        success = success && write_color(buffer, write);
+        success = success && write_color(buffer, out, write);
+        success = success && write_normal(buffer, out);
         //coord_index add later
         buffer.append("}\n");
+        scoped_stage st("ifs_flush", coord_.size());
         out.write(buffer.data(), buffer.size());
         return success
             ? ouchi::result::result<std::monostate, std::string>{ouchi::result::ok{ std::monostate{} }}
@@ -269,37 +301,75 @@ public:
     auto& data() noexcept { return coord_; }
     const auto& data() const noexcept { return coord_; }
 private:
+    static constexpr std::size_t flush_size = std::size_t{ 1 } << 20;
+
+    static void flush_if_full(std::string& out, std::ostream& stream)
+    {
+        if (out.size() < flush_size) return;
+        stream.write(out.data(), out.size());
+        out.clear();
+    }
+    vec3f permute(const vec3f& v) const noexcept
+    {
+        return { v.coord[axis_order[0]], v.coord[axis_order[1]], v.coord[axis_order[2]] };
+    }
     ouchi::result::result<std::monostate, std::string>
-    write_color(std::string& out, bool write) const
+    write_color(std::string& out, std::ostream& stream, bool write) const
     {
         if (!write) return ouchi::result::ok{ std::monostate{} };
+        scoped_stage st("ifs_color", coord_.size());
         out.append("color Color{color[");
         for (auto&& v : coord_) {
             if (auto r = to_vrml(v.color, out); !r) return ouchi::result::err{std::make_error_code(r.unwrap_err()).message()};
             out.push_back('\n');
+            flush_if_full(out, stream);
+        }
+        out.append("]}");
+        return ouchi::result::ok{ std::monostate{} };
+    }
+    ouchi::result::result<std::monostate, std::string>
+    write_normal(std::string& out, std::ostream& stream) const
+    {
+        if (normal_.empty()) return ouchi::result::ok{ std::monostate{} };
+        scoped_stage st("ifs_normal", normal_.size());
+        // 丸めた値を最短の表現で書き込むので、多くの成分は数文字に収まる
+        const double scale = std::pow(10.0, normal_digits);
+        out.append("\nnormal Normal{vector[");
+        for (auto&& n : normal_) {
+            auto q = permute(n);
+            for (auto i = 0u; i < 3; ++i) q.coord[i] = std::round(q.coord[i] * scale) / scale + 0.0;
+            if (auto r = to_vrml(q, out); !r) return ouchi::result::err{std::make_error_code(r.unwrap_err()).message()};
+            out.push_back('\n');
+            flush_if_full(out, stream);
         }
         out.append("]}");
         return ouchi::result::ok{ std::monostate{} };
     }
     [[nodiscard]]
-    std::tuple<ouchi::result::result<std::monostate, std::string>, bool> write_coord(std::string& out) const
+    std::tuple<ouchi::result::result<std::monostate, std::string>, bool> write_coord(std::string& out, std::ostream& stream) const
     {
         bool is_color_none = false;
-        out.append("coord Coordinate{");
-        out.append("point[");
-        for (const auto& v : coord_) {
-            if (auto r = to_vrml(v.position, out); !r) return { ouchi::result::err{std::make_error_code(r.unwrap_err()).message()}, false };
-            out.push_back('\n');
-            is_color_none |= (bool)v.color;
+        {
+            scoped_stage st("ifs_coord", coord_.size());
+            out.append("coord Coordinate{");
+            out.append("point[");
+            for (const auto& v : coord_) {
+                if (auto r = to_vrml(permute(v.position), out); !r) return { ouchi::result::err{std::make_error_code(r.unwrap_err()).message()}, false };
+                out.push_back('\n');
+                is_color_none |= (bool)v.color;
+                flush_if_full(out, stream);
+            }
+            out.append("]\n");
+            out.append("}\n");
         }
-        out.append("]\n");
-        out.append("}\n");
+        scoped_stage st("ifs_coord_index", coord_index_.size());
         out.append("coordIndex [\n");
         for(auto&& idx : coord_index_){
             char buffer[16] = {};
             std::to_chars(buffer, buffer+16, idx);
             out.append(buffer);
             out.push_back(' ');
+            flush_if_full(out, stream);
         }
         out.append("]");
         return { ouchi::result::ok{ std::monostate{} }, is_color_none };
@@ -326,6 +396,11 @@ struct box {
 
 struct point_set {
     std::vector<gaei::vertex<>> points;
+
+    point_set() = default;
+    explicit point_set(std::vector<gaei::vertex<>> points) noexcept
+        : points{ std::move(points) }
+    {}
     ouchi::result::result<std::monostate, std::string>
     write(std::ostream& out) const
     {
@@ -371,8 +446,10 @@ private:
     }
 };
 
-struct [[deprecated("not safe because error handling is not satisfied. there is no substitute")]]
-    transform : public node_base
+/// <summary>
+/// 子ノードを移動、回転、拡大するTransformノード。bbox_sizeが負ならバウンディングボックスは子ノードから求められる。
+/// </summary>
+struct transform : public node_base
 {
     vec3f translation = { 0, 0, 0 };
     vector<float, 4> rotation = { 1, 0, 0, 0 };
@@ -411,14 +488,75 @@ struct [[deprecated("not safe because error handling is not satisfied. there is
             << bbox_size.x() << ' '
             << bbox_size.y() << ' '
             << bbox_size.z() << '\n';
-        out << "children [\n";
-        for (const auto& i : children) {
-            (void)(i->write(out));
+        auto r = detail::streamtoresult(out << "children [\n");
+        for (const auto& i : children) r = r && i->write(out);
+        return r && detail::streamtoresult(out << "]\n}\n");
+    }
+};
+
+/// <summary>
+/// 子ノードをまとめるGroupノード。
+/// </summary>
+struct group : public node_base {
+    std::list<std::unique_ptr<node_base>> children;
+
+    ouchi::result::result<std::monostate, std::string>
+    write(std::ostream& out) const override
+    {
+        auto r = detail::streamtoresult(out << "Group {\nchildren [\n");
+        for (const auto& i : children) r = r && i->write(out);
+        return r && detail::streamtoresult(out << "]\n}\n");
+    }
+};
+
+/// <summary>
+/// 別のファイルを参照するInlineノード。bbox_sizeが負ならバウンディングボックスを書き込まない。
+/// </summary>
+struct inline_node : public node_base {
+    std::string url;
+    vec3f bbox_center = { 0, 0, 0 };
+    vec3f bbox_size = { -1, -1, -1 };
+
+    ouchi::result::result<std::monostate, std::string>
+    write(std::ostream& out) const override
+    {
+        out << "Inline {\nurl \"" << url << "\"\n";
+        if (bbox_size.x() >= 0) {
+            out << "bboxCenter "
+                << bbox_center.x() << ' '
+                << bbox_center.y() << ' '
+                << bbox_center.z() << '\n';
+            out << "bboxSize "
+                << bbox_size.x() << ' '
+                << bbox_size.y() << ' '
+                << bbox_size.z() << '\n';
         }
-        out << "]\n}\n";
-        return out.good()
-            ? ouchi::result::result<std::monostate, std::string>{ouchi::result::ok{ std::monostate{} }}
-            : ouchi::result::result<std::monostate, std::string>{ ouchi::result::err{detail::stream_error_message(out)} };
+        return detail::streamtoresult(out << "}\n");
+    }
+};
+
+/// <summary>
+/// 視点からの距離で子ノードを切り替えるLODノード。
+/// levelは詳細なものから順に並べ、rangeはlevelより1つ少ない切り替え距離とする。
+/// </summary>
+struct lod : public node_base {
+    vec3f center = { 0, 0, 0 };
+    std::vector<float> range;
+    std::list<std::unique_ptr<node_base>> level;
+
+    ouchi::result::result<std::monostate, std::string>
+    write(std::ostream& out) const override
+    {
+        out << "LOD {\ncenter "
+            << center.x() << ' '
+            << center.y() << ' '
+            << center.z() << '\n';
+        out << "range [";
+        for (auto r : range) out << ' ' << r;
+        out << " ]\nlevel [\n";
+        auto r = detail::streamtoresult(out);
+        for (const auto& i : level) r = r && i->write(out);
+        return r && detail::streamtoresult(out << "]\n}\n");
     }
 };
 
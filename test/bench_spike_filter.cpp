@@ -0,0 +1,43 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "spike_filter.hpp"
+
+// 誤差点の除去の速度を測る。引数は点の数、繰り返しの回数、スレッド数(省略すればハードウェアのスレッド数)
+// 1m間隔の格子に並ぶ点に、0.1%の割合で高さ20mの誤差点を混ぜる
+int main(int argc, char** argv)
+{
+    const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : std::size_t{ 1 } << 24;
+    const int repeat = argc > 2 ? std::atoi(argv[2]) : 5;
+    if (argc > 3) gaei::thread_limit() = static_cast<unsigned>(std::atoi(argv[3]));
+    const auto side = static_cast<std::size_t>(std::sqrt(static_cast<double>(n)));
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> noise(0, 0.1);
+    std::bernoulli_distribution spike(0.001);
+    std::vector<gaei::vertex<>> points(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        points[i] = { { static_cast<double>(i % side), static_cast<double>(i / side), noise(rng) + (spike(rng) ? 20 : 0) }, gaei::colors::none };
+    }
+    std::printf("%zu points, %u threads\n", n, gaei::hardware_threads());
+    double grid_best = 0, spike_best = 0;
+    for (int r = 0; r < repeat; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        gaei::height_grid grid(points, 1.0);
+        auto t1 = std::chrono::steady_clock::now();
+        auto vs = points;
+        auto t2 = std::chrono::steady_clock::now();
+        const auto removed = gaei::remove_spikes(vs, 2.0);
+        auto t3 = std::chrono::steady_clock::now();
+        const auto g = n / std::chrono::duration<double>(t1 - t0).count();
+        const auto s = n / std::chrono::duration<double>(t3 - t2).count();
+        grid_best = std::max(grid_best, g);
+        spike_best = std::max(spike_best, s);
+        std::printf("height_grid %.1fM points/s, remove_spikes %.1fM points/s (%zu removed, %zux%zu cells)\n",
+                    g / 1e6, s / 1e6, removed, grid.width(), grid.height());
+    }
+    std::printf("best: height_grid %.1fM points/s, remove_spikes %.1fM points/s\n", grid_best / 1e6, spike_best / 1e6);
+}
@@ -0,0 +1,65 @@
+﻿#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ouchitest.hpp"
+#include "async_reader.hpp"
+
+namespace {
+
+std::vector<std::filesystem::path> make_files(const std::filesystem::path& dir, std::vector<std::string>& contents)
+{
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::vector<std::filesystem::path> files;
+    for (auto i = 0u; i < 10; ++i) {
+        // 空のファイルと、先読みの予算より大きいファイルを含める
+        std::string s(i == 3 ? 0 : (i == 7 ? 200000 : 1000 + i * 37), static_cast<char>('a' + i));
+        files.push_back(dir / ("tile" + std::to_string(i) + ".dat"));
+        std::ofstream(files.back(), std::ios::binary) << s;
+        contents.push_back(std::move(s));
+    }
+    return files;
+}
+
+}
+
+OUCHI_TEST_CASE(test_async_reader)
+{
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "gaei_test_async_reader";
+    std::vector<std::string> contents;
+    auto files = make_files(dir, contents);
+    for (bool io_uring : { true, false }) {
+        gaei::async_reader reader(files, 3, 4096, io_uring);
+        std::size_t mismatch = 0, bytes = 0;
+        for (auto& c : contents) {
+            auto r = reader.next();
+            OUCHI_CHECK_TRUE(r);
+            if (!r) break;
+            mismatch += r.unwrap() != c;
+            bytes += c.size();
+        }
+        OUCHI_CHECK_EQUAL(mismatch, 0u);
+        OUCHI_CHECK_TRUE(reader.done());
+        OUCHI_CHECK_EQUAL(reader.bytes_read(), bytes);
+        OUCHI_CHECK_TRUE(!reader.next());
+    }
+    fs::remove_all(dir);
+}
+
+OUCHI_TEST_CASE(test_async_reader_error)
+{
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "gaei_test_async_reader_error";
+    std::vector<std::string> contents;
+    auto files = make_files(dir, contents);
+    files.insert(files.begin() + 1, dir / "missing.dat");
+    for (bool io_uring : { true, false }) {
+        gaei::async_reader reader(files, 4, 1 << 20, io_uring);
+        OUCHI_CHECK_TRUE(reader.next());
+        OUCHI_CHECK_TRUE(!reader.next());
+        // 途中で読むのをやめても、読み込み中のファイルを待ってから破棄される
+    }
+    fs::remove_all(dir);
+}
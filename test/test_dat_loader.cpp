@@ -1,4 +1,6 @@
 ﻿#include <sstream>
+#include <string>
+#include <vector>
 #include "ouchitest.hpp"
 #include "dat_loader.hpp"
 
@@ -38,3 +40,89 @@ OUCHI_TEST_CASE(test_dat_loader_translate_err)
     // result must be err
     OUCHI_CHECK_TRUE(!r);
 }
+
+OUCHI_TEST_CASE(test_dat_format_of)
+{
+    OUCHI_CHECK_TRUE(gaei::dat_format_of("a/b.dat") == gaei::dat_format::plain);
+    OUCHI_CHECK_TRUE(gaei::dat_format_of("a/b.dat.gz") == gaei::dat_format::gzip);
+    OUCHI_CHECK_TRUE(gaei::dat_format_of("a/b.dat.zst") == gaei::dat_format::zstd);
+    OUCHI_CHECK_TRUE(gaei::dat_format_of("a/b.las") == gaei::dat_format::las);
+    OUCHI_CHECK_TRUE(gaei::dat_format_of("a/b.txt.gz") == gaei::dat_format::none);
+    OUCHI_CHECK_TRUE(gaei::dat_format_of("a/b.txt") == gaei::dat_format::none);
+    OUCHI_CHECK_TRUE(gaei::dat_format_supported(gaei::dat_format::plain));
+    OUCHI_CHECK_TRUE(!gaei::dat_format_supported(gaei::dat_format::none));
+}
+
+#if defined(GAEI_HAS_ZLIB)
+namespace {
+
+std::string gzip(std::string_view s)
+{
+    z_stream zs{};
+    // 15 + 16: gzipのヘッダーを付ける
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&zs, static_cast<uLong>(s.size())), '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(s.data()));
+    zs.avail_in = static_cast<uInt>(s.size());
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+}
+
+OUCHI_TEST_CASE(test_dat_loader_gzip)
+{
+    std::string text;
+    for (int i = 0; i < 1000; ++i) {
+        text += "  " + std::to_string(i) + ".00  -33278.00    " + std::to_string(i % 17) + ".25\r\n";
+    }
+    gaei::dat_loader dl;
+    auto accept = [](const gaei::vertex<>& v) { return v.position.z() != 3.25; };
+    std::vector<gaei::vertex<>> expected;
+    OUCHI_CHECK_TRUE(dl.load_from_memory(text, expected, accept));
+    const auto gz = gzip(text);
+    // 行がチャンクの境界をまたいでも同じ結果になる
+    for (std::size_t chunk : { std::size_t{ 7 }, std::size_t{ 1000 }, std::size_t{ 1 } << 20 }) {
+        std::vector<gaei::vertex<>> v;
+        OUCHI_CHECK_TRUE(dl.load_from_memory(gz, gaei::dat_format::gzip, v, accept, chunk));
+        OUCHI_CHECK_EQUAL(v.size(), expected.size());
+        std::size_t mismatch = 0;
+        for (auto i = 0u; i < v.size() && i < expected.size(); ++i) mismatch += !(v[i].position == expected[i].position);
+        OUCHI_CHECK_EQUAL(mismatch, 0u);
+    }
+    // 連結された複数のgzipメンバーは1つのデータとして読む
+    std::vector<gaei::vertex<>> twice;
+    OUCHI_CHECK_TRUE(dl.load_from_memory(gz + gz, gaei::dat_format::gzip, twice, accept));
+    OUCHI_CHECK_EQUAL(twice.size(), expected.size() * 2);
+    std::vector<gaei::vertex<>> truncated;
+    OUCHI_CHECK_TRUE(!dl.load_from_memory(std::string_view(gz).substr(0, gz.size() / 2), gaei::dat_format::gzip, truncated, accept));
+}
+#else
+OUCHI_TEST_CASE(test_dat_loader_gzip)
+{
+    std::vector<gaei::vertex<>> v;
+    OUCHI_CHECK_TRUE(!gaei::dat_format_supported(gaei::dat_format::gzip));
+    OUCHI_CHECK_TRUE(!gaei::dat_loader{}.load_from_memory("", gaei::dat_format::gzip, v, [](auto&) { return true; }));
+}
+#endif
+
+#if defined(GAEI_HAS_ZSTD)
+OUCHI_TEST_CASE(test_dat_loader_zstd)
+{
+    std::string text;
+    for (int i = 0; i < 1000; ++i) text += "  " + std::to_string(i) + ".00  -33278.00    19.00\r\n";
+    std::string zst(ZSTD_compressBound(text.size()), '\0');
+    zst.resize(ZSTD_compress(zst.data(), zst.size(), text.data(), text.size(), 3));
+    gaei::dat_loader dl;
+    std::vector<gaei::vertex<>> v;
+    OUCHI_CHECK_TRUE(dl.load_from_memory(zst, gaei::dat_format::zstd, v, [](auto&) { return true; }, 7));
+    OUCHI_CHECK_EQUAL(v.size(), 1000u);
+    OUCHI_CHECK_EQUAL(v.back().position.x(), 999.0);
+    std::vector<gaei::vertex<>> truncated;
+    OUCHI_CHECK_TRUE(!dl.load_from_memory(std::string_view(zst).substr(0, zst.size() / 2), gaei::dat_format::zstd, truncated, [](auto&) { return true; }));
+}
+#endif
@@ -0,0 +1,90 @@
+﻿#include <string>
+#include <vector>
+#include "ouchitest.hpp"
+#include "dedup.hpp"
+
+namespace {
+
+gaei::vertex<> at(double x, double y, double z, gaei::color c = gaei::colors::none)
+{
+    return { { x, y, z }, c };
+}
+
+// 重なった境界の行を持つ2枚のタイルを連結した点群。x == 2の列が両方に含まれ、後のタイルは1m高い
+std::vector<gaei::vertex<>> overlapping_tiles()
+{
+    std::vector<gaei::vertex<>> vs;
+    for (int y = 0; y < 3; ++y) {
+        for (int x = 0; x < 3; ++x) vs.push_back(at(x, y, 0));
+    }
+    for (int y = 0; y < 3; ++y) {
+        for (int x = 2; x < 5; ++x) vs.push_back(at(x, y, 1));
+    }
+    return vs;
+}
+
+}
+
+OUCHI_TEST_CASE(test_parse_dedup_policy)
+{
+    OUCHI_CHECK_TRUE(gaei::parse_dedup_policy("mean").unwrap() == gaei::dedup_policy::mean);
+    OUCHI_CHECK_TRUE(gaei::parse_dedup_policy("none").unwrap() == gaei::dedup_policy::none);
+    OUCHI_CHECK_TRUE(!gaei::parse_dedup_policy("last"));
+}
+
+OUCHI_TEST_CASE(test_remove_duplicate_points_first)
+{
+    auto vs = overlapping_tiles();
+    OUCHI_CHECK_EQUAL(gaei::remove_duplicate_points(vs, gaei::dedup_policy::first), std::size_t{ 3 });
+    OUCHI_CHECK_EQUAL(vs.size(), std::size_t{ 15 });
+    // 最初のタイルの点が元の順序のまま残る
+    OUCHI_CHECK_EQUAL(vs[2].position.x(), 2.0);
+    OUCHI_CHECK_EQUAL(vs[2].position.z(), 0.0);
+    OUCHI_CHECK_EQUAL(vs[9].position.x(), 3.0);
+    OUCHI_CHECK_EQUAL(vs[9].position.z(), 1.0);
+}
+
+OUCHI_TEST_CASE(test_remove_duplicate_points_policy)
+{
+    std::vector<gaei::vertex<>> vs = { at(0, 0, 2, gaei::colors::red), at(1, 0, 5), at(0, 0, 1, gaei::colors::blue), at(0, 0, 6) };
+    auto min = vs;
+    gaei::remove_duplicate_points(min, gaei::dedup_policy::min);
+    OUCHI_CHECK_EQUAL(min.size(), std::size_t{ 2 });
+    OUCHI_CHECK_EQUAL(min[0].position.z(), 1.0);
+    OUCHI_CHECK_TRUE(min[0].color == gaei::colors::blue);
+    OUCHI_CHECK_EQUAL(min[1].position.z(), 5.0);
+    auto max = vs;
+    gaei::remove_duplicate_points(max, gaei::dedup_policy::max);
+    OUCHI_CHECK_EQUAL(max[0].position.z(), 6.0);
+    auto mean = vs;
+    gaei::remove_duplicate_points(mean, gaei::dedup_policy::mean);
+    OUCHI_CHECK_EQUAL(mean[0].position.z(), 3.0);
+    OUCHI_CHECK_TRUE(mean[0].color == gaei::colors::red);
+    auto none = vs;
+    OUCHI_CHECK_EQUAL(gaei::remove_duplicate_points(none, gaei::dedup_policy::none), std::size_t{ 0 });
+    OUCHI_CHECK_EQUAL(none.size(), std::size_t{ 4 });
+}
+
+OUCHI_TEST_CASE(test_remove_duplicate_points_tolerance)
+{
+    // 丸めた格子が同じ点だけをまとめる。負の座標と大きな座標も扱う
+    std::vector<gaei::vertex<>> vs = { at(-30000.0004, 100000, 0), at(-30000.0001, 100000, 1), at(-30000.002, 100000, 2), at(-30000.0004, 100000.0004, 3) };
+    OUCHI_CHECK_EQUAL(gaei::remove_duplicate_points(vs, gaei::dedup_policy::first, 0.001), std::size_t{ 2 });
+    OUCHI_CHECK_EQUAL(vs.size(), std::size_t{ 2 });
+    OUCHI_CHECK_EQUAL(vs[1].position.z(), 2.0);
+}
+
+OUCHI_TEST_CASE(test_remove_duplicate_points_parallel)
+{
+    // 区間の境界をまたぐ組も1つにまとめる
+    std::vector<gaei::vertex<>> vs;
+    for (int copy = 0; copy < 3; ++copy) {
+        for (int i = 0; i < 100000; ++i) vs.push_back(at(i % 400, i / 400, copy));
+    }
+    OUCHI_CHECK_EQUAL(gaei::remove_duplicate_points(vs, gaei::dedup_policy::max), std::size_t{ 200000 });
+    bool ok = vs.size() == 100000;
+    for (std::size_t i = 0; ok && i < vs.size(); ++i) {
+        ok = vs[i].position.x() == double(i % 400) && vs[i].position.z() == 2.0;
+    }
+    OUCHI_CHECK_TRUE(ok);
+}
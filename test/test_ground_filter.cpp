@@ -0,0 +1,132 @@
+﻿#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+#include "ouchitest.hpp"
+#include "ground_filter.hpp"
+
+namespace {
+
+gaei::vertex<> at(double x, double y, double z)
+{
+    return { { x, y, z }, gaei::colors::none };
+}
+
+// 勾配0.2で傾いた60m四方の地面に、高さ6mの10m四方の建物と、高さ3mの1m四方の柱が建つ点群
+std::vector<gaei::vertex<>> slope_with_building()
+{
+    std::vector<gaei::vertex<>> vs;
+    for (int y = 0; y < 60; ++y) {
+        for (int x = 0; x < 60; ++x) {
+            double z = 0.2 * x;
+            if (20 <= x && x < 30 && 20 <= y && y < 30) z += 6;
+            if (x == 45 && y == 45) z += 3;
+            vs.push_back(at(x, y, z));
+        }
+    }
+    return vs;
+}
+
+}
+
+OUCHI_TEST_CASE(test_van_herk_filter)
+{
+    // 窓の最小値と最大値を総当たりと比べる
+    std::vector<double> src;
+    for (int i = 0; i < 37; ++i) src.push_back((i * 7919) % 23);
+    std::vector<double> g, h;
+    bool ok = true;
+    for (std::size_t r = 1; r < 20; ++r) {
+        auto mn = src, mx = src;
+        gaei::van_herk_filter(mn.data(), mn.size(), r, [](double a, double b) { return std::min(a, b); }, std::numeric_limits<double>::infinity(), g, h);
+        gaei::van_herk_filter(mx.data(), mx.size(), r, [](double a, double b) { return std::max(a, b); }, -std::numeric_limits<double>::infinity(), g, h);
+        for (std::size_t i = 0; i < src.size(); ++i) {
+            const auto b = src.begin() + (i < r ? 0 : i - r);
+            const auto e = src.begin() + std::min(src.size(), i + r + 1);
+            ok = ok && mn[i] == *std::min_element(b, e) && mx[i] == *std::max_element(b, e);
+        }
+    }
+    OUCHI_CHECK_TRUE(ok);
+}
+
+OUCHI_TEST_CASE(test_height_grid)
+{
+    // 点のないセルは最も近いセルの値で埋める
+    std::vector<gaei::vertex<>> vs = { at(0, 0, 1), at(0, 0, 0.5), at(3, 0, 4), at(0, 2, 7) };
+    gaei::height_grid grid(vs, 1.0);
+    OUCHI_CHECK_EQUAL(grid.width(), std::size_t{ 4 });
+    OUCHI_CHECK_EQUAL(grid.height(), std::size_t{ 3 });
+    OUCHI_CHECK_EQUAL(grid[0], 0.5);
+    OUCHI_CHECK_EQUAL(grid[1], 0.5);
+    OUCHI_CHECK_EQUAL(grid[2], 4.0);
+    OUCHI_CHECK_EQUAL(grid[4 + 3], 4.0);
+    OUCHI_CHECK_EQUAL(grid[8 + 3], 7.0);
+    grid.erode(1);
+    OUCHI_CHECK_EQUAL(grid[2], 0.5);
+}
+
+OUCHI_TEST_CASE(test_height_grid_parallel_scatter)
+{
+    // 点を行の帯に振り分けて並列に書き込んでも、直列に書き込んだ格子と一致する
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<double> xy(0, 300), z(-5, 5);
+    std::vector<gaei::vertex<>> vs(100000);
+    for (auto& v : vs) v = at(xy(rng), xy(rng), z(rng));
+    auto& limit = gaei::thread_limit();
+    const auto saved = limit;
+    limit = 1;
+    gaei::height_grid serial(vs, 1.0);
+    limit = 4;
+    gaei::height_grid banded(vs, 1.0);
+    limit = saved;
+    OUCHI_CHECK_EQUAL(banded.width(), serial.width());
+    OUCHI_CHECK_EQUAL(banded.height(), serial.height());
+    std::size_t mismatch = 0;
+    for (std::size_t c = 0; c < serial.width() * serial.height(); ++c) mismatch += banded[c] != serial[c];
+    OUCHI_CHECK_EQUAL(mismatch, std::size_t{ 0 });
+}
+
+OUCHI_TEST_CASE(test_progressive_morphological_filter)
+{
+    auto vs = slope_with_building();
+    auto ground = gaei::progressive_morphological_filter(vs);
+    std::size_t misclassified = 0;
+    for (std::size_t i = 0; i < vs.size(); ++i) {
+        const auto x = i % 60, y = i / 60;
+        const bool building = (20 <= x && x < 30 && 20 <= y && y < 30) || (x == 45 && y == 45);
+        misclassified += (ground[i] != 0) == building;
+    }
+    // 傾いた地面は地面、建物と柱は地面でないと判定される
+    OUCHI_CHECK_EQUAL(misclassified, std::size_t{ 0 });
+    // 窓より大きい建物は地面とみなされる
+    gaei::pmf_parameters small;
+    small.max_window = 5;
+    ground = gaei::progressive_morphological_filter(vs, small);
+    OUCHI_CHECK_TRUE(ground[25 * 60 + 25] != 0);
+    OUCHI_CHECK_TRUE(ground[45 * 60 + 45] == 0);
+}
+
+OUCHI_TEST_CASE(test_merge_ground_labels)
+{
+    // 地面が橋で2つのラベルに分かれている。ラベル2は建物
+    std::vector<gaei::vertex<>> vs = { at(0, 0, 0), at(1, 0, 0), at(2, 0, 0), at(5, 0, 0), at(6, 0, 0), at(3, 3, 9) };
+    std::vector<gaei::label_t> labels = { 0, 0, 0 | gaei::label_border, 1, 1, 2 };
+    gaei::label_statistics lc(3);
+    for (std::size_t i = 0; i < vs.size(); ++i) lc.add(gaei::label_id(labels[i]), vs[i].position, gaei::is_border(labels[i]));
+    lc.finalize();
+    std::vector<char> ground = { 1, 1, 1, 1, 0, 0 };
+    OUCHI_CHECK_EQUAL(gaei::merge_ground_labels(lc, labels, ground), std::size_t{ 1 });
+    // ラベル1は過半数でないので地面にならない
+    OUCHI_CHECK_EQUAL(lc.ground(), std::size_t{ 0 });
+    ground = { 1, 1, 1, 1, 1, 0 };
+    OUCHI_CHECK_EQUAL(gaei::merge_ground_labels(lc, labels, ground), std::size_t{ 2 });
+    OUCHI_CHECK_EQUAL(lc.ground(), std::size_t{ 0 });
+    OUCHI_CHECK_EQUAL(lc.count(0), std::size_t{ 5 });
+    OUCHI_CHECK_EQUAL(lc.count(1), std::size_t{ 0 });
+    OUCHI_CHECK_EQUAL(lc[0].max.x(), 6.0);
+    OUCHI_CHECK_TRUE(labels[3] == 0 && labels[2] == (0 | gaei::label_border) && labels[5] == 2);
+    // 地面と判定された点がなければ地面のラベルはない
+    ground.assign(6, 0);
+    gaei::merge_ground_labels(lc, labels, ground);
+    OUCHI_CHECK_EQUAL(lc.ground(), gaei::label_statistics::no_ground);
+}
@@ -0,0 +1,139 @@
+﻿#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ouchitest.hpp"
+#include "las_loader.hpp"
+#include "async_reader.hpp"
+
+namespace {
+
+struct las_point {
+    std::int32_t x, y, z;
+    unsigned return_number, return_count, classification;
+};
+
+template<class T>
+void put(std::string& s, std::size_t pos, T v)
+{
+    std::memcpy(s.data() + pos, &v, sizeof(T));
+}
+
+// 形式formatの点レコードを持つLAS 1.minorのファイルを作る
+std::string make_las(unsigned minor, unsigned format, std::size_t record_length, const std::vector<las_point>& points)
+{
+    const std::size_t header_size = minor >= 4 ? 375 : 227;
+    std::string s(header_size + record_length * points.size(), '\0');
+    std::memcpy(s.data(), "LASF", 4);
+    put<std::uint8_t>(s, 24, 1);
+    put<std::uint8_t>(s, 25, static_cast<std::uint8_t>(minor));
+    put<std::uint16_t>(s, 94, static_cast<std::uint16_t>(header_size));
+    put<std::uint32_t>(s, 96, static_cast<std::uint32_t>(header_size));
+    put<std::uint8_t>(s, 104, static_cast<std::uint8_t>(format));
+    put<std::uint16_t>(s, 105, static_cast<std::uint16_t>(record_length));
+    if (minor >= 4) put<std::uint64_t>(s, 247, points.size());
+    else put<std::uint32_t>(s, 107, static_cast<std::uint32_t>(points.size()));
+    const double scale[3] = { 0.01, 0.01, 0.001 }, offset[3] = { 1000, -2000, 0 };
+    for (auto i = 0u; i < 3; ++i) {
+        put(s, 131 + i * 8, scale[i]);
+        put(s, 155 + i * 8, offset[i]);
+    }
+    for (auto i = 0u; i < points.size(); ++i) {
+        auto rec = header_size + i * record_length;
+        auto& p = points[i];
+        put(s, rec, p.x);
+        put(s, rec + 4, p.y);
+        put(s, rec + 8, p.z);
+        if (format < 6) {
+            put<std::uint8_t>(s, rec + 14, static_cast<std::uint8_t>(p.return_number | (p.return_count << 3)));
+            put<std::uint8_t>(s, rec + 15, static_cast<std::uint8_t>(p.classification));
+        }
+        else {
+            put<std::uint8_t>(s, rec + 14, static_cast<std::uint8_t>(p.return_number | (p.return_count << 4)));
+            put<std::uint8_t>(s, rec + 16, static_cast<std::uint8_t>(p.classification));
+        }
+    }
+    return s;
+}
+
+const std::vector<las_point> sample = {
+    { 100, 200, 3000, 1, 1, 2 },
+    { -100, 0, 500, 1, 2, 5 },
+    { 250, 50, 1500, 2, 2, 2 },
+    { 0, 0, 0, 1, 3, 6 },
+};
+
+}
+
+OUCHI_TEST_CASE(test_las_loader)
+{
+    gaei::las_loader las;
+    for (auto [minor, format, length] : { std::tuple{ 2u, 1u, 28u }, std::tuple{ 2u, 3u, 34u }, std::tuple{ 4u, 6u, 30u }, std::tuple{ 4u, 8u, 38u } }) {
+        auto s = make_las(minor, format, length, sample);
+        auto h = gaei::las_loader::read_header(s);
+        OUCHI_CHECK_TRUE(h);
+        if (!h) continue;
+        OUCHI_CHECK_EQUAL(h.unwrap().point_format, format);
+        OUCHI_CHECK_EQUAL(h.unwrap().point_count, sample.size());
+        std::vector<gaei::vertex<>> v;
+        // 区間に分けてデコードしても順序は変わらない
+        OUCHI_CHECK_TRUE(las.load_from_memory(s, v, [](auto&) { return true; }, 1));
+        OUCHI_CHECK_EQUAL(v.size(), sample.size());
+        if (v.size() != sample.size()) continue;
+        OUCHI_CHECK_EQUAL(v[0].position.x(), 100 * 0.01 + 1000);
+        OUCHI_CHECK_EQUAL(v[1].position.x(), -100 * 0.01 + 1000);
+        OUCHI_CHECK_EQUAL(v[0].position.y(), 200 * 0.01 - 2000);
+        OUCHI_CHECK_EQUAL(v[2].position.z(), 1500 * 0.001);
+    }
+}
+
+OUCHI_TEST_CASE(test_las_loader_filter)
+{
+    auto s = make_las(4, 6, 30, sample);
+    gaei::las_loader las;
+    OUCHI_CHECK_TRUE(las.set_classes("2, 6"));
+    std::vector<gaei::vertex<>> v;
+    OUCHI_CHECK_TRUE(las.load_from_memory(s, v, [](auto&) { return true; }));
+    OUCHI_CHECK_EQUAL(v.size(), 3u);
+    las.returns = gaei::las_returns::last;
+    v.clear();
+    OUCHI_CHECK_TRUE(las.load_from_memory(s, v, [](auto&) { return true; }));
+    OUCHI_CHECK_EQUAL(v.size(), 2u);
+    las.returns = gaei::las_returns::first;
+    v.clear();
+    // predは分類と反射で絞り込んだ後の点に対して呼ばれる
+    std::size_t called = 0;
+    OUCHI_CHECK_TRUE(las.load_from_memory(s, v, [&called](auto&) { ++called; return false; }));
+    OUCHI_CHECK_EQUAL(called, 2u);
+    OUCHI_CHECK_TRUE(v.empty());
+    OUCHI_CHECK_TRUE(!las.set_classes("2,x"));
+    OUCHI_CHECK_TRUE(!las.set_classes("256"));
+}
+
+OUCHI_TEST_CASE(test_las_loader_error)
+{
+    auto s = make_las(2, 1, 28, sample);
+    OUCHI_CHECK_TRUE(!gaei::las_loader::read_header(std::string_view(s).substr(0, s.size() - 1)));
+    OUCHI_CHECK_TRUE(!gaei::las_loader::read_header("LASF"));
+    auto laz = s;
+    laz[104] = static_cast<char>(0x81);
+    OUCHI_CHECK_TRUE(!gaei::las_loader::read_header(laz));
+    auto short_record = make_las(2, 3, 28, sample);
+    OUCHI_CHECK_TRUE(!gaei::las_loader::read_header(short_record));
+}
+
+OUCHI_TEST_CASE(test_mapped_file)
+{
+    namespace fs = std::filesystem;
+    auto path = fs::temp_directory_path() / "gaei_test_mapped_file.las";
+    auto s = make_las(2, 1, 28, sample);
+    std::ofstream(path, std::ios::binary) << s;
+    gaei::mapped_file m;
+    OUCHI_CHECK_TRUE(m.open(path));
+    OUCHI_CHECK_TRUE(m.data() == s);
+    m.close();
+    OUCHI_CHECK_TRUE(m.data().empty());
+    OUCHI_CHECK_TRUE(!m.open(path.string() + ".missing"));
+    fs::remove(path);
+}
@@ -0,0 +1,48 @@
+﻿#include <filesystem>
+#include <thread>
+#include "ouchitest.hpp"
+#include "local_server.hpp"
+
+OUCHI_TEST_CASE(test_split_args)
+{
+    auto a = gaei::split_args("  data -o \"out dir/a.wrl\" --bbox=\"1,2\"  \"\" x\\y \"a\\\"b\"\n");
+    OUCHI_CHECK_EQUAL(a.size(), 7u);
+    OUCHI_CHECK_EQUAL(a[0], "data");
+    OUCHI_CHECK_EQUAL(a[1], "-o");
+    OUCHI_CHECK_EQUAL(a[2], "out dir/a.wrl");
+    OUCHI_CHECK_EQUAL(a[3], "--bbox=1,2");
+    OUCHI_CHECK_EQUAL(a[4], "");
+    OUCHI_CHECK_EQUAL(a[5], "x\\y");
+    OUCHI_CHECK_EQUAL(a[6], "a\"b");
+    OUCHI_CHECK_TRUE(gaei::split_args(" \t").empty());
+}
+
+#if !defined(_WIN32)
+OUCHI_TEST_CASE(test_local_server)
+{
+    auto path = (std::filesystem::temp_directory_path() / "gaei_test.sock").string();
+    gaei::local_server server;
+    const auto mask = ::umask(0);
+    ::umask(mask);
+    OUCHI_CHECK_TRUE(server.listen(path));
+    // 作成したユーザーだけがジョブを送れる。ソケットの作成のために絞ったumaskは元に戻す
+    auto perms = std::filesystem::status(path).permissions();
+    OUCHI_CHECK_TRUE(perms == (std::filesystem::perms::owner_read | std::filesystem::perms::owner_write));
+    const auto restored = ::umask(mask);
+    OUCHI_CHECK_EQUAL(restored, mask);
+    std::size_t jobs = 0;
+    std::thread th([&server, &jobs] {
+        server.serve([&jobs](std::string_view line) {
+            ++jobs;
+            return "echo " + std::string(line) + "\n";
+        });
+    });
+    auto r = gaei::local_server::request(path, "a b");
+    OUCHI_CHECK_TRUE(r);
+    if (r) OUCHI_CHECK_EQUAL(r.unwrap(), "echo a b\n");
+    auto bye = gaei::local_server::request(path, gaei::local_server::shutdown_command);
+    th.join();
+    OUCHI_CHECK_TRUE(bye);
+    OUCHI_CHECK_EQUAL(jobs, 1u);
+}
+#endif
@@ -0,0 +1,45 @@
+﻿#include <sstream>
+#include <string>
+#include "ouchitest.hpp"
+#include "lod_pyramid.hpp"
+
+OUCHI_TEST_CASE(test_lod_pyramid_partition)
+{
+    gaei::lod_pyramid pyramid({ 0, 0 }, 10, 2);
+    OUCHI_CHECK_EQUAL(pyramid.tile_size(1), 20.0);
+    OUCHI_CHECK_TRUE((pyramid.tile_of(0, 15, 5) == gaei::lod_pyramid::tile_key{ 1, 0 }));
+    OUCHI_CHECK_TRUE((pyramid.tile_of(1, 15, 5) == gaei::lod_pyramid::tile_key{ 0, 0 }));
+    std::vector<gaei::vertex<>> vs = {
+        { { 5, 5, 0 }, gaei::colors::none },
+        { { 9.5, 5, 0 }, gaei::colors::none },
+        { { 15, 5, 0 }, gaei::colors::none },
+    };
+    auto parts = pyramid.partition(0, vs, 1);
+    OUCHI_CHECK_EQUAL(parts.size(), 2u);
+    // タイルの境界から1以内の点は隣のタイルにも含まれる
+    OUCHI_CHECK_EQUAL(parts[gaei::lod_pyramid::tile_key(0, 0)].size(), 2u);
+    OUCHI_CHECK_EQUAL(parts[gaei::lod_pyramid::tile_key(1, 0)].size(), 2u);
+}
+
+OUCHI_TEST_CASE(test_lod_pyramid_manifest)
+{
+    gaei::lod_pyramid pyramid({ 0, 0 }, 10, 2);
+    std::vector<gaei::vertex<>> a = { { { 0, 0, 0 }, gaei::colors::none }, { { 10, 10, 2 }, gaei::colors::none } };
+    std::vector<gaei::vertex<>> b = { { { 10, 0, 0 }, gaei::colors::none }, { { 20, 10, 2 }, gaei::colors::none } };
+    pyramid.add(0, { 0, 0 }, "out_L0_0_0.wrl", a);
+    pyramid.add(0, { 1, 0 }, "out_L0_1_0.wrl", b);
+    pyramid.add(1, { 0, 0 }, "out_L1_0_0.wrl", a);
+    OUCHI_CHECK_TRUE(pyramid.find(1, { 0, 0 }) != nullptr);
+    OUCHI_CHECK_TRUE(pyramid.find(1, { 1, 0 }) == nullptr);
+    std::stringstream ss;
+    OUCHI_CHECK_TRUE(pyramid.write_manifest(ss));
+    auto s = ss.str();
+    OUCHI_CHECK_TRUE(s.rfind("#VRML V2.0 utf8\n", 0) == 0);
+    OUCHI_CHECK_TRUE(s.find("LOD {") != std::string::npos);
+    OUCHI_CHECK_TRUE(s.find("range [ 40 ]") != std::string::npos);
+    // 詳細な階層が先、粗い階層が後に並ぶ
+    auto l0 = s.find("out_L0_1_0.wrl");
+    auto l1 = s.find("out_L1_0_0.wrl");
+    OUCHI_CHECK_TRUE(s.find("out_L0_0_0.wrl") < l0);
+    OUCHI_CHECK_TRUE(l0 < l1 && l1 != std::string::npos);
+}
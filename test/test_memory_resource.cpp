@@ -0,0 +1,57 @@
+﻿#include <vector>
+#include <unordered_set>
+#include "ouchitest.hpp"
+#include "memory_resource.hpp"
+#include "surface_structure_isolate.hpp"
+
+OUCHI_TEST_CASE(test_counting_resource)
+{
+    gaei::counting_resource cr(std::pmr::new_delete_resource());
+    {
+        std::pmr::vector<int> v(&cr);
+        v.reserve(100);
+        OUCHI_CHECK_EQUAL(cr.allocations(), 1u);
+        OUCHI_CHECK_EQUAL(cr.bytes(), 100 * sizeof(int));
+    }
+    OUCHI_CHECK_EQUAL(cr.deallocations(), 1u);
+    OUCHI_CHECK_EQUAL(cr.bytes(), 0u);
+    OUCHI_CHECK_EQUAL(cr.peak_bytes(), 100 * sizeof(int));
+}
+
+OUCHI_TEST_CASE(test_stage_arena)
+{
+    gaei::stage_arena arena;
+    {
+        std::pmr::unordered_set<int> s(arena.resource());
+        for (int i = 0; i < 1000; ++i) s.insert(i);
+    }
+    // 1000個のノードの確保が少数のヒープ確保にまとめられる
+    OUCHI_CHECK_TRUE(arena.requests().allocations() >= 1000u);
+    OUCHI_CHECK_TRUE(arena.heap().allocations() < 20u);
+    arena.release();
+    OUCHI_CHECK_EQUAL(arena.heap().bytes(), 0u);
+
+    gaei::stage_arena heap(false);
+    {
+        std::pmr::unordered_set<int> s(heap.resource());
+        for (int i = 0; i < 1000; ++i) s.insert(i);
+    }
+    OUCHI_CHECK_EQUAL(heap.heap().allocations(), heap.requests().allocations());
+}
+
+OUCHI_TEST_CASE(test_ssi_arena)
+{
+    std::vector<gaei::vertex<>> vs;
+    for (int x = 0; x < 20; ++x) {
+        for (int y = 0; y < 20; ++y) vs.push_back({ { (double)x, (double)y, (x / 5 + y / 5) % 2 * 10.0 }, gaei::color{} });
+    }
+    std::vector<gaei::label_t> expected, actual;
+    gaei::surface_structure_isolate{ 1 }(vs, expected);
+    gaei::stage_arena arena;
+    {
+        gaei::surface_structure_isolate ssi{ 1, arena.resource() };
+        OUCHI_CHECK_EQUAL(ssi(vs, actual), 16u);
+    }
+    OUCHI_CHECK_TRUE(expected == actual);
+    OUCHI_CHECK_TRUE(arena.heap().allocations() < arena.requests().allocations());
+}
@@ -0,0 +1,64 @@
+﻿#include <cmath>
+#include <sstream>
+#include "ouchitest.hpp"
+#include "mesh_normals.hpp"
+#include "vrml_writer.hpp"
+
+namespace {
+
+gaei::vertex<> at(double x, double y, double z)
+{
+    return { { x, y, z }, gaei::colors::none };
+}
+
+}
+
+OUCHI_TEST_CASE(test_face_normals)
+{
+    std::vector<gaei::vertex<>> vs = { at(0, 0, 0), at(2, 0, 0), at(0, 3, 0) };
+    std::vector<gaei::triangle> ts = { { 0, 1, 2 } };
+    auto fn = gaei::face_normals(vs, ts);
+    // 反時計回りの三角形は上を向き、長さは面積の2倍
+    OUCHI_CHECK_EQUAL(fn[0].z(), 6.0);
+    OUCHI_CHECK_EQUAL(fn[0].x(), 0.0);
+    OUCHI_CHECK_EQUAL(fn[0].y(), 0.0);
+}
+
+OUCHI_TEST_CASE(test_vertex_normals)
+{
+    // 稜線(0, 1)を共有する2枚の面。大きい方(x < 0で面積4)は水平、小さい方(x > 0で面積1)は45度傾く
+    std::vector<gaei::vertex<>> vs = { at(0, 0, 0), at(0, 2, 0), at(-4, 0, 0), at(1, 0, 1), at(5, 5, 5) };
+    std::vector<gaei::triangle> ts = { { 0, 1, 2 }, { 0, 3, 1 } };
+    auto ns = gaei::vertex_normals(vs, ts);
+    OUCHI_CHECK_EQUAL(ns.size(), vs.size());
+    for (auto i = 0u; i < 4; ++i) {
+        OUCHI_CHECK_TRUE(std::abs(gaei::inner_product(ns[i], ns[i]) - 1) < 1e-12);
+    }
+    // 面積で重み付けするので、共有する頂点の法線は大きい面に近い
+    OUCHI_CHECK_TRUE(ns[0].z() > 0.9);
+    OUCHI_CHECK_TRUE(ns[0].x() < 0);
+    OUCHI_CHECK_EQUAL(ns[2].z(), 1.0);
+    OUCHI_CHECK_TRUE(std::abs(ns[3].x() + std::sqrt(0.5)) < 1e-12);
+    // どの三角形にも使われない頂点は上向き
+    OUCHI_CHECK_EQUAL(ns[4].z(), 1.0);
+}
+
+OUCHI_TEST_CASE(test_write_normal_node)
+{
+    gaei::vrml::indexed_face_set ifs;
+    ifs.coord_ = { at(0, 0, 0), at(1, 0, 0), at(0, 1, 0) };
+    ifs.coord_index_ = { 0, 1, 2, -1 };
+    std::ostringstream plain;
+    OUCHI_CHECK_TRUE(ifs.write(plain));
+    OUCHI_CHECK_TRUE(plain.str().find("Normal") == std::string::npos);
+
+    ifs.normal_ = { { 0, 1, 0 }, { 0.70710678, 0.70710678, -0.00001 }, { 0.123456, 0, 0.9923 } };
+    std::ostringstream out;
+    OUCHI_CHECK_TRUE(ifs.write(out));
+    auto s = out.str();
+    OUCHI_CHECK_TRUE(s.find("normal Normal{vector[") != std::string::npos);
+    // 小数点以下3桁に丸め、-0は0と書く
+    OUCHI_CHECK_TRUE(s.find("0 1 0 \n") != std::string::npos);
+    OUCHI_CHECK_TRUE(s.find("0.707 0.707 0 \n") != std::string::npos);
+    OUCHI_CHECK_TRUE(s.find("0.123 0 0.992 \n") != std::string::npos);
+}
@@ -0,0 +1,55 @@
+﻿#include <random>
+#include <algorithm>
+#include "ouchitest.hpp"
+#include "mesh_optimize.hpp"
+
+namespace {
+
+// n×nの格子を三角形に分割し、三角形の順序をばらばらにする
+std::vector<gaei::triangle> shuffled_grid(std::size_t n)
+{
+    std::vector<gaei::triangle> ts;
+    for (std::size_t y = 0; y + 1 < n; ++y) {
+        for (std::size_t x = 0; x + 1 < n; ++x) {
+            auto a = y * n + x;
+            ts.push_back({ a, a + 1, a + n });
+            ts.push_back({ a + 1, a + n + 1, a + n });
+        }
+    }
+    std::mt19937 rng(1);
+    std::shuffle(ts.begin(), ts.end(), rng);
+    return ts;
+}
+
+}
+
+OUCHI_TEST_CASE(test_optimize_triangle_order)
+{
+    const std::size_t n = 64;
+    auto ts = shuffled_grid(n);
+    auto original = ts;
+    const auto before = gaei::average_cache_miss_ratio(ts, n * n);
+    gaei::optimize_triangle_order(ts, n * n);
+    const auto after = gaei::average_cache_miss_ratio(ts, n * n);
+    // 三角形の集合と各三角形の頂点の並びは変わらない
+    auto sorted = ts;
+    std::sort(sorted.begin(), sorted.end());
+    std::sort(original.begin(), original.end());
+    OUCHI_CHECK_TRUE(sorted == original);
+    OUCHI_CHECK_TRUE(before > 2.0);
+    OUCHI_CHECK_TRUE(after < 0.8);
+    OUCHI_CHECK_EQUAL(gaei::average_cache_miss_ratio({}, 0), 0.0);
+}
+
+OUCHI_TEST_CASE(test_reorder_vertices)
+{
+    std::vector<int> vs = { 0, 1, 2, 3, 4, 5 };
+    std::vector<gaei::triangle> ts = { { 4, 2, 5 }, { 2, 0, 5 } };
+    auto remap = gaei::reorder_vertices(vs, ts);
+    // 最初に使われた順に並び、使われない頂点(1, 3)は末尾に残る
+    OUCHI_CHECK_TRUE((vs == std::vector<int>{ 4, 2, 5, 0, 1, 3 }));
+    OUCHI_CHECK_TRUE((ts[0] == gaei::triangle{ 0, 1, 2 }));
+    OUCHI_CHECK_TRUE((ts[1] == gaei::triangle{ 1, 3, 2 }));
+    OUCHI_CHECK_EQUAL(remap[4], 0u);
+    OUCHI_CHECK_EQUAL(remap[3], 5u);
+}
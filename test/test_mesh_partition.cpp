@@ -0,0 +1,91 @@
+﻿#include <sstream>
+#include <string>
+#include <algorithm>
+#include "ouchitest.hpp"
+#include "mesh_partition.hpp"
+
+namespace {
+
+// x方向に並ぶ4点×2列の帯。左半分の頂点はラベル1、右半分はラベル2
+struct strip {
+    std::vector<gaei::vertex<>> vs;
+    std::vector<gaei::label_t> labels;
+    std::vector<gaei::triangle> ts;
+
+    strip()
+    {
+        for (std::size_t x = 0; x < 4; ++x) {
+            for (std::size_t y = 0; y < 2; ++y) {
+                vs.push_back({ { x * 10.0, y * 10.0, (double)x }, gaei::colors::none });
+                labels.push_back(x < 2 ? 1 : 2 | gaei::label_border);
+            }
+        }
+        for (std::size_t x = 0; x + 1 < 4; ++x) {
+            auto a = x * 2;
+            ts.push_back({ a, a + 2, a + 1 });
+            ts.push_back({ a + 2, a + 3, a + 1 });
+        }
+    }
+};
+
+}
+
+OUCHI_TEST_CASE(test_partition_by_label)
+{
+    strip s;
+    auto parts = gaei::partition_mesh(s.vs, s.labels, s.ts, gaei::partition_mode::label);
+    OUCHI_CHECK_EQUAL(parts.size(), 2u);
+    // 中央の2つの三角形は2頂点がラベル1、または2頂点がラベル2である
+    OUCHI_CHECK_EQUAL(parts[0].label, 1u);
+    OUCHI_CHECK_EQUAL(parts[1].label, 2u);
+    OUCHI_CHECK_EQUAL(parts[0].triangles.size() + parts[1].triangles.size(), s.ts.size());
+    OUCHI_CHECK_EQUAL(parts[0].name(gaei::partition_mode::label), std::string("1"));
+    for (auto& p : parts) {
+        // 頂点番号は部分の中で詰められ、元の座標を指す
+        for (auto& t : p.triangles) {
+            for (auto v : t) OUCHI_CHECK_TRUE(v < p.vertices.size());
+        }
+        OUCHI_CHECK_TRUE(std::is_sorted(p.vertices.begin(), p.vertices.end(), [](auto& a, auto& b) {
+            return a.position.x() < b.position.x();
+        }));
+    }
+    // 1つ目の三角形(0, 2, 1)は部分の中でも同じ頂点を同じ順で指す
+    auto& t = parts[0].triangles.front();
+    OUCHI_CHECK_EQUAL(parts[0].vertices[t[0]].position.x(), 0.0);
+    OUCHI_CHECK_EQUAL(parts[0].vertices[t[1]].position.x(), 10.0);
+    OUCHI_CHECK_EQUAL(parts[0].vertices[t[2]].position.y(), 10.0);
+}
+
+OUCHI_TEST_CASE(test_partition_by_tile)
+{
+    strip s;
+    auto parts = gaei::partition_mesh(s.vs, s.labels, s.ts, gaei::partition_mode::tile, { 0, 0 }, 15);
+    // 重心のxは約3.3〜26.7なので、タイル0と1に分かれる
+    OUCHI_CHECK_EQUAL(parts.size(), 2u);
+    OUCHI_CHECK_EQUAL(parts[0].tile_x, 0);
+    OUCHI_CHECK_EQUAL(parts[1].tile_x, 1);
+    OUCHI_CHECK_EQUAL(parts[1].name(gaei::partition_mode::tile), std::string("1_0"));
+    std::size_t total = 0;
+    for (auto& p : parts) total += p.triangles.size();
+    OUCHI_CHECK_EQUAL(total, s.ts.size());
+
+    auto both = gaei::partition_mesh(s.vs, s.labels, s.ts, gaei::partition_mode::label_tile, { 0, 0 }, 15);
+    OUCHI_CHECK_TRUE(both.size() >= parts.size());
+    OUCHI_CHECK_EQUAL(both.back().name(gaei::partition_mode::label_tile), std::string("2_1_0"));
+}
+
+OUCHI_TEST_CASE(test_partition_index)
+{
+    strip s;
+    auto parts = gaei::partition_mesh(s.vs, s.labels, s.ts, gaei::partition_mode::label);
+    std::ostringstream out;
+    auto r = gaei::write_partition_index(out, parts, { "a_1.wrl", "a_2.wrl" });
+    OUCHI_CHECK_TRUE(r);
+    auto str = out.str();
+    OUCHI_CHECK_TRUE(str.find("url \"a_1.wrl\"") != std::string::npos);
+    OUCHI_CHECK_TRUE(str.find("url \"a_2.wrl\"") != std::string::npos);
+    OUCHI_CHECK_TRUE(str.find("bboxSize") != std::string::npos);
+
+    OUCHI_CHECK_TRUE(gaei::parse_partition_mode("label_tile"));
+    OUCHI_CHECK_TRUE(!gaei::parse_partition_mode("labels"));
+}
@@ -1,2 +1,55 @@
-﻿#include "ouchitest.hpp"
+﻿#include <vector>
+#include "ouchitest.hpp"
 #include "normalize.hpp"
+
+namespace {
+
+// 30000m付近の1m間隔の格子に並ぶ点
+std::vector<gaei::vertex<>> grid(int x0, int y0, int n)
+{
+    std::vector<gaei::vertex<>> vs;
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) vs.push_back({ { 30000.0 + x0 + x, -40000.0 + y0 + y, 0.5 * x }, gaei::colors::none });
+    }
+    return vs;
+}
+
+}
+
+OUCHI_TEST_CASE(test_normalize_round_trip)
+{
+    const auto original = grid(0, 0, 8);
+    auto vs = original;
+    const auto n = gaei::normalize(vs);
+    OUCHI_CHECK_EQUAL(n.origin.x(), 30000.0);
+    OUCHI_CHECK_EQUAL(n.origin.y(), -40000.0);
+    OUCHI_CHECK_EQUAL(n.jitter.size(), vs.size());
+    gaei::inv_normalize(vs, n);
+    std::size_t mismatch = 0;
+    for (std::size_t i = 0; i < vs.size(); ++i) {
+        mismatch += vs[i].position.x() + n.origin.x() != original[i].position.x()
+                 || vs[i].position.y() + n.origin.y() != original[i].position.y()
+                 || vs[i].position.z() != original[i].position.z();
+    }
+    OUCHI_CHECK_EQUAL(mismatch, std::size_t{ 0 });
+}
+
+OUCHI_TEST_CASE(test_normalize_jitter_by_position)
+{
+    // 重なる範囲を別々に正規化しても、同じ点は同じだけずれる
+    auto a = grid(0, 0, 8), b = grid(4, 2, 8);
+    const auto na = gaei::normalize(a), nb = gaei::normalize(b);
+    std::size_t shared = 0, mismatch = 0;
+    for (std::size_t i = 0; i < b.size(); ++i) {
+        const auto x = static_cast<int>(i % 8) + 4, y = static_cast<int>(i / 8) + 2;
+        if (x >= 8 || y >= 8) continue;
+        ++shared;
+        mismatch += na.jitter[y * 8 + x] != nb.jitter[i];
+    }
+    OUCHI_CHECK_EQUAL(shared, std::size_t{ 24 });
+    OUCHI_CHECK_EQUAL(mismatch, std::size_t{ 0 });
+    // ずらし量は点ごとに異なり、格子が同一円周上に並ばない
+    std::size_t distinct = 0;
+    for (std::size_t i = 1; i < na.jitter.size(); ++i) distinct += na.jitter[i] != na.jitter[0];
+    OUCHI_CHECK_TRUE(distinct > 0);
+}
@@ -0,0 +1,146 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <streambuf>
+#include "ouchitest.hpp"
+#include "pipeline.hpp"
+#include "vrml_writer.hpp"
+#include "stage_report.hpp"
+
+namespace {
+
+// 40m四方の地面に、高さ10mの10m四方の建物が1つ建つ点群
+std::vector<gaei::vertex<>> town()
+{
+    std::vector<gaei::vertex<>> vs;
+    for (int y = 0; y < 40; ++y) {
+        for (int x = 0; x < 40; ++x) {
+            const bool building = 15 <= x && x < 25 && 15 <= y && y < 25;
+            vs.push_back({ { (double)x, (double)y, building ? 10.0 : 0.0 }, gaei::colors::none });
+        }
+    }
+    return vs;
+}
+
+// 書き込まれた文字数だけを数える
+struct counting_buffer : std::streambuf {
+    std::size_t size = 0;
+    int overflow(int c) override { ++size; return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { size += static_cast<std::size_t>(n); return n; }
+};
+
+// メッシュの各配列の大きさと頂点番号が整合しているか
+bool consistent(const gaei::mesh& m)
+{
+    for (auto& t : m.triangles) {
+        for (auto v : t) {
+            if (v >= m.vertices.size()) return false;
+        }
+    }
+    for (auto f : m.faces) {
+        if (f < -1 || f >= (long)m.vertices.size()) return false;
+    }
+    return m.labels.size() <= m.vertices.size();
+}
+
+}
+
+OUCHI_TEST_CASE(test_pipeline_run)
+{
+    const auto points = town();
+    gaei::pipeline_options o;
+    o.thinout_width = 1;
+    auto r = gaei::pipeline(o).run(points.data(), points.size());
+    OUCHI_CHECK_TRUE(r);
+    if (!r) return;
+    auto& m = r.unwrap();
+    // 呼び出し側の点は変更しない
+    OUCHI_CHECK_EQUAL(points.size(), 1600u);
+    OUCHI_CHECK_TRUE(m.vertices.size() >= 3);
+    OUCHI_CHECK_TRUE(!m.triangles.empty());
+    OUCHI_CHECK_EQUAL(m.labels.size(), m.vertices.size());
+    OUCHI_CHECK_EQUAL(m.normals.size(), m.vertices.size());
+    OUCHI_CHECK_EQUAL(m.faces.size(), m.triangles.size() * 4);
+    OUCHI_CHECK_TRUE(consistent(m));
+}
+
+OUCHI_TEST_CASE(test_pipeline_origin)
+{
+    // 平面直角座標系のような大きな座標でも、originを足せば入力と同じ範囲に戻る
+    auto points = town();
+    for (auto& v : points) {
+        v.position.x() += 30000;
+        v.position.y() -= 40000;
+    }
+    gaei::pipeline_options o;
+    o.thinout_width = 1;
+    auto r = gaei::pipeline(o).run(std::move(points));
+    OUCHI_CHECK_TRUE(r);
+    if (!r) return;
+    auto& m = r.unwrap();
+    double min_x = 1e9, max_x = -1e9, min_y = 1e9, max_y = -1e9;
+    for (auto& v : m.vertices) {
+        min_x = std::min(min_x, v.position.x() + m.origin.x());
+        max_x = std::max(max_x, v.position.x() + m.origin.x());
+        min_y = std::min(min_y, v.position.y() + m.origin.y());
+        max_y = std::max(max_y, v.position.y() + m.origin.y());
+    }
+    OUCHI_CHECK_TRUE(std::abs(min_x - 30000) < 0.5 && std::abs(max_x - 30039) < 0.5);
+    OUCHI_CHECK_TRUE(std::abs(min_y + 40000) < 0.5 && std::abs(max_y + 39961) < 0.5);
+}
+
+OUCHI_TEST_CASE(test_pipeline_printer)
+{
+    gaei::pipeline_options o;
+    o.printer = true;
+    auto r = gaei::pipeline(o).run(town());
+    OUCHI_CHECK_TRUE(r);
+    if (!r) return;
+    auto& m = r.unwrap();
+    // 側面と底面の分だけ面が増え、法線は計算しない
+    OUCHI_CHECK_TRUE(m.faces.size() > m.triangles.size() * 4);
+    OUCHI_CHECK_TRUE(m.normals.empty());
+    OUCHI_CHECK_TRUE(consistent(m));
+}
+
+OUCHI_TEST_CASE(test_pipeline_too_few_points)
+{
+    std::vector<gaei::vertex<>> vs = { { { 0, 0, 0 }, gaei::colors::none } };
+    auto r = gaei::pipeline{}.run(vs);
+    OUCHI_CHECK_TRUE(!r);
+    OUCHI_CHECK_TRUE(!gaei::pipeline{}.run(nullptr, 0));
+}
+
+OUCHI_TEST_CASE(test_pipeline_peak_memory)
+{
+    // ピーク常駐メモリ量を測れない環境では確かめない
+    if (!gaei::reset_peak_rss()) return;
+    const auto base = gaei::peak_rss();
+    // 1000m四方の地面に、40m間隔で10m四方の建物が並ぶ点群
+    std::vector<gaei::vertex<>> points;
+    points.reserve(1000 * 1000);
+    for (int y = 0; y < 1000; ++y) {
+        for (int x = 0; x < 1000; ++x) {
+            const bool building = x % 40 >= 15 && x % 40 < 25 && y % 40 >= 15 && y % 40 < 25;
+            points.push_back({ { (double)x, (double)y, building ? 10.0 : 0.0 }, gaei::colors::none });
+        }
+    }
+    const auto input = points.size() * sizeof(gaei::vertex<>);
+    gaei::pipeline_options o;
+    o.thinout_width = 1;
+    auto r = gaei::pipeline(o).run(std::move(points));
+    OUCHI_CHECK_TRUE(r);
+    if (!r) return;
+    auto& m = r.unwrap();
+    // 頂点、面、法線はノードへ移し、書き込みは一定の大きさの領域で行う
+    gaei::vrml::indexed_face_set ifs(std::move(m.vertices), std::move(m.faces), std::move(m.normals));
+    counting_buffer buf;
+    std::ostream out(&buf);
+    OUCHI_CHECK_TRUE(ifs.write(out));
+    OUCHI_CHECK_TRUE(buf.size > 0);
+    // 現在は入力の約4.3倍。点群全体の複製が1つ増えれば5倍を超える
+    const auto used = gaei::peak_rss() - base;
+    OUCHI_CHECK_TRUE(used < 5 * input);
+}
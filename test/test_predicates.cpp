@@ -0,0 +1,59 @@
+﻿#include <cmath>
+#include "ouchitest.hpp"
+#include "predicates.hpp"
+#include "vector_utl.hpp"
+
+OUCHI_TEST_CASE(test_expansion)
+{
+    gaei::exact::expansion<3> e;
+    gaei::exact::grow(e, 1e16);
+    gaei::exact::grow(e, 1);
+    gaei::exact::grow(e, -1e16);
+    OUCHI_CHECK_EQUAL(e.estimate(), 1.0);
+    auto p = gaei::exact::product(gaei::exact::difference(1e16, 1), gaei::exact::difference(1e16, -1));
+    // (1e16 - 1)(1e16 + 1) = 1e32 - 1
+    auto d = gaei::exact::sum(p, gaei::exact::negate(gaei::exact::scale(gaei::exact::difference(1e16, 0), 1e16)));
+    OUCHI_CHECK_EQUAL(d.estimate(), -1.0);
+}
+
+OUCHI_TEST_CASE(test_orient2d)
+{
+    OUCHI_CHECK_EQUAL(gaei::orient2d(0.5, 0.5, 12, 12, 24, 24), 0.0);
+    OUCHI_CHECK_TRUE(gaei::orient2d(0.5, 0.5, 12, 12, 24, std::nextafter(24.0, 25.0)) > 0);
+    OUCHI_CHECK_TRUE(gaei::orient2d(0.5, 0.5, 12, 12, 24, std::nextafter(24.0, 23.0)) < 0);
+    // 浮動小数点の誤差が問題になる、ほぼ同一直線上の点の組み合わせ
+    std::size_t mismatch = 0, nonzero = 0;
+    double ax = 0.5;
+    for (int i = 0; i < 64; ++i, ax = std::nextafter(ax, 1.0)) {
+        double ay = 0.5;
+        for (int j = 0; j < 64; ++j, ay = std::nextafter(ay, 1.0)) {
+            auto adaptive = gaei::orient2d(ax, ay, 12, 12, 24, 24);
+            auto exact = gaei::exact::orient2d(ax, ay, 12, 12, 24, 24);
+            mismatch += (adaptive > 0) != (exact > 0) || (adaptive < 0) != (exact < 0);
+            nonzero += exact != 0;
+        }
+    }
+    OUCHI_CHECK_EQUAL(mismatch, 0u);
+    OUCHI_CHECK_TRUE(nonzero > 0u);
+}
+
+OUCHI_TEST_CASE(test_incircle)
+{
+    // 格子上の4点は同一円周上にある
+    OUCHI_CHECK_EQUAL(gaei::incircle(0, 0, 1, 0, 1, 1, 0, 1), 0.0);
+    const double o = 12345678.0;
+    OUCHI_CHECK_EQUAL(gaei::incircle(o, o, o + 1, o, o + 1, o + 1, o, o + 1), 0.0);
+    OUCHI_CHECK_TRUE(gaei::incircle(o, o, o + 1, o, o + 1, o + 1, o + 0.5, o + 0.5) > 0);
+    OUCHI_CHECK_TRUE(gaei::incircle(o, o, o + 1, o, o + 1, o + 1, o + 2, o + 2) < 0);
+    OUCHI_CHECK_TRUE(gaei::incircle(o, o, o + 1, o, o + 1, o + 1, o, std::nextafter(o + 1, o)) > 0);
+}
+
+OUCHI_TEST_CASE(test_point_traits_predicates)
+{
+    using traits = ouchi::geometry::point_traits<gaei::vertex<>>;
+    gaei::vertex<> a{ { 0, 0, 5 }, gaei::color{} }, b{ { 1, 0, 0 }, gaei::color{} }, c{ { 0, 1, 0 }, gaei::color{} };
+    OUCHI_CHECK_TRUE(traits::orient2d(a, b, c) > 0);
+    OUCHI_CHECK_TRUE(traits::orient2d(a, c, b) < 0);
+    gaei::vertex<> d{ { 1, 1, 0 }, gaei::color{} };
+    OUCHI_CHECK_EQUAL(traits::incircle(a, b, d, c), 0.0);
+}
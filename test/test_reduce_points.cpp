@@ -1,2 +1,22 @@
 ﻿#include "ouchitest.hpp"
 #include "reduce_points.hpp"
+
+OUCHI_TEST_CASE(test_decimate)
+{
+    std::vector<gaei::vertex<>> vs = {
+        { { 0, 0, 0 }, gaei::colors::none },
+        { { 1, 1, 0 }, gaei::colors::none },
+        { { 1, 1, 5 }, gaei::colors::none },
+        { { 2, 0, 0 }, gaei::colors::none },
+        { { -1, 0, 0 }, gaei::colors::none },
+    };
+    std::vector<gaei::label_t> labels = { 0, 0 | gaei::label_border, 1, 0, 0 };
+    gaei::decimate(vs, labels, 2);
+    // ラベル0の(0,0)と(1,1)は同じマス、ラベル1の点は別に残る
+    OUCHI_CHECK_EQUAL(vs.size(), 4u);
+    OUCHI_CHECK_EQUAL(labels.size(), 4u);
+    OUCHI_CHECK_EQUAL(vs[0].position.x(), 0.0);
+    OUCHI_CHECK_EQUAL(vs[1].position.z(), 5.0);
+    OUCHI_CHECK_EQUAL(labels[1], 1u);
+    OUCHI_CHECK_EQUAL(vs[3].position.x(), -1.0);
+}
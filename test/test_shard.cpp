@@ -0,0 +1,279 @@
+﻿#include <string>
+#include <vector>
+#include <filesystem>
+#include "ouchitest.hpp"
+#include "shard.hpp"
+#include "pipeline.hpp"
+
+namespace {
+
+// 20x10の格子点をlayoutで分担し、各分担が受け持つ点と、4隅とも受け持つ正方形を2つの三角形にしたメッシュ
+// 分担sはラベル0からs - 1を使わず、全ての点をラベルs(地面)とする
+std::vector<gaei::shard_mesh> grid_shards(const gaei::shard_layout& layout)
+{
+    std::vector<gaei::shard_mesh> shards(layout.count);
+    for (unsigned s = 0; s < layout.count; ++s) {
+        auto& m = shards[s];
+        m.shard = s;
+        m.layout = layout;
+        m.ground = s;
+        std::vector<std::size_t> index(20 * 10, static_cast<std::size_t>(-1));
+        for (int y = 0; y < 10; ++y) {
+            for (int x = 0; x < 20; ++x) {
+                if (!layout.covers(s, x, y)) continue;
+                index[y * 20 + x] = m.vertices.size();
+                m.vertices.push_back({ { double(x), double(y), 0.0 }, gaei::colors::none });
+                m.labels.push_back(s | (x == 0 ? gaei::label_border : 0));
+            }
+        }
+        for (int y = 0; y < 9; ++y) {
+            for (int x = 0; x < 19; ++x) {
+                const auto a = index[y * 20 + x], b = index[y * 20 + x + 1];
+                const auto c = index[(y + 1) * 20 + x + 1], d = index[(y + 1) * 20 + x];
+                if (a == static_cast<std::size_t>(-1) || b == static_cast<std::size_t>(-1) ||
+                    c == static_cast<std::size_t>(-1) || d == static_cast<std::size_t>(-1)) continue;
+                m.triangles.push_back({ a, b, c });
+                m.triangles.push_back({ a, c, d });
+            }
+        }
+    }
+    return shards;
+}
+
+}
+
+OUCHI_TEST_CASE(test_shard_layout)
+{
+    // yの方が長いので、yに沿って3本の帯に分ける
+    auto layout = gaei::shard_layout::fit(3, { 0, 0 }, { 10, 30 }, 2.0);
+    OUCHI_CHECK_EQUAL(layout.axis, 1u);
+    OUCHI_CHECK_EQUAL(layout.shard_of(5, 5), 0u);
+    OUCHI_CHECK_EQUAL(layout.shard_of(5, 15), 1u);
+    OUCHI_CHECK_EQUAL(layout.shard_of(5, 25), 2u);
+    // 範囲の外の点は両端の帯に属する
+    OUCHI_CHECK_EQUAL(layout.shard_of(5, -100), 0u);
+    OUCHI_CHECK_EQUAL(layout.shard_of(5, 100), 2u);
+    // 担当する分担は必ずその点を読み込み、のりしろは境界からmargin以内にかかる
+    for (int y = -5; y < 35; ++y) OUCHI_CHECK_TRUE(layout.covers(layout.shard_of(0, y + 0.5), 0, y + 0.5));
+    OUCHI_CHECK_TRUE(layout.covers(1, 5, 8.5));
+    OUCHI_CHECK_TRUE(!layout.covers(1, 5, 7.5));
+    OUCHI_CHECK_TRUE(!layout.covers(0, 5, 12.5));
+    OUCHI_CHECK_TRUE(layout.intersects(2, 0, 0, 1, 18.5));
+    OUCHI_CHECK_TRUE(!layout.intersects(2, 0, 0, 1, 17.5));
+    // 分担が1つならば全ての点を受け持つ
+    OUCHI_CHECK_TRUE(gaei::shard_layout{}.covers(0, 12345.0, -678.0));
+    OUCHI_CHECK_TRUE(layout == gaei::shard_layout::fit(3, { 0, 0 }, { 10, 30 }, 2.0));
+    OUCHI_CHECK_TRUE(layout != gaei::shard_layout::fit(3, { 0, 0 }, { 10, 30 }, 3.0));
+}
+
+OUCHI_TEST_CASE(test_shard_file)
+{
+    OUCHI_CHECK_EQUAL(gaei::shard_file("dir/out.wrl", 3).generic_string(), std::string("dir/out.shard3"));
+    auto layout = gaei::shard_layout::fit(2, { 0, 0 }, { 19, 9 }, 2.0);
+    auto m = grid_shards(layout)[1];
+    m.vertices[0].color = gaei::colors::green;
+    auto path = std::filesystem::temp_directory_path() / "gaei_test_shard.shard1";
+    OUCHI_CHECK_TRUE(gaei::write_shard(path, m));
+    auto r = gaei::read_shard(path);
+    OUCHI_CHECK_TRUE(r);
+    auto& read = r.unwrap();
+    OUCHI_CHECK_EQUAL(read.shard, 1u);
+    OUCHI_CHECK_TRUE(read.layout == layout);
+    OUCHI_CHECK_EQUAL(read.ground, std::size_t{ 1 });
+    OUCHI_CHECK_EQUAL(read.vertices.size(), m.vertices.size());
+    OUCHI_CHECK_TRUE(read.labels == m.labels);
+    OUCHI_CHECK_TRUE(read.triangles == m.triangles);
+    OUCHI_CHECK_EQUAL(read.vertices[0].color.value(), gaei::colors::green.value());
+    OUCHI_CHECK_EQUAL(read.vertices.back().position.x(), m.vertices.back().position.x());
+    std::filesystem::remove(path);
+    OUCHI_CHECK_TRUE(!gaei::read_shard(path));
+}
+
+OUCHI_TEST_CASE(test_merge_shards)
+{
+    auto layout = gaei::shard_layout::fit(3, { 0, 0 }, { 19, 9 }, 2.0);
+    auto shards = grid_shards(layout);
+    std::size_t total = 0;
+    for (auto& s : shards) total += s.vertices.size();
+    auto m = gaei::merge_shards(shards);
+    // のりしろの頂点は溶接され、三角形は重複も欠けもなく1つずつ残る
+    OUCHI_CHECK_EQUAL(m.vertices.size(), std::size_t{ 200 });
+    OUCHI_CHECK_EQUAL(m.welded, total - 200);
+    OUCHI_CHECK_EQUAL(m.triangles.size(), std::size_t{ 19 * 9 * 2 });
+    std::vector<int> edge_use(200 * 200);
+    for (auto& t : m.triangles) {
+        for (std::size_t k = 0; k < 3; ++k) {
+            const auto a = t[k], b = t[(k + 1) % 3];
+            ++edge_use[std::min(a, b) * 200 + std::max(a, b)];
+        }
+    }
+    // 内部の辺はちょうど2つの三角形に共有される
+    for (auto u : edge_use) OUCHI_CHECK_TRUE(u <= 2);
+    // 分担ごとの地面のラベルは1つのラベルにまとまり、地面として緑に塗られる
+    OUCHI_CHECK_EQUAL(m.ground, std::size_t{ 0 });
+    for (std::size_t i = 0; i < m.vertices.size(); ++i) {
+        OUCHI_CHECK_EQUAL(gaei::label_id(m.labels[i]), gaei::label_t{ 0 });
+        OUCHI_CHECK_EQUAL(m.vertices[i].color.value(), gaei::colors::green.value());
+        OUCHI_CHECK_EQUAL(gaei::is_border(m.labels[i]), m.vertices[i].position.x() == 0);
+    }
+}
+
+OUCHI_TEST_CASE(test_shard_pipeline_merge)
+{
+    // 平面直角座標系のような大きな座標の60x20の地面を2つの分担で処理し、中間ファイルを経て統合する
+    const gaei::vec2f base = { 30000, -40000 };
+    auto layout = gaei::shard_layout::fit(2, base, { base.x() + 59, base.y() + 19 }, 5.0);
+    gaei::pipeline_options o;
+    o.thinout_width = 1;
+    o.log = nullptr;
+    const gaei::pipeline pipe(o);
+    std::vector<gaei::shard_mesh> shards;
+    for (unsigned k = 0; k < 2; ++k) {
+        std::vector<gaei::vertex<>> vs;
+        for (int y = 0; y < 20; ++y) {
+            for (int x = 0; x < 60; ++x) {
+                const double px = base.x() + x, py = base.y() + y;
+                if (layout.covers(k, px, py)) vs.push_back({ { px, py, 0.1 * x }, gaei::colors::none });
+            }
+        }
+        std::vector<gaei::label_t> labels;
+        const auto lc = pipe.label(vs, labels);
+        const auto path = std::filesystem::temp_directory_path() / ("gaei_test_pipeline.shard" + std::to_string(k));
+        OUCHI_CHECK_TRUE(gaei::write_shard(path, pipe.shard(std::move(vs), std::move(labels), lc, k, layout)));
+        auto r = gaei::read_shard(path);
+        std::filesystem::remove(path);
+        OUCHI_CHECK_TRUE(r);
+        if (!r) return;
+        shards.push_back(std::move(r.unwrap()));
+    }
+    auto m = gaei::merge_shards(shards);
+    // のりしろの頂点は同じ座標で両方の分担に残り、溶接される
+    OUCHI_CHECK_TRUE(m.welded > 0);
+    // 頂点は入力と同じ座標で、両方の分担の三角形が残る
+    std::size_t outside = 0, per_shard[2] = {};
+    for (auto& v : m.vertices) {
+        outside += v.position.x() < base.x() - 0.5 || v.position.x() > base.x() + 59.5
+                || v.position.y() < base.y() - 0.5 || v.position.y() > base.y() + 19.5;
+    }
+    for (auto& t : m.triangles) {
+        const auto cx = (m.vertices[t[0]].position.x() + m.vertices[t[1]].position.x() + m.vertices[t[2]].position.x()) / 3;
+        const auto cy = (m.vertices[t[0]].position.y() + m.vertices[t[1]].position.y() + m.vertices[t[2]].position.y()) / 3;
+        ++per_shard[layout.shard_of(cx, cy)];
+    }
+    OUCHI_CHECK_EQUAL(outside, std::size_t{ 0 });
+    OUCHI_CHECK_TRUE(per_shard[0] > 0 && per_shard[1] > 0);
+}
+
+OUCHI_TEST_CASE(test_shard_pipeline_empty_strip)
+{
+    // 領域の左端にしか点がなく、3つの分担のうち中央と右端には点が来ない
+    auto layout = gaei::shard_layout::fit(3, { 0, 0 }, { 99, 19 }, 2.0);
+    gaei::pipeline_options o;
+    o.thinout_width = 1;
+    o.log = nullptr;
+    const gaei::pipeline pipe(o);
+    std::vector<gaei::shard_mesh> shards;
+    for (unsigned k = 0; k < 3; ++k) {
+        std::vector<gaei::vertex<>> vs;
+        for (int y = 0; y < 20; ++y) {
+            for (int x = 0; x < 20; ++x) {
+                if (layout.covers(k, x, y)) vs.push_back({ { double(x), double(y), 0.1 * x }, gaei::colors::none });
+            }
+        }
+        std::vector<gaei::label_t> labels;
+        const auto lc = pipe.label(vs, labels);
+        shards.push_back(pipe.shard(std::move(vs), std::move(labels), lc, k, layout));
+    }
+    for (unsigned k = 1; k < 3; ++k) {
+        OUCHI_CHECK_TRUE(shards[k].vertices.empty());
+        OUCHI_CHECK_TRUE(shards[k].triangles.empty());
+        OUCHI_CHECK_EQUAL(shards[k].ground, gaei::label_statistics::no_ground);
+    }
+    // 空の分担は中間ファイルを経ても空のまま読み戻せる
+    const auto path = std::filesystem::temp_directory_path() / "gaei_test_pipeline_empty.shard";
+    OUCHI_CHECK_TRUE(gaei::write_shard(path, shards[2]));
+    auto r = gaei::read_shard(path);
+    std::filesystem::remove(path);
+    OUCHI_CHECK_TRUE(r);
+    if (!r) return;
+    OUCHI_CHECK_TRUE(r.unwrap().vertices.empty());
+    auto m = gaei::merge_shards(shards);
+    OUCHI_CHECK_TRUE(!m.triangles.empty());
+    OUCHI_CHECK_TRUE(m.ground != gaei::label_statistics::no_ground);
+}
+
+OUCHI_TEST_CASE(test_patch_grid)
+{
+    // 格子の線はcell_sizeの倍数に揃い、外側の列と行は範囲の外にも伸びる
+    auto grid = gaei::patch_grid::fit({ 130, -70 }, { 390, -10 }, 100.0, 10.0);
+    OUCHI_CHECK_EQUAL(grid.columns.count, 3u);
+    OUCHI_CHECK_EQUAL(grid.rows.count, 1u);
+    OUCHI_CHECK_EQUAL(grid.columns.min, 100.0);
+    OUCHI_CHECK_EQUAL(grid.size(), 3u);
+    OUCHI_CHECK_EQUAL(grid.cell_of(150, 0), 0u);
+    OUCHI_CHECK_EQUAL(grid.cell_of(250, 0), 1u);
+    OUCHI_CHECK_EQUAL(grid.cell_of(1000, 0), 2u);
+    OUCHI_CHECK_EQUAL(grid.cell_of(0, -500), 0u);
+    grid = gaei::patch_grid::fit({ 0, 0 }, { 199, 199 }, 100.0, 10.0);
+    OUCHI_CHECK_EQUAL(grid.size(), 4u);
+    OUCHI_CHECK_EQUAL(grid.cell_of(150, 50), 1u);
+    OUCHI_CHECK_EQUAL(grid.cell_of(50, 150), 2u);
+    // のりしろの点は隣のパッチにも含まれる
+    OUCHI_CHECK_TRUE(grid.covers(0, 105, 50));
+    OUCHI_CHECK_TRUE(grid.covers(1, 105, 50));
+    OUCHI_CHECK_TRUE(!grid.covers(1, 85, 50));
+    OUCHI_CHECK_TRUE(grid.covers(3, 95, 95));
+    OUCHI_CHECK_TRUE(!grid.covers(3, 95, 50));
+    OUCHI_CHECK_TRUE(grid.intersects(3, 0, 0, 95, 95));
+    OUCHI_CHECK_TRUE(!grid.intersects(3, 0, 0, 80, 80));
+    OUCHI_CHECK_TRUE(grid.to_string() != gaei::patch_grid::fit({ 0, 0 }, { 199, 199 }, 100.0, 20.0).to_string());
+}
+
+OUCHI_TEST_CASE(test_merge_patches)
+{
+    // 40x40の地面を2x2のパッチで処理し、格子で三角形の担当を決めて統合する
+    const gaei::vec2f base = { -12000, 5000 };
+    const auto grid = gaei::patch_grid::fit(base, { base.x() + 39, base.y() + 39 }, 20.0, 4.0);
+    OUCHI_CHECK_EQUAL(grid.size(), 4u);
+    gaei::pipeline_options o;
+    o.thinout_width = 1;
+    o.log = nullptr;
+    const gaei::pipeline pipe(o);
+    std::vector<gaei::shard_mesh> patches;
+    for (unsigned c = 0; c < grid.size(); ++c) {
+        std::vector<gaei::vertex<>> vs;
+        for (int y = 0; y < 40; ++y) {
+            for (int x = 0; x < 40; ++x) {
+                const double px = base.x() + x, py = base.y() + y;
+                if (grid.covers(c, px, py)) vs.push_back({ { px, py, 0.1 * y }, gaei::colors::none });
+            }
+        }
+        std::vector<gaei::label_t> labels;
+        const auto lc = pipe.label(vs, labels);
+        patches.push_back(pipe.shard(std::move(vs), std::move(labels), lc, c, {}));
+    }
+    auto m = gaei::merge_patches(patches, grid);
+    OUCHI_CHECK_TRUE(m.welded > 0);
+    OUCHI_CHECK_TRUE(m.ground != gaei::label_statistics::no_ground);
+    // どのパッチの三角形も、重心が自身の正方形にあるものだけが残る
+    std::size_t per_cell[4] = {};
+    for (auto& t : m.triangles) {
+        const auto cx = (m.vertices[t[0]].position.x() + m.vertices[t[1]].position.x() + m.vertices[t[2]].position.x()) / 3;
+        const auto cy = (m.vertices[t[0]].position.y() + m.vertices[t[1]].position.y() + m.vertices[t[2]].position.y()) / 3;
+        ++per_cell[grid.cell_of(cx, cy)];
+    }
+    for (auto n : per_cell) OUCHI_CHECK_TRUE(n > 0);
+    std::size_t kept = 0;
+    for (auto& p : patches) kept += p.triangles.size();
+    OUCHI_CHECK_TRUE(m.triangles.size() < kept);
+}
+
+OUCHI_TEST_CASE(test_disjoint_set)
+{
+    gaei::disjoint_set s(5);
+    OUCHI_CHECK_TRUE(s.unite(3, 4));
+    OUCHI_CHECK_TRUE(s.unite(4, 1));
+    OUCHI_CHECK_TRUE(!s.unite(1, 3));
+    OUCHI_CHECK_EQUAL(s.find(4), std::size_t{ 1 });
+    OUCHI_CHECK_EQUAL(s.find(0), std::size_t{ 0 });
+}
@@ -0,0 +1,65 @@
+﻿#include <algorithm>
+#include <random>
+#include <vector>
+#include "ouchitest.hpp"
+#include "simd.hpp"
+#include "vector_utl.hpp"
+
+namespace {
+
+template<class T, std::size_t Dim>
+std::size_t simd_mismatch(std::mt19937& rng)
+{
+    std::uniform_real_distribution<T> dist(-1000, 1000);
+    std::size_t mismatch = 0;
+    for (int i = 0; i < 1000; ++i) {
+        gaei::vector<T, Dim> a, b;
+        for (auto j = 0u; j < Dim; ++j) {
+            a.coord[j] = dist(rng);
+            b.coord[j] = dist(rng);
+        }
+        // 足し合わせる順序がスカラーの実装と同じなので、結果はビット単位で一致する
+        mismatch += gaei::simd::sqdistance(a, b) != gaei::sqdistance(a, b);
+        mismatch += gaei::simd::inner_product(a, b) != gaei::inner_product(a, b);
+        if constexpr (Dim == 3) {
+            auto c = gaei::simd::cross_product(a, b);
+            mismatch += !(c == gaei::cross_product(a, b));
+        }
+    }
+    return mismatch;
+}
+
+}
+
+OUCHI_TEST_CASE(test_simd_kernels)
+{
+    std::mt19937 rng(1);
+    OUCHI_CHECK_EQUAL((simd_mismatch<double, 2>(rng)), 0u);
+    OUCHI_CHECK_EQUAL((simd_mismatch<double, 3>(rng)), 0u);
+    OUCHI_CHECK_EQUAL((simd_mismatch<double, 4>(rng)), 0u);
+    OUCHI_CHECK_EQUAL((simd_mismatch<float, 2>(rng)), 0u);
+    OUCHI_CHECK_EQUAL((simd_mismatch<float, 3>(rng)), 0u);
+    OUCHI_CHECK_EQUAL((simd_mismatch<float, 4>(rng)), 0u);
+    OUCHI_CHECK_EQUAL((simd_mismatch<double, 5>(rng)), 0u);
+}
+
+OUCHI_TEST_CASE(test_median3)
+{
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> dist(0, 3);
+    // 端数の要素も含めて、同じ値を含む組の中央値をスカラーの計算と比べる
+    std::vector<double> a(103), b(103), c(103), out(103);
+    for (auto i = 0u; i < a.size(); ++i) {
+        a[i] = dist(rng);
+        b[i] = dist(rng);
+        c[i] = dist(rng);
+    }
+    gaei::simd::median3(a.data(), b.data(), c.data(), out.data(), a.size());
+    std::size_t mismatch = 0;
+    for (auto i = 0u; i < a.size(); ++i) {
+        double v[3] = { a[i], b[i], c[i] };
+        std::sort(v, v + 3);
+        mismatch += out[i] != v[1];
+    }
+    OUCHI_CHECK_EQUAL(mismatch, 0u);
+}
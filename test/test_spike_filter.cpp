@@ -0,0 +1,63 @@
+﻿#include <vector>
+#include "ouchitest.hpp"
+#include "spike_filter.hpp"
+
+namespace {
+
+// 勾配0.1で傾いた30m四方の地面に、高さ5mの4m四方の建物が建つ点群。z(x, y)はvs[y * 30 + x]
+std::vector<gaei::vertex<>> terrain()
+{
+    std::vector<gaei::vertex<>> vs;
+    for (int y = 0; y < 30; ++y) {
+        for (int x = 0; x < 30; ++x) {
+            const bool building = 10 <= x && x < 14 && 10 <= y && y < 14;
+            vs.push_back({ { (double)x, (double)y, 0.1 * x + (building ? 5.0 : 0.0) }, gaei::colors::none });
+        }
+    }
+    return vs;
+}
+
+}
+
+OUCHI_TEST_CASE(test_height_grid_median3)
+{
+    auto vs = terrain();
+    vs[5 * 30 + 5].position.z() += 10;
+    gaei::height_grid grid(vs, 1.0);
+    grid.median3();
+    // 孤立した突起は消え、斜面と建物の角は残る
+    OUCHI_CHECK_EQUAL(grid[5 * 30 + 5], 0.5);
+    OUCHI_CHECK_EQUAL(grid[10 * 30 + 10], 6.0);
+    OUCHI_CHECK_TRUE(grid[13 * 30 + 13] > 6.0);
+    OUCHI_CHECK_EQUAL(grid[0], 0.0);
+    OUCHI_CHECK_EQUAL(grid[29 * 30 + 29], 0.1 * 29);
+}
+
+OUCHI_TEST_CASE(test_remove_spikes)
+{
+    auto vs = terrain();
+    // 鳥、多重反射による低い点、x方向に張られた電線
+    vs[5 * 30 + 5].position.z() += 20;
+    vs[20 * 30 + 3].position.z() -= 8;
+    for (int x = 18; x < 28; ++x) vs[25 * 30 + x].position.z() += 12;
+    OUCHI_CHECK_EQUAL(gaei::remove_spikes(vs, 2.0), std::size_t{ 12 });
+    OUCHI_CHECK_EQUAL(vs.size(), std::size_t{ 888 });
+    bool kept = true;
+    for (auto& v : vs) kept = kept && v.position.z() < 10 && v.position.z() > -1;
+    OUCHI_CHECK_TRUE(kept);
+    // 建物の点は全て残り、元の順序を保つ
+    std::size_t building = 0;
+    for (auto& v : vs) building += v.position.z() - 0.1 * v.position.x() > 4.9;
+    OUCHI_CHECK_EQUAL(building, std::size_t{ 16 });
+    OUCHI_CHECK_EQUAL(vs[1].position.x(), 1.0);
+}
+
+OUCHI_TEST_CASE(test_remove_spikes_unchanged)
+{
+    auto vs = terrain();
+    const auto before = vs;
+    OUCHI_CHECK_EQUAL(gaei::remove_spikes(vs, 0.5), std::size_t{ 0 });
+    bool same = vs.size() == before.size();
+    for (std::size_t i = 0; same && i < vs.size(); ++i) same = vs[i].position.z() == before[i].position.z();
+    OUCHI_CHECK_TRUE(same);
+}
@@ -34,17 +34,63 @@ OUCHI_TEST_CASE(test_ssi)
 {
     gaei::surface_structure_isolate ssi;
     std::vector<gaei::vertex<>> vvec(vs, vs+12);
-    ssi(vvec);
-    unsigned labels[4] = {};
+    std::vector<gaei::label_t> lvec;
+    ssi(vvec, lvec);
+    OUCHI_CHECK_EQUAL(lvec.size(), vvec.size());
+    gaei::label_t labels[4] = {};
     for (auto i = 0u; i < vvec.size(); ++i) {
-        labels[res[i]] = vvec.at(i).color.value();
+        labels[res[i]] = gaei::label_id(lvec.at(i));
     }
     for (auto i = 0u; i < vvec.size(); ++i) {
-        OUCHI_CHECK_EQUAL(vvec.at(i).color.value(), labels[res[i]]);
+        OUCHI_CHECK_EQUAL(gaei::label_id(lvec.at(i)), labels[res[i]]);
     }
-    for (auto i = 0; i < sizeof(labels)/sizeof(*labels); ++i) {
+    // labels[0]は使われない
+    for (auto i = 1u; i < sizeof(labels)/sizeof(*labels); ++i) {
         for (auto j = i + 1; j < sizeof(labels)/sizeof(*labels); ++j) {
             OUCHI_CHECK_TRUE(labels[i] != labels[j]);
         }
     }
 }
+
+OUCHI_TEST_CASE(test_ssi_statistics)
+{
+    gaei::surface_structure_isolate ssi;
+    std::vector<gaei::vertex<>> vvec(vs, vs+12);
+    std::vector<gaei::label_t> lvec;
+    auto label_cnt = ssi(vvec, lvec);
+    auto& st = ssi.statistics();
+    OUCHI_CHECK_EQUAL(st.size(), label_cnt);
+    // 地面(res = 3)は最も点が多い
+    auto ground = gaei::label_id(lvec.at(0));
+    OUCHI_CHECK_EQUAL(st.ground(), (size_t)ground);
+    OUCHI_CHECK_EQUAL(st[ground].count, 7u);
+    OUCHI_CHECK_EQUAL(st[ground].max_z, 0.0);
+    OUCHI_CHECK_EQUAL(st[ground].max.x(), 2.0);
+    OUCHI_CHECK_EQUAL(st[ground].max.y(), 2.0);
+    auto wall = gaei::label_id(lvec.at(3));
+    OUCHI_CHECK_EQUAL(st[wall].count, 3u);
+    OUCHI_CHECK_EQUAL(st[wall].mean_z(), 20.0);
+    OUCHI_CHECK_EQUAL(st[wall].footprint_area(), 0.0);
+    auto roof = gaei::label_id(lvec.at(5));
+    OUCHI_CHECK_EQUAL(st[roof].count, 2u);
+    // 屋根の点はどちらも地面と接している
+    OUCHI_CHECK_EQUAL(st[roof].border_count, 2u);
+}
+
+OUCHI_TEST_CASE(test_label_compact)
+{
+    gaei::surface_structure_isolate ssi;
+    std::vector<gaei::vertex<>> vvec(vs, vs+12);
+    std::vector<gaei::label_t> lvec;
+    ssi(vvec, lvec);
+    auto& st = ssi.statistics();
+    // 壁(res = 2)だけを残す
+    auto wall = gaei::label_id(lvec.at(3));
+    std::vector<gaei::label_t> remain;
+    for (auto l : lvec) if (gaei::label_id(l) == wall) remain.push_back(l);
+    auto n = st.compact(remain);
+    OUCHI_CHECK_EQUAL(n, 1u);
+    OUCHI_CHECK_EQUAL(st[0].count, 3u);
+    OUCHI_CHECK_EQUAL(st.ground(), gaei::label_statistics::no_ground);
+    for (auto l : remain) OUCHI_CHECK_EQUAL(gaei::label_id(l), 0u);
+}
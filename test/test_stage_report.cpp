@@ -0,0 +1,47 @@
+﻿#include <sstream>
+#include <string>
+#include "ouchitest.hpp"
+#include "stage_report.hpp"
+
+OUCHI_TEST_CASE(test_stage_report_nested)
+{
+    gaei::stage_report rep;
+    rep.activate();
+    {
+        gaei::scoped_stage outer("outer", 10);
+        {
+            gaei::scoped_stage inner("inner", 10);
+            inner.points_out(4);
+        }
+        outer.points_out(4);
+    }
+    rep.deactivate();
+    // レポートが無効なときは記録されない
+    {
+        gaei::scoped_stage ignored("ignored", 1);
+    }
+    auto r = rep.records();
+    OUCHI_CHECK_EQUAL(r.size(), 2u);
+    OUCHI_CHECK_EQUAL(r[0].name, std::string("outer"));
+    OUCHI_CHECK_EQUAL(r[0].depth, 0u);
+    OUCHI_CHECK_EQUAL(r[1].name, std::string("inner"));
+    OUCHI_CHECK_EQUAL(r[1].depth, 1u);
+    OUCHI_CHECK_EQUAL(r[1].points_in, 10u);
+    OUCHI_CHECK_EQUAL(r[1].points_out, 4u);
+    OUCHI_CHECK_TRUE(r[0].seconds >= r[1].seconds);
+}
+
+OUCHI_TEST_CASE(test_stage_report_json)
+{
+    gaei::stage_report rep;
+    rep.activate();
+    {
+        gaei::scoped_stage s("a\"b", 3);
+    }
+    std::stringstream ss;
+    rep.write_json(ss);
+    auto str = ss.str();
+    OUCHI_CHECK_TRUE(str.find("\"name\":\"a\\\"b\"") != std::string::npos);
+    OUCHI_CHECK_TRUE(str.find("\"points_in\":3") != std::string::npos);
+    OUCHI_CHECK_TRUE(str.front() == '{');
+}
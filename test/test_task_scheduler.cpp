@@ -0,0 +1,142 @@
+﻿#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ouchitest.hpp"
+#include "task_scheduler.hpp"
+
+namespace {
+
+// 段階を通った順を記録する要素
+struct item {
+    int value = 0;
+    std::vector<int> visited;
+};
+
+}
+
+OUCHI_TEST_CASE(test_work_stealing_pool_runs_all)
+{
+    gaei::work_stealing_pool pool(4);
+    std::atomic<int> count{ 0 };
+    for (int i = 0; i < 100; ++i) {
+        pool.submit([&pool, &count] {
+            ++count;
+            // 作業スレッドから追加した仕事も待つ
+            pool.submit([&count] { ++count; });
+        });
+    }
+    pool.wait_idle();
+    OUCHI_CHECK_EQUAL(count.load(), 200);
+    OUCHI_CHECK_EQUAL(pool.size(), 4u);
+}
+
+OUCHI_TEST_CASE(test_work_stealing_pool_exception)
+{
+    gaei::work_stealing_pool pool(2);
+    std::atomic<int> count{ 0 };
+    pool.submit([] { throw std::runtime_error("fail"); });
+    for (int i = 0; i < 10; ++i) pool.submit([&count] { ++count; });
+    bool thrown = false;
+    try {
+        pool.wait_idle();
+    }
+    catch (std::runtime_error&) {
+        thrown = true;
+    }
+    OUCHI_CHECK_TRUE(thrown);
+    OUCHI_CHECK_EQUAL(count.load(), 10);
+    // 例外は1度だけ投げ直される
+    pool.wait_idle();
+}
+
+OUCHI_TEST_CASE(test_work_stealing_pool_nested_parallel)
+{
+    gaei::work_stealing_pool pool(2);
+    std::atomic<unsigned> threads{ 0 };
+    std::atomic<std::size_t> chunks{ 0 };
+    pool.submit([&threads, &chunks] {
+        threads = gaei::hardware_threads();
+        gaei::parallel_for(1000, [&chunks](std::size_t, std::size_t) { ++chunks; }, 1);
+    });
+    pool.wait_idle();
+    // 作業スレッドの中の並列処理は直列に行われる
+    OUCHI_CHECK_EQUAL(threads.load(), 1u);
+    OUCHI_CHECK_EQUAL(chunks.load(), std::size_t{ 1 });
+}
+
+OUCHI_TEST_CASE(test_stage_graph_order)
+{
+    std::vector<item> items(50);
+    for (int i = 0; i < 50; ++i) items[i].value = i;
+    // 段階ごとに同時に処理している要素の数を数え、容量を超えないことを確かめる
+    std::mutex mtx;
+    std::vector<std::size_t> active(3), max_active(3);
+    auto stage = [&](int k) {
+        return [&, k](item& it) -> ouchi::result::result<std::monostate, std::string> {
+            {
+                std::lock_guard lk(mtx);
+                max_active[k] = std::max(max_active[k], ++active[k]);
+                it.visited.push_back(k);
+            }
+            std::this_thread::yield();
+            it.value = it.value * 10 + k;
+            std::lock_guard lk(mtx);
+            --active[k];
+            return ouchi::result::ok(std::monostate{});
+        };
+    };
+    gaei::stage_graph<item> g;
+    g.add("a", stage(0), 2).add("b", stage(1), 1).add("c", stage(2), 3);
+    gaei::work_stealing_pool pool(4);
+    auto r = g.run(items, pool);
+    OUCHI_CHECK_TRUE(!!r);
+    bool ordered = true;
+    for (int i = 0; i < 50; ++i) {
+        ordered = ordered && items[i].visited == std::vector<int>{ 0, 1, 2 } && items[i].value == i * 1000 + 12;
+    }
+    OUCHI_CHECK_TRUE(ordered);
+    for (std::size_t k = 0; k < 3; ++k) {
+        auto& s = g.stats()[k];
+        OUCHI_CHECK_EQUAL(s.items, 50u);
+        OUCHI_CHECK_TRUE(s.max_occupancy <= s.capacity);
+        OUCHI_CHECK_TRUE(max_active[k] <= s.capacity);
+        OUCHI_CHECK_TRUE(g.utilization(s) >= 0 && g.utilization(s) <= 1);
+    }
+    OUCHI_CHECK_EQUAL(g.stats()[1].name, std::string("b"));
+}
+
+OUCHI_TEST_CASE(test_stage_graph_error)
+{
+    std::vector<item> items(100);
+    for (int i = 0; i < 100; ++i) items[i].value = i;
+    gaei::stage_graph<item> g;
+    g.add("load", [](item& it) -> ouchi::result::result<std::monostate, std::string> {
+        if (it.value == 3) return ouchi::result::err(std::string("broken tile"));
+        return ouchi::result::ok(std::monostate{});
+    }, 2).add("format", [](item& it) -> ouchi::result::result<std::monostate, std::string> {
+        it.visited.push_back(1);
+        return ouchi::result::ok(std::monostate{});
+    }, 2);
+    gaei::work_stealing_pool pool(2);
+    auto r = g.run(items, pool);
+    OUCHI_CHECK_TRUE(!r);
+    OUCHI_CHECK_EQUAL(r.unwrap_err(), std::string("broken tile"));
+    // エラーの後は新しい要素を投入しない
+    OUCHI_CHECK_TRUE(g.stats()[0].items < 100u);
+    OUCHI_CHECK_TRUE(items.back().visited.empty());
+}
+
+OUCHI_TEST_CASE(test_stage_graph_empty)
+{
+    std::vector<item> items;
+    gaei::stage_graph<item> g;
+    g.add("a", [](item&) -> ouchi::result::result<std::monostate, std::string> {
+        return ouchi::result::ok(std::monostate{});
+    });
+    gaei::work_stealing_pool pool(1);
+    OUCHI_CHECK_TRUE(!!g.run(items, pool));
+    OUCHI_CHECK_EQUAL(g.stats()[0].items, 0u);
+}
@@ -0,0 +1,171 @@
+﻿#include <filesystem>
+#include <fstream>
+#include "ouchitest.hpp"
+#include "tile_cache.hpp"
+
+OUCHI_TEST_CASE(test_fnv1a)
+{
+    static_assert(gaei::fnv1a("") == 14695981039346656037ull);
+    OUCHI_CHECK_EQUAL(gaei::fnv1a("a"), 0xaf63dc4c8601ec8cull);
+    // 続きから計算しても一度に計算しても同じ
+    OUCHI_CHECK_EQUAL(gaei::fnv1a("bc", gaei::fnv1a("a")), gaei::fnv1a("abc"));
+    OUCHI_CHECK_TRUE(gaei::fnv1a(1ull, 0) != gaei::fnv1a(2ull, 0));
+}
+
+OUCHI_TEST_CASE(test_tile_cache_points)
+{
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "gaei_test_tile_cache";
+    fs::remove_all(dir);
+    gaei::tile_cache cache(dir);
+    std::vector<gaei::vertex<>> v;
+    std::size_t errors = 0;
+    OUCHI_CHECK_TRUE(!cache.load_points(1, v, errors));
+    std::vector<gaei::vertex<>> src = {
+        { { 1, 2, 3 }, gaei::colors::none },
+        { { -4.5, 5, 6.25 }, gaei::colors::none },
+    };
+    OUCHI_CHECK_TRUE(cache.store_points(1, src.data(), src.size(), 7));
+    v.push_back({ { 0, 0, 0 }, gaei::colors::none });
+    OUCHI_CHECK_TRUE(cache.load_points(1, v, errors));
+    OUCHI_CHECK_EQUAL(v.size(), 3u);
+    OUCHI_CHECK_EQUAL(errors, 7u);
+    OUCHI_CHECK_EQUAL(v[2].position.x(), -4.5);
+    OUCHI_CHECK_EQUAL(v[2].position.z(), 6.25);
+    fs::remove_all(dir);
+}
+
+OUCHI_TEST_CASE(test_tile_cache_result)
+{
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "gaei_test_tile_cache_result";
+    fs::remove_all(dir);
+    gaei::tile_cache cache(dir);
+    auto out = dir / "out.wrl";
+    std::ofstream(out) << "#VRML V2.0 utf8\n";
+    OUCHI_CHECK_TRUE(!cache.has_result(2, out));
+    OUCHI_CHECK_TRUE(cache.store_result(2, out));
+    OUCHI_CHECK_TRUE(cache.has_result(2, out));
+    OUCHI_CHECK_TRUE(!cache.has_result(3, out));
+    // 出力が書き換えられたら再利用しない
+    std::ofstream(out, std::ios::app) << "Shape {}\n";
+    OUCHI_CHECK_TRUE(!cache.has_result(2, out));
+    // 目録から参照される部分のファイルが変わっても再利用しない
+    auto part = dir / "out_L0_0_0.wrl";
+    std::ofstream(part) << "#VRML V2.0 utf8\n";
+    OUCHI_CHECK_TRUE(cache.store_result(4, out, { part }));
+    OUCHI_CHECK_TRUE(cache.has_result(4, out));
+    std::ofstream(part, std::ios::app) << "Shape {}\n";
+    OUCHI_CHECK_TRUE(!cache.has_result(4, out));
+    OUCHI_CHECK_TRUE(cache.store_result(4, out, { part }));
+    fs::remove(part);
+    OUCHI_CHECK_TRUE(!cache.has_result(4, out));
+    OUCHI_CHECK_TRUE(!cache.store_result(4, out, { part }));
+    fs::remove_all(dir);
+}
+
+OUCHI_TEST_CASE(test_resident_tiles)
+{
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "gaei_test_resident_tiles";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    auto a = dir / "a.dat", b = dir / "b.dat";
+    std::ofstream(a) << "a\n";
+    std::ofstream(b) << "b\n";
+    auto make = [](std::uint64_t h, std::size_t n) {
+        return gaei::resident_tiles::tile{ h, 0, std::vector<gaei::vertex<>>(n) };
+    };
+    // 2つ目のタイルを入れると1つ目が追い出される大きさ
+    gaei::resident_tiles tiles(sizeof(gaei::vertex<>) * 150 + 1024);
+    tiles.insert(a, 0, make(1, 100));
+    OUCHI_CHECK_TRUE(tiles.find(a, 0) != nullptr);
+    OUCHI_CHECK_TRUE(tiles.find(a, 1) == nullptr);
+    tiles.insert(b, 0, make(2, 100));
+    OUCHI_CHECK_EQUAL(tiles.size(), 1u);
+    OUCHI_CHECK_TRUE(tiles.find(a, 0) == nullptr);
+    auto t = tiles.find(b, 0);
+    OUCHI_CHECK_TRUE(t && t->content_hash == 2);
+    OUCHI_CHECK_TRUE(tiles.bytes() <= tiles.budget());
+    // 予算を超えるタイルは保持しない
+    tiles.insert(a, 0, make(3, 1000));
+    OUCHI_CHECK_TRUE(tiles.find(a, 0) == nullptr);
+    // 内容が変わったタイルは無効
+    std::ofstream(b, std::ios::app) << "changed\n";
+    OUCHI_CHECK_TRUE(tiles.find(b, 0) == nullptr);
+    OUCHI_CHECK_EQUAL(tiles.size(), 0u);
+    fs::remove_all(dir);
+}
+
+OUCHI_TEST_CASE(test_tile_cache_patch)
+{
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "gaei_test_tile_cache_patch";
+    fs::remove_all(dir);
+    gaei::tile_cache cache(dir);
+    gaei::shard_mesh m;
+    OUCHI_CHECK_TRUE(!cache.load_patch(5, m));
+    gaei::shard_mesh src;
+    src.shard = 3;
+    src.ground = 1;
+    src.vertices = {
+        { { 100.5, 200, 1 }, gaei::colors::green },
+        { { 101, 200, 2 }, gaei::colors::red },
+        { { 100.5, 201, 3 }, gaei::colors::green },
+    };
+    src.labels = { 1, 0, 1 };
+    src.triangles = { { 0, 1, 2 } };
+    OUCHI_CHECK_TRUE(cache.store_patch(5, src));
+    OUCHI_CHECK_TRUE(cache.load_patch(5, m));
+    OUCHI_CHECK_EQUAL(m.shard, 3u);
+    OUCHI_CHECK_EQUAL(m.ground, std::size_t{ 1 });
+    OUCHI_CHECK_EQUAL(m.vertices.size(), 3u);
+    OUCHI_CHECK_EQUAL(m.vertices[0].position.x(), 100.5);
+    OUCHI_CHECK_EQUAL(m.labels[1], gaei::label_t{ 0 });
+    OUCHI_CHECK_EQUAL(m.triangles.size(), 1u);
+    OUCHI_CHECK_EQUAL(m.triangles[0][2], std::size_t{ 2 });
+
+    gaei::tile_entry b;
+    OUCHI_CHECK_TRUE(!cache.load_bounds(6, b));
+    gaei::tile_entry e;
+    e.add(-1.5, 2);
+    e.add(3, 4.25);
+    OUCHI_CHECK_TRUE(cache.store_bounds(6, e));
+    OUCHI_CHECK_TRUE(cache.load_bounds(6, b));
+    OUCHI_CHECK_EQUAL(b.count, std::size_t{ 2 });
+    OUCHI_CHECK_EQUAL(b.min.x(), -1.5);
+    OUCHI_CHECK_EQUAL(b.max.y(), 4.25);
+    fs::remove_all(dir);
+}
+
+OUCHI_TEST_CASE(test_patch_key)
+{
+    // 一辺100mの3x3のタイルを同じ大きさのパッチで処理する
+    std::vector<gaei::tile_entry> bounds(9);
+    std::vector<std::uint64_t> hashes(9);
+    for (std::size_t i = 0; i < 9; ++i) {
+        const double x = 100.0 * (i % 3), y = 100.0 * (i / 3);
+        bounds[i].add(x, y);
+        bounds[i].add(x + 99, y + 99);
+        hashes[i] = gaei::fnv1a(std::to_string(i));
+    }
+    const auto grid = gaei::patch_grid::fit({ 0, 0 }, { 299, 299 }, 100.0, 10.0);
+    OUCHI_CHECK_EQUAL(grid.size(), 9u);
+    // 角のパッチは、のりしろがかかる隣のタイルにも依存する
+    OUCHI_CHECK_TRUE((gaei::patch_tiles(grid, 0, bounds) == std::vector<std::size_t>{ 0, 1, 3, 4 }));
+    OUCHI_CHECK_EQUAL(gaei::patch_tiles(grid, 4, bounds).size(), 9u);
+    std::vector<std::uint64_t> before;
+    for (unsigned c = 0; c < grid.size(); ++c) before.push_back(gaei::patch_key(1, grid, c, gaei::patch_tiles(grid, c, bounds), hashes));
+    // 角のタイルの内容が変わると、そのタイルのパッチと隣のパッチだけが作り直される
+    hashes[0] = gaei::fnv1a("changed");
+    std::vector<unsigned> dirty;
+    for (unsigned c = 0; c < grid.size(); ++c) {
+        if (gaei::patch_key(1, grid, c, gaei::patch_tiles(grid, c, bounds), hashes) != before[c]) dirty.push_back(c);
+    }
+    OUCHI_CHECK_TRUE((dirty == std::vector<unsigned>{ 0, 1, 3, 4 }));
+    // オプションが変われば全てのパッチを作り直す
+    OUCHI_CHECK_TRUE(gaei::patch_key(2, grid, 8, gaei::patch_tiles(grid, 8, bounds), hashes) != before[8]);
+    // タイルを列挙する順によらない
+    std::vector<std::size_t> reversed = { 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+    OUCHI_CHECK_EQUAL(gaei::patch_key(1, grid, 4, reversed, hashes), gaei::patch_key(1, grid, 4, gaei::patch_tiles(grid, 4, bounds), hashes));
+}
@@ -0,0 +1,66 @@
+﻿#include <filesystem>
+#include <fstream>
+#include "ouchitest.hpp"
+#include "tile_index.hpp"
+#include "dat_loader.hpp"
+
+OUCHI_TEST_CASE(test_region)
+{
+    gaei::region r;
+    OUCHI_CHECK_TRUE(r.unbounded());
+    OUCHI_CHECK_TRUE(r.set_bbox("10, 0, 0, 10"));
+    OUCHI_CHECK_TRUE(r.contains(5, 5));
+    OUCHI_CHECK_TRUE(!r.contains(11, 5));
+    OUCHI_CHECK_TRUE(r.intersects({ 9, 9 }, { 20, 20 }));
+    OUCHI_CHECK_TRUE(!r.intersects({ 11, 0 }, { 20, 20 }));
+    // 三角形(0,0) (10,0) (0,10)
+    OUCHI_CHECK_TRUE(r.set_polygon("0,0,10,0,0,10"));
+    OUCHI_CHECK_TRUE(r.contains(2, 2));
+    OUCHI_CHECK_TRUE(!r.contains(8, 8));
+    OUCHI_CHECK_TRUE(!r.set_bbox("0,0,1"));
+    OUCHI_CHECK_TRUE(!r.set_polygon("0,0,1,a,2,2"));
+}
+
+OUCHI_TEST_CASE(test_dat_loader_predicate)
+{
+    std::string s =
+        "      0.00       0.00    1.00\r\n"
+        "      5.00       5.00 -9999.99\r\n"
+        "     20.00      20.00    2.00\r\n";
+    gaei::region r;
+    r.set_bbox("-1,-1,10,10");
+    std::vector<gaei::vertex<>> v;
+    gaei::dat_loader dl;
+    auto res = dl.load_from_memory(s, v, [&r](const gaei::vertex<>& p) {
+        return p.position.z() >= -9000 && r.contains(p.position.x(), p.position.y());
+    });
+    OUCHI_CHECK_TRUE(res);
+    OUCHI_CHECK_EQUAL(v.size(), 1u);
+}
+
+OUCHI_TEST_CASE(test_tile_index_roundtrip)
+{
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "gaei_test_tile_index";
+    fs::create_directories(dir);
+    auto file = dir / "a b.dat";
+    std::ofstream(file) << "      0.00       0.00    1.00\r\n";
+    gaei::tile_index idx;
+    gaei::tile_entry e;
+    e.add(1.5, -2);
+    e.add(3, 4);
+    idx.update(file, e);
+    OUCHI_CHECK_TRUE(idx.save(dir));
+    auto loaded = gaei::tile_index::load(dir);
+    auto found = loaded.find(file);
+    OUCHI_CHECK_TRUE(found != nullptr);
+    if (found) {
+        OUCHI_CHECK_EQUAL(found->min.x(), 1.5);
+        OUCHI_CHECK_EQUAL(found->max.y(), 4.0);
+        OUCHI_CHECK_EQUAL(found->count, 2u);
+    }
+    // ファイルが変わったら項目は無効
+    std::ofstream(file, std::ios::app) << "      1.00       0.00    1.00\r\n";
+    OUCHI_CHECK_TRUE(loaded.find(file) == nullptr);
+    fs::remove_all(dir);
+}
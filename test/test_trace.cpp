@@ -0,0 +1,68 @@
+﻿#include <sstream>
+#include <string>
+#include <thread>
+#include <filesystem>
+#include "ouchitest.hpp"
+#include "trace.hpp"
+
+OUCHI_TEST_CASE(test_trace_threads)
+{
+    auto& rec = gaei::trace_recorder::instance();
+    rec.enable(4);
+    {
+        gaei::trace_scope ts("main_event", "detail");
+    }
+    std::thread th([] {
+        gaei::trace_recorder::instance().name_thread("test_worker");
+        gaei::trace_scope ts("worker_event");
+    });
+    th.join();
+    rec.disable();
+    {
+        // 無効なときは記録されない
+        gaei::trace_scope ts("disabled_event");
+    }
+    std::stringstream ss;
+    rec.write_json(ss);
+    auto str = ss.str();
+    OUCHI_CHECK_TRUE(str.find("\"name\":\"main_event\"") != std::string::npos);
+    OUCHI_CHECK_TRUE(str.find("\"detail\":\"detail\"") != std::string::npos);
+    OUCHI_CHECK_TRUE(str.find("\"name\":\"worker_event\"") != std::string::npos);
+    OUCHI_CHECK_TRUE(str.find("\"name\":\"test_worker\"") != std::string::npos);
+    OUCHI_CHECK_TRUE(str.find("disabled_event") == std::string::npos);
+}
+
+OUCHI_TEST_CASE(test_trace_ring_overflow)
+{
+    auto& rec = gaei::trace_recorder::instance();
+    rec.enable(2);
+    for (auto i = 0; i < 5; ++i) {
+        gaei::trace_scope ts(i < 3 ? "old" : "new");
+    }
+    rec.disable();
+    std::stringstream ss;
+    rec.write_json(ss);
+    auto str = ss.str();
+    OUCHI_CHECK_EQUAL(rec.dropped(), 3u);
+    OUCHI_CHECK_TRUE(str.find("\"name\":\"old\"") == std::string::npos);
+    OUCHI_CHECK_TRUE(str.find("\"name\":\"new\"") != std::string::npos);
+}
+
+OUCHI_TEST_CASE(test_trace_temporary_detail)
+{
+    auto& rec = gaei::trace_recorder::instance();
+    rec.enable(4);
+    {
+        // path::string()の一時オブジェクトをdetailに渡してもスコープが所有する
+        std::filesystem::path p = "tiles/temporary_detail_tile.las";
+        gaei::trace_scope ts("load_file", p.string());
+        // 解放された領域が再利用されても記録が壊れないようにする
+        std::string other(p.string().size(), 'x');
+        p = "overwritten";
+    }
+    rec.disable();
+    std::stringstream ss;
+    rec.write_json(ss);
+    auto str = ss.str();
+    OUCHI_CHECK_TRUE(str.find("temporary_detail_tile.las") != std::string::npos);
+}
@@ -0,0 +1,62 @@
+﻿#include <random>
+#include <algorithm>
+#include <atomic>
+#include "ouchitest.hpp"
+#include "triangle_postprocess.hpp"
+
+OUCHI_TEST_CASE(test_parallel_chunks)
+{
+    std::vector<int> hit(1000, 0);
+    std::atomic<std::size_t> calls{ 0 };
+    gaei::parallel_chunks(hit.size(), 7, [&](std::size_t b, std::size_t e, std::size_t) {
+        for (auto i = b; i < e; ++i) ++hit[i];
+        ++calls;
+    });
+    OUCHI_CHECK_EQUAL(calls.load(), 7u);
+    OUCHI_CHECK_TRUE(std::all_of(hit.begin(), hit.end(), [](int h) { return h == 1; }));
+    OUCHI_CHECK_EQUAL(gaei::chunk_count(10, 100, 8), 1u);
+    OUCHI_CHECK_EQUAL(gaei::chunk_count(1000, 100, 8), 8u);
+}
+
+OUCHI_TEST_CASE(test_radix_sort)
+{
+    std::mt19937_64 rng(1);
+    std::vector<std::uint32_t> v(100000);
+    for (auto& x : v) x = static_cast<std::uint32_t>(rng()) & 0xFFFF0F;
+    auto expected = v;
+    std::sort(expected.begin(), expected.end());
+    gaei::radix_sort(v, 4, [](std::uint32_t x, unsigned pass) { return static_cast<std::uint8_t>(x >> (pass * 8)); }, 1000);
+    OUCHI_CHECK_TRUE(v == expected);
+}
+
+OUCHI_TEST_CASE(test_remove_duplicate_triangles)
+{
+    std::vector<gaei::triangle> ts = {
+        { 2, 1, 0 }, { 0, 1, 2 }, { 1, 2, 0 }, { 3, 3, 1 }, { 300, 2, 1 }, { 1, 300, 2 },
+    };
+    gaei::triangle_postprocess_result res;
+    gaei::remove_duplicate_triangles(ts, 301, res);
+    OUCHI_CHECK_EQUAL(ts.size(), 2u);
+    OUCHI_CHECK_EQUAL(res.duplicates, 3u);
+    OUCHI_CHECK_EQUAL(res.repeated_index, 1u);
+    OUCHI_CHECK_TRUE((ts[0] == gaei::triangle{ 0, 1, 2 }));
+    OUCHI_CHECK_TRUE((ts[1] == gaei::triangle{ 1, 2, 300 }));
+}
+
+OUCHI_TEST_CASE(test_fix_triangle_orientation)
+{
+    std::vector<gaei::vertex<>> vs = {
+        { { 0, 0, 0 }, gaei::color{} },
+        { { 1, 0, 0 }, gaei::color{} },
+        { { 0, 1, 0 }, gaei::color{} },
+        { { 2, 0, 0 }, gaei::color{} },
+    };
+    std::vector<gaei::triangle> ts = { { 0, 2, 1 }, { 0, 1, 2 }, { 0, 1, 3 } };
+    auto res = gaei::postprocess_triangles(vs, ts);
+    OUCHI_CHECK_EQUAL(res.input, 3u);
+    OUCHI_CHECK_EQUAL(res.duplicates, 1u);
+    OUCHI_CHECK_EQUAL(res.zero_area, 1u);
+    OUCHI_CHECK_EQUAL(ts.size(), 2u);
+    // 反時計回りの(0,1,2)はそのまま
+    OUCHI_CHECK_TRUE((ts[0] == gaei::triangle{ 0, 1, 2 }));
+}